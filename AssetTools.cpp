@@ -0,0 +1,358 @@
+#include "tiny_gltf.h"
+#include "AssetTools.h"
+#include "CookedAsset.h"
+#include <glew.h>
+#include <glut.h>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+namespace {
+
+const uint32_t GLB_MAGIC = 0x46546C67;      // "glTF"
+const uint32_t GLB_VERSION = 2;
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004E4942;  // "BIN\0"
+
+bool HasExtension(const std::string& filename, const char* extension) {
+    std::string ext = std::filesystem::path(filename).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+        [](unsigned char c) { return (char)std::tolower(c); });
+    return ext == extension;
+}
+
+bool ReadWholeFile(const std::string& filename, std::vector<unsigned char>& data) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    data.resize((size_t)size);
+    return size == 0 || static_cast<bool>(file.read((char*)data.data(), size));
+}
+
+void PadTo4(std::vector<unsigned char>& data, unsigned char value) {
+    while (data.size() % 4 != 0) {
+        data.push_back(value);
+    }
+}
+
+// Reads a buffer or image uri, either embedded as a data uri or relative to baseDir
+bool ReadURI(const std::string& uri, const std::filesystem::path& baseDir,
+    std::vector<unsigned char>& data, std::string& mimeType) {
+    if (tinygltf::IsDataURI(uri)) {
+        return tinygltf::DecodeDataURI(&data, mimeType, uri, 0, false);
+    }
+
+    std::string decoded;
+    tinygltf::URIDecode(uri, &decoded, nullptr);
+    if (HasExtension(decoded, ".png")) {
+        mimeType = "image/png";
+    }
+    else if (HasExtension(decoded, ".jpg") || HasExtension(decoded, ".jpeg")) {
+        mimeType = "image/jpeg";
+    }
+    return ReadWholeFile((baseDir / std::filesystem::u8path(decoded)).string(), data);
+}
+
+void WriteU32(std::ofstream& out, uint32_t value) {
+    unsigned char bytes[4] = {
+        (unsigned char)(value & 0xFF), (unsigned char)((value >> 8) & 0xFF),
+        (unsigned char)((value >> 16) & 0xFF), (unsigned char)((value >> 24) & 0xFF)
+    };
+    out.write((const char*)bytes, 4);
+}
+
+// Average and best wall time in milliseconds of parsing filename
+bool TimeLoad(const std::string& filename, int iterations, double& average, double& best) {
+    average = 0.0;
+    best = 0.0;
+
+    for (int i = 0; i < iterations; i++) {
+        tinygltf::Model model;
+        std::string err;
+        std::string warn;
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = LoadGLTFFile(model, filename, err, warn);
+        auto end = std::chrono::steady_clock::now();
+
+        if (!ok) {
+            std::cerr << "Benchmark: failed to load " << filename << ": " << err << std::endl;
+            return false;
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        average += ms;
+        best = (i == 0) ? ms : std::min(best, ms);
+    }
+
+    average /= iterations;
+    return true;
+}
+
+} // namespace
+
+bool LoadGLTFFile(tinygltf::Model& model, const std::string& filename, std::string& err, std::string& warn) {
+    tinygltf::TinyGLTF loader;
+
+    if (!HasExtension(filename, ".glb")) {
+        return loader.LoadASCIIFromFile(&model, &err, &warn, filename);
+    }
+
+    std::vector<unsigned char> data;
+    if (!ReadWholeFile(filename, data)) {
+        err = "Unable to read " + filename;
+        return false;
+    }
+
+    std::string baseDir = std::filesystem::path(filename).parent_path().string();
+    return loader.LoadBinaryFromMemory(&model, &err, &warn, data.data(),
+        (unsigned int)data.size(), baseDir);
+}
+
+std::string PreferBinaryGLTF(const std::string& filename) {
+    if (!HasExtension(filename, ".gltf")) {
+        return filename;
+    }
+
+    std::filesystem::path glbPath(filename);
+    glbPath.replace_extension(".glb");
+
+    std::error_code error;
+    if (!std::filesystem::exists(glbPath, error)) {
+        return filename;
+    }
+
+    auto glbTime = std::filesystem::last_write_time(glbPath, error);
+    auto gltfTime = std::filesystem::last_write_time(filename, error);
+    if (error || glbTime < gltfTime) {
+        return filename;
+    }
+    return glbPath.string();
+}
+
+bool ConvertToGLB(const std::string& gltfPath, const std::string& glbPath) {
+    std::vector<unsigned char> text;
+    if (!ReadWholeFile(gltfPath, text)) {
+        std::cerr << "Convert: unable to read " << gltfPath << std::endl;
+        return false;
+    }
+
+    nlohmann::json gltf = nlohmann::json::parse(text.begin(), text.end(), nullptr, false);
+    if (gltf.is_discarded()) {
+        std::cerr << "Convert: invalid JSON in " << gltfPath << std::endl;
+        return false;
+    }
+
+    std::filesystem::path baseDir = std::filesystem::path(gltfPath).parent_path();
+    std::vector<unsigned char> bin;
+    std::vector<size_t> bufferOffsets;
+
+    // Every buffer goes back to back in the BIN chunk
+    if (gltf.contains("buffers")) {
+        for (auto& buffer : gltf["buffers"]) {
+            std::vector<unsigned char> data;
+            std::string mimeType;
+            std::string uri = buffer.value("uri", "");
+            if (uri.empty() || !ReadURI(uri, baseDir, data, mimeType)) {
+                std::cerr << "Convert: missing buffer '" << uri << "' for " << gltfPath << std::endl;
+                return false;
+            }
+
+            bufferOffsets.push_back(bin.size());
+            bin.insert(bin.end(), data.begin(), data.end());
+            PadTo4(bin, 0);
+        }
+    }
+
+    if (gltf.contains("bufferViews")) {
+        for (auto& view : gltf["bufferViews"]) {
+            size_t buffer = view.value("buffer", 0);
+            size_t offset = view.value("byteOffset", (size_t)0);
+            if (buffer >= bufferOffsets.size()) {
+                std::cerr << "Convert: buffer view refers to missing buffer " << buffer << " in " << gltfPath << std::endl;
+                return false;
+            }
+            view["buffer"] = 0;
+            view["byteOffset"] = offset + bufferOffsets[buffer];
+        }
+    }
+
+    // Image files become buffer views so nothing is opened beside the .glb
+    if (gltf.contains("images")) {
+        for (auto& image : gltf["images"]) {
+            if (!image.contains("uri")) {
+                continue;
+            }
+
+            std::vector<unsigned char> data;
+            std::string mimeType;
+            std::string uri = image["uri"].get<std::string>();
+            if (!ReadURI(uri, baseDir, data, mimeType)) {
+                std::cerr << "Convert: missing image '" << uri << "' for " << gltfPath << std::endl;
+                return false;
+            }
+
+            nlohmann::json view;
+            view["buffer"] = 0;
+            view["byteOffset"] = bin.size();
+            view["byteLength"] = data.size();
+            gltf["bufferViews"].push_back(view);
+
+            bin.insert(bin.end(), data.begin(), data.end());
+            PadTo4(bin, 0);
+
+            image.erase("uri");
+            image["bufferView"] = gltf["bufferViews"].size() - 1;
+            image["mimeType"] = mimeType;
+        }
+    }
+
+    if (bin.empty()) {
+        gltf.erase("buffers");
+    }
+    else {
+        gltf["buffers"] = nlohmann::json::array({ { { "byteLength", bin.size() } } });
+    }
+
+    std::string jsonText = gltf.dump();
+    while (jsonText.size() % 4 != 0) {
+        jsonText.push_back(' ');
+    }
+
+    uint32_t totalLength = 12 + 8 + (uint32_t)jsonText.size();
+    if (!bin.empty()) {
+        totalLength += 8 + (uint32_t)bin.size();
+    }
+
+    std::ofstream out(glbPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Convert: unable to write " << glbPath << std::endl;
+        return false;
+    }
+
+    WriteU32(out, GLB_MAGIC);
+    WriteU32(out, GLB_VERSION);
+    WriteU32(out, totalLength);
+
+    WriteU32(out, (uint32_t)jsonText.size());
+    WriteU32(out, GLB_CHUNK_JSON);
+    out.write(jsonText.data(), jsonText.size());
+
+    if (!bin.empty()) {
+        WriteU32(out, (uint32_t)bin.size());
+        WriteU32(out, GLB_CHUNK_BIN);
+        out.write((const char*)bin.data(), bin.size());
+    }
+
+    if (!out) {
+        std::cerr << "Convert: failed writing " << glbPath << std::endl;
+        out.close();
+        std::filesystem::remove(glbPath);
+        return false;
+    }
+    return true;
+}
+
+int ConvertDirectoryToGLB(const std::string& root) {
+    int converted = 0;
+    std::error_code error;
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(root, error)) {
+        if (!entry.is_regular_file() || !HasExtension(entry.path().string(), ".gltf")) {
+            continue;
+        }
+
+        std::filesystem::path glbPath = entry.path();
+        glbPath.replace_extension(".glb");
+
+        if (ConvertToGLB(entry.path().string(), glbPath.string())) {
+            std::cout << "Converted " << entry.path().string() << " -> " << glbPath.string()
+                << " (" << std::filesystem::file_size(glbPath, error) / 1024 << " KB)" << std::endl;
+            converted++;
+        }
+    }
+
+    if (error) {
+        std::cerr << "Convert: unable to scan " << root << ": " << error.message() << std::endl;
+    }
+    return converted;
+}
+
+void BenchmarkGLTFLoads(const std::vector<std::string>& gltfFiles, int iterations) {
+    std::cout << "Load benchmark, " << iterations << " iterations per file" << std::endl;
+
+    for (const std::string& gltfPath : gltfFiles) {
+        std::filesystem::path glbPath(gltfPath);
+        glbPath.replace_extension(".glb");
+
+        if (PreferBinaryGLTF(gltfPath) != glbPath.string() && !ConvertToGLB(gltfPath, glbPath.string())) {
+            continue;
+        }
+
+        double gltfAverage, gltfBest, glbAverage, glbBest;
+        if (!TimeLoad(gltfPath, iterations, gltfAverage, gltfBest) ||
+            !TimeLoad(glbPath.string(), iterations, glbAverage, glbBest)) {
+            continue;
+        }
+
+        std::cout << gltfPath << std::endl;
+        std::cout << "  .gltf: avg " << gltfAverage << " ms, best " << gltfBest << " ms" << std::endl;
+        std::cout << "  .glb:  avg " << glbAverage << " ms, best " << glbBest << " ms" << std::endl;
+        std::cout << "  speedup: " << gltfAverage / glbAverage << "x" << std::endl;
+    }
+}
+
+bool RunAssetTool(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--convert-glb") {
+            std::string root = (i + 1 < argc) ? argv[i + 1] : "models";
+            int converted = ConvertDirectoryToGLB(root);
+            std::cout << "Converted " << converted << " glTF files under " << root << std::endl;
+            return true;
+        }
+
+        // --cook stores textures as BC1/BC3, --cook-bc7 as BC7 (needs ARB_texture_compression_bptc)
+        if (arg == "--cook" || arg == "--cook-bc7") {
+            CookTextures textures = arg == "--cook-bc7" ? COOK_TEXTURES_BC7 : COOK_TEXTURES_BC;
+
+            // Model_3DS uploads its textures while parsing, so the 3DS cook needs a GL context
+            int glutArgc = 1;
+            glutInit(&glutArgc, argv);
+            glutCreateWindow("Asset cooker");
+            glutHideWindow();
+            glewInit();
+
+            if (i + 1 < argc) {
+                int cooked = CookDirectory(argv[i + 1], textures, { ".gltf", ".3ds" });
+                std::cout << "Cooked " << cooked << " assets under " << argv[i + 1] << std::endl;
+                return true;
+            }
+
+            int cooked = CookDirectory("models", textures, { ".gltf", ".3ds" });
+            int images = CookDirectory("textures", textures, { ".png", ".jpg", ".jpeg" });
+            std::cout << "Cooked " << cooked << " assets under models and " << images << " images under textures" << std::endl;
+            return true;
+        }
+
+        if (arg == "--benchmark-load") {
+            int iterations = (i + 1 < argc) ? std::max(1, atoi(argv[i + 1])) : 5;
+            BenchmarkGLTFLoads({
+                "models/track5/scene.gltf",
+                "models/moscow-test/scene.gltf",
+                "models/bugatti-no-wheels/scene.gltf"
+            }, iterations);
+            return true;
+        }
+    }
+    return false;
+}
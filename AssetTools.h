@@ -0,0 +1,37 @@
+#ifndef ASSETTOOLS_H
+#define ASSETTOOLS_H
+
+#include <string>
+#include <vector>
+
+// tiny_gltf.h must only be included once in the TU that defines
+// TINYGLTF_IMPLEMENTATION, so the model type is forward declared here
+namespace tinygltf {
+    class Model;
+}
+
+// Loads a .gltf or .glb file. Binary files are read with a single sequential
+// read and parsed from memory, so the whole asset costs one file open.
+bool LoadGLTFFile(tinygltf::Model& model, const std::string& filename, std::string& err, std::string& warn);
+
+// Returns the .glb sitting next to a .gltf when it is at least as new as the
+// source, otherwise the filename unchanged
+std::string PreferBinaryGLTF(const std::string& filename);
+
+// Packs a .gltf, its .bin buffers and its image files into one .glb
+bool ConvertToGLB(const std::string& gltfPath, const std::string& glbPath);
+
+// Converts every .gltf under root to a sibling .glb, returns the number written
+int ConvertDirectoryToGLB(const std::string& root);
+
+// Times parsing of each .gltf against its .glb and prints the results
+void BenchmarkGLTFLoads(const std::vector<std::string>& gltfFiles, int iterations);
+
+// Handles the offline asset command line modes:
+//   --convert-glb [directory]      (default: models)
+//   --cook [directory]             (default: models)
+//   --benchmark-load [iterations]  (default: 5)
+// Returns true when a tool ran and the game should not start
+bool RunAssetTool(int argc, char** argv);
+
+#endif
@@ -0,0 +1,589 @@
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// One 4x4 block as floats, RGBA per pixel
+typedef float Block[16][4];
+
+const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+void FetchBlock(const unsigned char* pixels, int width, int height, int components, int blockX, int blockY, Block block) {
+    for (int y = 0; y < 4; ++y) {
+        int sy = std::min(blockY * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x) {
+            int sx = std::min(blockX * 4 + x, width - 1);
+            const unsigned char* src = pixels + (static_cast<size_t>(sy) * width + sx) * components;
+            float* dst = block[y * 4 + x];
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = components == 4 ? src[3] : 255.0f;
+        }
+    }
+}
+
+void StoreBlock(const unsigned char decoded[16][4], int width, int height, int blockX, int blockY, unsigned char* rgba) {
+    for (int y = 0; y < 4; ++y) {
+        int dy = blockY * 4 + y;
+        for (int x = 0; x < 4; ++x) {
+            int dx = blockX * 4 + x;
+            if (dx < width && dy < height) {
+                memcpy(rgba + (static_cast<size_t>(dy) * width + dx) * 4, decoded[y * 4 + x], 4);
+            }
+        }
+    }
+}
+
+// Mean and dominant direction of the block's colours over the first channels
+void PrincipalAxis(const Block block, int channels, float mean[4], float axis[4]) {
+    for (int c = 0; c < 4; ++c) {
+        mean[c] = 0.0f;
+        axis[c] = 0.0f;
+    }
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            mean[c] += block[i][c] / 16.0f;
+        }
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+            }
+        }
+    }
+
+    // Power iteration; a handful of steps is plenty for 16 points
+    float vector[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {};
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                next[a] += covariance[a][b] * vector[b];
+            }
+        }
+        float length = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            length += next[c] * next[c];
+        }
+        if (length < 1e-8f) {
+            break;
+        }
+        length = std::sqrt(length);
+        for (int c = 0; c < channels; ++c) {
+            vector[c] = next[c] / length;
+        }
+    }
+
+    float length = 0.0f;
+    for (int c = 0; c < channels; ++c) {
+        length += vector[c] * vector[c];
+    }
+    length = std::sqrt(length);
+    for (int c = 0; c < channels; ++c) {
+        axis[c] = vector[c] / length;
+    }
+}
+
+// Block colours projected onto the principal axis give the two endpoints
+void FitEndpoints(const Block block, int channels, float low[4], float high[4]) {
+    float mean[4];
+    float axis[4];
+    PrincipalAxis(block, channels, mean, axis);
+
+    float minT = 0.0f;
+    float maxT = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            t += (block[i][c] - mean[c]) * axis[c];
+        }
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    for (int c = 0; c < 4; ++c) {
+        low[c] = std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+        high[c] = std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+    }
+}
+
+// Least-squares endpoints for fixed indices, where weights[i] is how much of high
+// pixel i takes. Returns false when the system is degenerate (all weights equal)
+bool RefineEndpoints(const Block block, int channels, const float weights[16], float low[4], float high[4]) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float b = weights[i];
+        float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channels; ++c) {
+            ax[c] += a * block[i][c];
+            bx[c] += b * block[i][c];
+        }
+    }
+
+    float determinant = aa * bb - ab * ab;
+    if (std::fabs(determinant) < 1e-6f) {
+        return false;
+    }
+    for (int c = 0; c < channels; ++c) {
+        low[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+        high[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+void WriteU16(unsigned char* dst, uint16_t value) {
+    dst[0] = static_cast<unsigned char>(value & 0xFF);
+    dst[1] = static_cast<unsigned char>(value >> 8);
+}
+
+uint16_t ReadU16(const unsigned char* src) {
+    return static_cast<uint16_t>(src[0] | (src[1] << 8));
+}
+
+// ---- BC1 colour blocks (also the colour half of BC3) ----
+
+uint16_t To565(const float color[4]) {
+    int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+    int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+    int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void From565(uint16_t value, int color[3]) {
+    int r = (value >> 11) & 31;
+    int g = (value >> 5) & 63;
+    int b = value & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Four-colour palette: both endpoints, then the 1/3 and 2/3 points
+void ColorPalette(uint16_t color0, uint16_t color1, bool fourColor, int palette[4][3]) {
+    From565(color0, palette[0]);
+    From565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        if (fourColor) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+float ChooseColorIndices(const Block block, uint16_t color0, uint16_t color1, unsigned char indices[16]) {
+    int palette[4][3];
+    ColorPalette(color0, color1, true, palette);
+
+    float total = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float best = 1e30f;
+        for (int p = 0; p < 4; ++p) {
+            float error = 0.0f;
+            for (int c = 0; c < 3; ++c) {
+                float d = block[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < best) {
+                best = error;
+                indices[i] = static_cast<unsigned char>(p);
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+// Always four-colour mode, which BC3 requires and which suits opaque BC1
+void EncodeColorBlock(const Block block, unsigned char* dst) {
+    float low[4];
+    float high[4];
+    FitEndpoints(block, 3, low, high);
+
+    uint16_t color0 = To565(high);
+    uint16_t color1 = To565(low);
+    unsigned char indices[16];
+    float error = ChooseColorIndices(block, color0, color1, indices);
+
+    // One least-squares pass on the chosen indices usually beats the PCA extremes
+    static const float HIGH_WEIGHT[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float weights[16];
+    for (int i = 0; i < 16; ++i) {
+        weights[i] = HIGH_WEIGHT[indices[i]];
+    }
+    if (RefineEndpoints(block, 3, weights, low, high)) {
+        uint16_t refined0 = To565(high);
+        uint16_t refined1 = To565(low);
+        unsigned char refinedIndices[16];
+        float refinedError = ChooseColorIndices(block, refined0, refined1, refinedIndices);
+        if (refinedError < error) {
+            color0 = refined0;
+            color1 = refined1;
+            memcpy(indices, refinedIndices, sizeof(indices));
+        }
+    }
+
+    // BC1 reads color0 <= color1 as three-colour mode, so keep color0 the larger
+    static const unsigned char SWAPPED[4] = { 1, 0, 3, 2 };
+    if (color0 < color1) {
+        std::swap(color0, color1);
+        for (int i = 0; i < 16; ++i) {
+            indices[i] = SWAPPED[indices[i]];
+        }
+    }
+    else if (color0 == color1) {
+        memset(indices, 0, sizeof(indices));
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i) {
+        bits |= static_cast<uint32_t>(indices[i]) << (i * 2);
+    }
+    WriteU16(dst, color0);
+    WriteU16(dst + 2, color1);
+    for (int b = 0; b < 4; ++b) {
+        dst[4 + b] = static_cast<unsigned char>(bits >> (b * 8));
+    }
+}
+
+void DecodeColorBlock(const unsigned char* src, bool allowThreeColor, unsigned char decoded[16][4]) {
+    uint16_t color0 = ReadU16(src);
+    uint16_t color1 = ReadU16(src + 2);
+    bool fourColor = !allowThreeColor || color0 > color1;
+    int palette[4][3];
+    ColorPalette(color0, color1, fourColor, palette);
+
+    uint32_t bits = src[4] | (src[5] << 8) | (src[6] << 16) | (static_cast<uint32_t>(src[7]) << 24);
+    for (int i = 0; i < 16; ++i) {
+        int index = (bits >> (i * 2)) & 3;
+        for (int c = 0; c < 3; ++c) {
+            decoded[i][c] = static_cast<unsigned char>(palette[index][c]);
+        }
+        decoded[i][3] = 255;
+    }
+}
+
+// ---- BC3 alpha blocks ----
+
+void AlphaPalette(int alpha0, int alpha1, int palette[8]) {
+    palette[0] = alpha0;
+    palette[1] = alpha1;
+    if (alpha0 > alpha1) {
+        for (int i = 1; i < 7; ++i) {
+            palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+        }
+    }
+    else {
+        for (int i = 1; i < 5; ++i) {
+            palette[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+void EncodeAlphaBlock(const Block block, unsigned char* dst) {
+    int alpha0 = 0;
+    int alpha1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        int alpha = static_cast<int>(block[i][3] + 0.5f);
+        alpha0 = std::max(alpha0, alpha);
+        alpha1 = std::min(alpha1, alpha);
+    }
+
+    uint64_t bits = 0;
+    if (alpha0 > alpha1) {
+        int palette[8];
+        AlphaPalette(alpha0, alpha1, palette);
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestError = 1e30f;
+            for (int p = 0; p < 8; ++p) {
+                float error = std::fabs(block[i][3] - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            bits |= static_cast<uint64_t>(best) << (i * 3);
+        }
+    }
+
+    dst[0] = static_cast<unsigned char>(alpha0);
+    dst[1] = static_cast<unsigned char>(alpha1);
+    for (int b = 0; b < 6; ++b) {
+        dst[2 + b] = static_cast<unsigned char>(bits >> (b * 8));
+    }
+}
+
+void DecodeAlphaBlock(const unsigned char* src, unsigned char decoded[16][4]) {
+    int palette[8];
+    AlphaPalette(src[0], src[1], palette);
+
+    uint64_t bits = 0;
+    for (int b = 0; b < 6; ++b) {
+        bits |= static_cast<uint64_t>(src[2 + b]) << (b * 8);
+    }
+    for (int i = 0; i < 16; ++i) {
+        decoded[i][3] = static_cast<unsigned char>(palette[(bits >> (i * 3)) & 7]);
+    }
+}
+
+// ---- BC7 mode 6: one subset, 7-bit RGBA endpoints with a p-bit each, 4-bit indices ----
+
+// Picks the p-bit that lands the 8-bit endpoint closest to color; value is 7 bits
+void QuantizeBC7Endpoint(const float color[4], int value[4], int& pbit) {
+    float bestError = 1e30f;
+    for (int p = 0; p < 2; ++p) {
+        int candidate[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; ++c) {
+            candidate[c] = std::min(std::max(static_cast<int>((color[c] - p) / 2.0f + 0.5f), 0), 127);
+            float d = color[c] - (candidate[c] * 2 + p);
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            pbit = p;
+            memcpy(value, candidate, sizeof(candidate));
+        }
+    }
+}
+
+float ChooseBC7Indices(const Block block, const int endpoint0[4], const int endpoint1[4], unsigned char indices[16]) {
+    int palette[16][4];
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            palette[i][c] = ((64 - BC7_WEIGHTS[i]) * endpoint0[c] + BC7_WEIGHTS[i] * endpoint1[c] + 32) >> 6;
+        }
+    }
+
+    float total = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float best = 1e30f;
+        for (int p = 0; p < 16; ++p) {
+            float error = 0.0f;
+            for (int c = 0; c < 4; ++c) {
+                float d = block[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < best) {
+                best = error;
+                indices[i] = static_cast<unsigned char>(p);
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+void PutBits(unsigned char* dst, int& position, uint32_t value, int count) {
+    for (int i = 0; i < count; ++i, ++position) {
+        if ((value >> i) & 1) {
+            dst[position >> 3] |= static_cast<unsigned char>(1 << (position & 7));
+        }
+    }
+}
+
+uint32_t GetBits(const unsigned char* src, int& position, int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; ++i, ++position) {
+        value |= static_cast<uint32_t>((src[position >> 3] >> (position & 7)) & 1) << i;
+    }
+    return value;
+}
+
+void EncodeBC7Block(const Block block, unsigned char* dst) {
+    float low[4];
+    float high[4];
+    FitEndpoints(block, 4, low, high);
+
+    int quantized[2][4];
+    int pbits[2];
+    int endpoints[2][4];
+    unsigned char indices[16];
+    float error = 0.0f;
+
+    for (int pass = 0; pass < 2; ++pass) {
+        int candidate[2][4];
+        int candidatePbits[2];
+        QuantizeBC7Endpoint(low, candidate[0], candidatePbits[0]);
+        QuantizeBC7Endpoint(high, candidate[1], candidatePbits[1]);
+
+        int candidateEndpoints[2][4];
+        for (int e = 0; e < 2; ++e) {
+            for (int c = 0; c < 4; ++c) {
+                candidateEndpoints[e][c] = candidate[e][c] * 2 + candidatePbits[e];
+            }
+        }
+
+        unsigned char candidateIndices[16];
+        float candidateError = ChooseBC7Indices(block, candidateEndpoints[0], candidateEndpoints[1], candidateIndices);
+        if (pass == 0 || candidateError < error) {
+            error = candidateError;
+            memcpy(quantized, candidate, sizeof(quantized));
+            memcpy(pbits, candidatePbits, sizeof(pbits));
+            memcpy(endpoints, candidateEndpoints, sizeof(endpoints));
+            memcpy(indices, candidateIndices, sizeof(indices));
+        }
+
+        // Second pass: least-squares endpoints for the first pass's indices
+        float weights[16];
+        for (int i = 0; i < 16; ++i) {
+            weights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+        }
+        if (pass == 0 && !RefineEndpoints(block, 4, weights, low, high)) {
+            break;
+        }
+    }
+
+    // The first pixel's index is stored without its top bit, so it has to be below 8
+    if (indices[0] >= 8) {
+        std::swap(quantized[0], quantized[1]);
+        std::swap(pbits[0], pbits[1]);
+        for (int i = 0; i < 16; ++i) {
+            indices[i] = static_cast<unsigned char>(15 - indices[i]);
+        }
+    }
+
+    memset(dst, 0, 16);
+    int position = 0;
+    PutBits(dst, position, 1 << 6, 7); // Mode 6
+    for (int c = 0; c < 4; ++c) {
+        PutBits(dst, position, quantized[0][c], 7);
+        PutBits(dst, position, quantized[1][c], 7);
+    }
+    PutBits(dst, position, pbits[0], 1);
+    PutBits(dst, position, pbits[1], 1);
+    for (int i = 0; i < 16; ++i) {
+        PutBits(dst, position, indices[i], i == 0 ? 3 : 4);
+    }
+}
+
+void DecodeBC7Block(const unsigned char* src, unsigned char decoded[16][4]) {
+    int position = 0;
+    if (GetBits(src, position, 7) != (1 << 6)) {
+        // Not mode 6; the cooker never writes anything else
+        memset(decoded, 0, 16 * 4);
+        return;
+    }
+
+    int endpoints[2][4];
+    for (int c = 0; c < 4; ++c) {
+        endpoints[0][c] = GetBits(src, position, 7) << 1;
+        endpoints[1][c] = GetBits(src, position, 7) << 1;
+    }
+    int pbit0 = GetBits(src, position, 1);
+    int pbit1 = GetBits(src, position, 1);
+    for (int c = 0; c < 4; ++c) {
+        endpoints[0][c] |= pbit0;
+        endpoints[1][c] |= pbit1;
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        int weight = BC7_WEIGHTS[GetBits(src, position, i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; ++c) {
+            decoded[i][c] = static_cast<unsigned char>(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+        }
+    }
+}
+
+size_t BlockBytes(uint32_t format) {
+    return format == BLOCK_FORMAT_BC1 ? 8 : 16;
+}
+
+} // namespace
+
+bool IsBlockFormat(uint32_t format) {
+    return format == BLOCK_FORMAT_BC1 || format == BLOCK_FORMAT_BC3 || format == BLOCK_FORMAT_BC7;
+}
+
+const char* BlockFormatName(uint32_t format) {
+    switch (format) {
+    case BLOCK_FORMAT_BC1: return "BC1";
+    case BLOCK_FORMAT_BC3: return "BC3";
+    case BLOCK_FORMAT_BC7: return "BC7";
+    default: return "raw";
+    }
+}
+
+size_t CompressedLevelSize(int width, int height, uint32_t format) {
+    size_t blocksX = (width + 3) / 4;
+    size_t blocksY = (height + 3) / 4;
+    return blocksX * blocksY * BlockBytes(format);
+}
+
+void CompressImage(const unsigned char* pixels, int width, int height, int components, uint32_t format, unsigned char* blocks) {
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    size_t blockBytes = BlockBytes(format);
+
+    Block block;
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            FetchBlock(pixels, width, height, components, bx, by, block);
+            unsigned char* dst = blocks + (static_cast<size_t>(by) * blocksX + bx) * blockBytes;
+            if (format == BLOCK_FORMAT_BC1) {
+                EncodeColorBlock(block, dst);
+            }
+            else if (format == BLOCK_FORMAT_BC3) {
+                EncodeAlphaBlock(block, dst);
+                EncodeColorBlock(block, dst + 8);
+            }
+            else {
+                EncodeBC7Block(block, dst);
+            }
+        }
+    }
+}
+
+void DecompressImage(const unsigned char* blocks, int width, int height, uint32_t format, unsigned char* rgba) {
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    size_t blockBytes = BlockBytes(format);
+
+    unsigned char decoded[16][4];
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            const unsigned char* src = blocks + (static_cast<size_t>(by) * blocksX + bx) * blockBytes;
+            if (format == BLOCK_FORMAT_BC1) {
+                DecodeColorBlock(src, true, decoded);
+            }
+            else if (format == BLOCK_FORMAT_BC3) {
+                DecodeColorBlock(src + 8, false, decoded);
+                DecodeAlphaBlock(src, decoded);
+            }
+            else {
+                DecodeBC7Block(src, decoded);
+            }
+            StoreBlock(decoded, width, height, bx, by, rgba);
+        }
+    }
+}
+
+double ComputePSNR(const unsigned char* pixels, int components, const unsigned char* rgba, size_t pixelCount) {
+    double squaredError = 0.0;
+    for (size_t i = 0; i < pixelCount; ++i) {
+        for (int c = 0; c < components; ++c) {
+            double d = static_cast<double>(pixels[i * components + c]) - rgba[i * 4 + c];
+            squaredError += d * d;
+        }
+    }
+    if (squaredError == 0.0) {
+        return 99.0;
+    }
+    double mse = squaredError / (static_cast<double>(pixelCount) * components);
+    return std::min(99.0, 10.0 * std::log10(255.0 * 255.0 / mse));
+}
@@ -0,0 +1,35 @@
+#ifndef BLOCKCOMPRESSION_H
+#define BLOCKCOMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+// CPU encoders and decoders for the block-compressed texture formats the asset
+// cooker writes. Formats are named by their GL internal format so the value can
+// go straight into CookedImage::format and glCompressedTexImage2D. Every format
+// stores 4x4 pixel blocks; edge blocks of images that are not a multiple of 4
+// repeat the last row and column.
+
+const uint32_t BLOCK_FORMAT_BC1 = 0x83F0; // GL_COMPRESSED_RGB_S3TC_DXT1_EXT: opaque RGB, 8 bytes per block
+const uint32_t BLOCK_FORMAT_BC3 = 0x83F3; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: RGB plus alpha, 16 bytes per block
+const uint32_t BLOCK_FORMAT_BC7 = 0x8E8C; // GL_COMPRESSED_RGBA_BPTC_UNORM: RGBA, 16 bytes per block (mode 6 only)
+
+bool IsBlockFormat(uint32_t format);
+
+// Short name for logs ("BC1", "BC3", "BC7")
+const char* BlockFormatName(uint32_t format);
+
+// Bytes of one compressed level
+size_t CompressedLevelSize(int width, int height, uint32_t format);
+
+// Encodes 8-bit RGB or RGBA pixels with tightly packed rows. Safe on any thread
+void CompressImage(const unsigned char* pixels, int width, int height, int components, uint32_t format, unsigned char* blocks);
+
+// Decodes back to 8-bit RGBA, for quality checks and drivers without the format
+void DecompressImage(const unsigned char* blocks, int width, int height, uint32_t format, unsigned char* rgba);
+
+// Peak signal-to-noise ratio in dB of decoded RGBA against the source pixels over
+// the source's channels; 99 when they are identical
+double ComputePSNR(const unsigned char* pixels, int components, const unsigned char* rgba, size_t pixelCount);
+
+#endif
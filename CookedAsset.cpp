@@ -0,0 +1,1306 @@
+#include "tiny_gltf.h"
+#include "stb_image.h"
+#include "Model_3DS.h"
+#include "AssetTools.h"
+#include "CookedAsset.h"
+#include "TextureUpload.h"
+#include "BlockCompression.h"
+#include "MeshSimplify.h"
+#include "MeshOptimize.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+
+static_assert(sizeof(CookedVertex) == 48, "CookedVertex layout changed; bump COOKED_VERSION");
+static_assert(sizeof(CookedHeader) == 104, "CookedHeader layout changed; bump COOKED_VERSION");
+static_assert(sizeof(CookedMaterial) == 24, "CookedMaterial layout changed; bump COOKED_VERSION");
+static_assert(sizeof(CookedImage) == 40, "CookedImage layout changed; bump COOKED_VERSION");
+static_assert(sizeof(CookedMesh) == 8, "CookedMesh layout changed; bump COOKED_VERSION");
+static_assert(sizeof(CookedPrimitive) == 72, "CookedPrimitive layout changed; bump COOKED_VERSION");
+static_assert(sizeof(CookedNode) == 140, "CookedNode layout changed; bump COOKED_VERSION");
+static_assert(sizeof(CookedLod) == 16, "CookedLod layout changed; bump COOKED_VERSION");
+
+namespace {
+
+uint64_t AlignUp(uint64_t value) {
+    return (value + 15) & ~static_cast<uint64_t>(15);
+}
+
+bool HasExtension(const std::string& filename, const char* extension) {
+    std::string ext = std::filesystem::path(filename).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+        [](unsigned char c) { return (char)std::tolower(c); });
+    return ext == extension;
+}
+
+bool IsImageFile(const std::string& filename) {
+    return HasExtension(filename, ".png") || HasExtension(filename, ".jpg") || HasExtension(filename, ".jpeg");
+}
+
+// Collects the tables and payload of a blob, then lays them out in Finish
+struct CookBuilder {
+    std::vector<CookedMaterial> materials;
+    std::vector<CookedImage> images;
+    std::vector<CookedMesh> meshes;
+    std::vector<CookedPrimitive> primitives;
+    std::vector<CookedNode> nodes;
+    std::vector<CookedLod> lods;
+    uint32_t sourceNodeCount = 0;
+    std::vector<std::string> dependencies;
+    std::vector<unsigned char> payload; // Offsets below are relative to this until Finish
+
+    CookTextures textures = COOK_TEXTURES_RAW;
+    size_t uncompressedImageBytes = 0;  // Of the compressed images only
+    size_t compressedImageBytes = 0;
+    size_t lodTriangles[COOKED_MAX_LODS] = {}; // Summed over the primitives that have each level
+    size_t chunkedPrimitives = 0;       // Source primitives split by AppendChunks
+    size_t chunks = 0;                  // Primitives they were split into
+    size_t cacheTriangles = 0;          // Level-0 triangles run through OptimizeIndexOrder
+    double cacheVertices = 0.0;         // Vertices those triangles use
+    double cacheMissesBefore = 0.0;     // Modelled post-transform cache misses, source order
+    double cacheMissesAfter = 0.0;      // And after reordering
+
+    uint64_t Append(const void* data, size_t bytes) {
+        payload.resize(AlignUp(payload.size()));
+        uint64_t offset = payload.size();
+        const unsigned char* src = static_cast<const unsigned char*>(data);
+        payload.insert(payload.end(), src, src + bytes);
+        return offset;
+    }
+
+    template <typename T>
+    static void WriteTable(std::vector<unsigned char>& blob, uint64_t offset, const std::vector<T>& table) {
+        if (!table.empty()) {
+            memcpy(&blob[offset], table.data(), table.size() * sizeof(T));
+        }
+    }
+
+    void Finish(std::vector<unsigned char>& blob) {
+        CookedHeader header = {};
+        header.magic = COOKED_MAGIC;
+        header.version = COOKED_VERSION;
+        header.materialCount = static_cast<uint32_t>(materials.size());
+        header.imageCount = static_cast<uint32_t>(images.size());
+        header.meshCount = static_cast<uint32_t>(meshes.size());
+        header.primitiveCount = static_cast<uint32_t>(primitives.size());
+        header.nodeCount = static_cast<uint32_t>(nodes.size());
+        header.sourceNodeCount = sourceNodeCount;
+        header.lodCount = static_cast<uint32_t>(lods.size());
+        header.dependencyCount = static_cast<uint32_t>(dependencies.size());
+
+        header.materialsOffset = AlignUp(sizeof(CookedHeader));
+        header.imagesOffset = AlignUp(header.materialsOffset + materials.size() * sizeof(CookedMaterial));
+        header.meshesOffset = AlignUp(header.imagesOffset + images.size() * sizeof(CookedImage));
+        header.primitivesOffset = AlignUp(header.meshesOffset + meshes.size() * sizeof(CookedMesh));
+        header.nodesOffset = AlignUp(header.primitivesOffset + primitives.size() * sizeof(CookedPrimitive));
+        header.lodsOffset = AlignUp(header.nodesOffset + nodes.size() * sizeof(CookedNode));
+        header.dependenciesOffset = AlignUp(header.lodsOffset + lods.size() * sizeof(CookedLod));
+        uint64_t dependencyBytes = 0;
+        for (const auto& path : dependencies) {
+            dependencyBytes += path.size() + 1;
+        }
+        uint64_t payloadOffset = AlignUp(header.dependenciesOffset + dependencyBytes);
+        header.fileSize = payloadOffset + payload.size();
+
+        for (auto& primitive : primitives) {
+            primitive.vertexOffset += payloadOffset;
+            if (primitive.indexType != 0) {
+                primitive.indexOffset += payloadOffset;
+            }
+        }
+        for (auto& lod : lods) {
+            lod.indexOffset += payloadOffset;
+        }
+        for (auto& image : images) {
+            image.dataOffset += payloadOffset;
+        }
+
+        blob.assign(static_cast<size_t>(header.fileSize), 0);
+        memcpy(blob.data(), &header, sizeof(header));
+        WriteTable(blob, header.materialsOffset, materials);
+        WriteTable(blob, header.imagesOffset, images);
+        WriteTable(blob, header.meshesOffset, meshes);
+        WriteTable(blob, header.primitivesOffset, primitives);
+        WriteTable(blob, header.nodesOffset, nodes);
+        WriteTable(blob, header.lodsOffset, lods);
+        uint64_t dependencyOffset = header.dependenciesOffset;
+        for (const auto& path : dependencies) {
+            memcpy(&blob[dependencyOffset], path.c_str(), path.size() + 1);
+            dependencyOffset += path.size() + 1;
+        }
+        if (!payload.empty()) {
+            memcpy(&blob[payloadOffset], payload.data(), payload.size());
+        }
+    }
+};
+
+bool HasTransparency(const unsigned char* pixels, int width, int height, int components) {
+    if (components != 4) {
+        return false;
+    }
+    size_t pixelCount = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < pixelCount; ++i) {
+        if (pixels[i * 4 + 3] != 255) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compresses each level of a raw chain and logs the size and level 0 quality
+void CompressMipChain(const std::vector<unsigned char>& levels, const CookedImage& image, const std::string& label,
+    std::vector<unsigned char>& compressed) {
+    int width = image.width;
+    int height = image.height;
+    size_t rawOffset = 0;
+    for (uint32_t level = 0; level < image.mipCount; ++level) {
+        size_t compressedOffset = compressed.size();
+        compressed.resize(compressedOffset + CompressedLevelSize(width, height, image.format));
+        CompressImage(&levels[rawOffset], width, height, image.components, image.format, &compressed[compressedOffset]);
+        rawOffset += static_cast<size_t>(width) * height * image.components;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+
+    std::vector<unsigned char> decoded(static_cast<size_t>(image.width) * image.height * 4);
+    DecompressImage(compressed.data(), image.width, image.height, image.format, decoded.data());
+    double psnr = ComputePSNR(levels.data(), image.components, decoded.data(), static_cast<size_t>(image.width) * image.height);
+
+    std::cout << "  " << label << ": " << image.width << "x" << image.height << " " << BlockFormatName(image.format)
+        << ", " << levels.size() / 1024 << " KB -> " << compressed.size() / 1024 << " KB ("
+        << static_cast<double>(levels.size()) / compressed.size() << "x), PSNR " << psnr << " dB" << std::endl;
+}
+
+// Appends an 8-bit RGB/RGBA image stored the way builder.textures asks
+int AppendImage(CookBuilder& builder, const unsigned char* pixels, int width, int height, int components, const std::string& label) {
+    CookedImage image = {};
+    image.width = width;
+    image.height = height;
+    image.components = components;
+
+    std::vector<unsigned char> levels;
+    if (builder.textures == COOK_TEXTURES_RAW) {
+        image.mipCount = 1;
+        levels.assign(pixels, pixels + static_cast<size_t>(width) * height * components);
+    }
+    else {
+        image.mipCount = BuildMipChain(pixels, width, height, components, levels);
+    }
+
+    // Anything smaller than one block (the 3DS colour swatches) stays raw
+    bool compress = builder.textures == COOK_TEXTURES_BC || builder.textures == COOK_TEXTURES_BC7;
+    if (compress && width >= 4 && height >= 4) {
+        if (builder.textures == COOK_TEXTURES_BC7) {
+            image.format = BLOCK_FORMAT_BC7;
+        }
+        else {
+            image.format = HasTransparency(pixels, width, height, components) ? BLOCK_FORMAT_BC3 : BLOCK_FORMAT_BC1;
+        }
+
+        std::vector<unsigned char> compressed;
+        CompressMipChain(levels, image, label, compressed);
+        builder.uncompressedImageBytes += levels.size();
+        builder.compressedImageBytes += compressed.size();
+        levels.swap(compressed);
+    }
+
+    image.dataSize = levels.size();
+    image.dataOffset = builder.Append(levels.data(), levels.size());
+    builder.images.push_back(image);
+    return static_cast<int>(builder.images.size()) - 1;
+}
+
+// Normalises a decoded glTF image to 8-bit RGB or RGBA
+int AppendGLTFImage(CookBuilder& builder, const tinygltf::Image& image, const std::string& label) {
+    if (image.width <= 0 || image.height <= 0 || image.image.empty()) {
+        return -1;
+    }
+
+    int sourceComponents = image.component;
+    int components = (sourceComponents == 1 || sourceComponents == 3) ? 3 : 4;
+    int bytesPerChannel = image.bits == 16 ? 2 : 1;
+    size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    if (image.image.size() < pixelCount * sourceComponents * bytesPerChannel) {
+        return -1;
+    }
+
+    std::vector<unsigned char> pixels(pixelCount * components);
+    for (size_t i = 0; i < pixelCount; ++i) {
+        unsigned char channels[4] = { 0, 0, 0, 255 };
+        for (int c = 0; c < sourceComponents; ++c) {
+            // 16-bit channels are little-endian; keep the high byte
+            channels[c] = image.image[(i * sourceComponents + c) * bytesPerChannel + bytesPerChannel - 1];
+        }
+        if (sourceComponents <= 2) {
+            // Grey (and grey + alpha) spread out to RGB(A)
+            channels[3] = sourceComponents == 2 ? channels[1] : 255;
+            channels[1] = channels[0];
+            channels[2] = channels[0];
+        }
+        memcpy(&pixels[i * components], channels, components);
+    }
+
+    return AppendImage(builder, pixels.data(), image.width, image.height, components, label);
+}
+
+int FindAttribute(const tinygltf::Primitive& primitive, const char* name) {
+    auto it = primitive.attributes.find(name);
+    return it != primitive.attributes.end() ? it->second : -1;
+}
+
+// Returns the first element of an accessor and its stride in bytes, or nullptr
+const unsigned char* GetAccessorData(const tinygltf::Model& model, int accessorIndex, int& stride) {
+    const auto& accessor = model.accessors[accessorIndex];
+    if (accessor.bufferView < 0) {
+        return nullptr;
+    }
+    const auto& view = model.bufferViews[accessor.bufferView];
+    stride = accessor.ByteStride(view);
+    if (stride <= 0) {
+        return nullptr;
+    }
+    return &model.buffers[view.buffer].data[view.byteOffset + accessor.byteOffset];
+}
+
+// One integer component as a float: normalized types map to [0, 1] or [-1, 1] the way
+// the glTF spec decodes them, the others keep their integer value
+float ReadIntegerComponent(const unsigned char* element, int componentType, bool normalized) {
+    switch (componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE: {
+        float value = *reinterpret_cast<const int8_t*>(element);
+        return normalized ? std::max(value / 127.0f, -1.0f) : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        return normalized ? *element / 255.0f : *element;
+    case TINYGLTF_COMPONENT_TYPE_SHORT: {
+        float value = *reinterpret_cast<const int16_t*>(element);
+        return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+    }
+    default: {
+        float value = *reinterpret_cast<const uint16_t*>(element);
+        return normalized ? value / 65535.0f : value;
+    }
+    }
+}
+
+// Copies a float attribute into the interleaved vertices at the given member offset.
+// Files using KHR_mesh_quantization store attributes as 8/16-bit integers instead;
+// those are decoded here, and any dequantization scale they rely on is already in the node matrices
+bool ReadFloatAttribute(const tinygltf::Model& model, int accessorIndex, int components,
+    std::vector<CookedVertex>& vertices, size_t fieldOffset) {
+    if (accessorIndex < 0) {
+        return false;
+    }
+    const auto& accessor = model.accessors[accessorIndex];
+    int componentSize = 0;
+    switch (accessor.componentType) {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+        componentSize = 4;
+        break;
+    case TINYGLTF_COMPONENT_TYPE_BYTE:
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        componentSize = 1;
+        break;
+    case TINYGLTF_COMPONENT_TYPE_SHORT:
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+        componentSize = 2;
+        break;
+    default:
+        return false;
+    }
+    if (accessor.count < vertices.size()) {
+        return false;
+    }
+
+    int stride = 0;
+    const unsigned char* data = GetAccessorData(model, accessorIndex, stride);
+    if (!data) {
+        return false;
+    }
+
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        float* dst = reinterpret_cast<float*>(reinterpret_cast<char*>(&vertices[i]) + fieldOffset);
+        if (componentSize == 4) {
+            memcpy(dst, data + i * stride, components * sizeof(float));
+            continue;
+        }
+        for (int c = 0; c < components; ++c) {
+            dst[c] = ReadIntegerComponent(data + i * stride + c * componentSize, accessor.componentType, accessor.normalized);
+        }
+    }
+    return true;
+}
+
+// Half floats keep 10 mantissa bits, so past this a texcoord step is over 1/128 of a tile
+const float HALF_TEXCOORD_LIMIT = 8.0f;
+
+// Position bounds, and COOKED_WIDE_TEXCOORDS when a texcoord is past HALF_TEXCOORD_LIMIT
+void ComputeBounds(const std::vector<CookedVertex>& vertices, CookedPrimitive& primitive) {
+    for (int c = 0; c < 3; ++c) {
+        primitive.boundsMin[c] = vertices.empty() ? 0.0f : FLT_MAX;
+        primitive.boundsMax[c] = vertices.empty() ? 0.0f : -FLT_MAX;
+    }
+    float texcoordRange = 0.0f;
+    for (const auto& vertex : vertices) {
+        for (int c = 0; c < 3; ++c) {
+            primitive.boundsMin[c] = std::min(primitive.boundsMin[c], vertex.position[c]);
+            primitive.boundsMax[c] = std::max(primitive.boundsMax[c], vertex.position[c]);
+        }
+        texcoordRange = std::max(texcoordRange, std::max(std::fabs(vertex.texcoord[0]), std::fabs(vertex.texcoord[1])));
+    }
+    if ((primitive.flags & COOKED_HAS_TEXCOORDS) && texcoordRange > HALF_TEXCOORD_LIMIT) {
+        primitive.flags |= COOKED_WIDE_TEXCOORDS;
+    }
+}
+
+uint64_t AppendIndexData(CookBuilder& builder, const std::vector<uint32_t>& indices, uint32_t indexType) {
+    if (indexType == GL_UNSIGNED_SHORT) {
+        std::vector<uint16_t> narrow(indices.begin(), indices.end());
+        return builder.Append(narrow.data(), narrow.size() * sizeof(uint16_t));
+    }
+    return builder.Append(indices.data(), indices.size() * sizeof(uint32_t));
+}
+
+// Appends indices as 16-bit whenever every vertex fits, 32-bit otherwise
+void AppendIndices(CookBuilder& builder, const std::vector<uint32_t>& indices, CookedPrimitive& primitive) {
+    primitive.indexCount = static_cast<uint32_t>(indices.size());
+    primitive.indexType = primitive.vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    primitive.indexOffset = AppendIndexData(builder, indices, primitive.indexType);
+}
+
+// Cache cost the overdraw pass may add to the cache-optimized order (5%)
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+// Reorders an indexed triangle list for the post-transform cache, then orders its
+// clusters outside-in for early depth rejection, recording the cache misses before and after
+void OptimizeIndexOrder(CookBuilder& builder, const std::vector<CookedVertex>& vertices, std::vector<uint32_t>& indices) {
+    if (indices.empty() || vertices.empty()) {
+        return;
+    }
+
+    VertexCacheStats before = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    std::vector<uint32_t> reordered = indices;
+    std::vector<size_t> clusters;
+    OptimizeVertexCache(reordered.data(), reordered.size(), vertices.size(), &clusters);
+    OptimizeOverdraw(reordered.data(), reordered.size(), vertices[0].position, vertices.size(), sizeof(CookedVertex),
+        clusters, OVERDRAW_THRESHOLD);
+    VertexCacheStats after = AnalyzeVertexCache(reordered.data(), reordered.size(), vertices.size());
+
+    // Meshes that share few vertices (the 3DS exports) can already be in a better order
+    if (after.acmr < before.acmr) {
+        indices.swap(reordered);
+    }
+    else {
+        after = before;
+    }
+
+    size_t triangles = indices.size() / 3;
+    builder.cacheTriangles += triangles;
+    builder.cacheMissesBefore += static_cast<double>(before.acmr) * triangles;
+    builder.cacheMissesAfter += static_cast<double>(after.acmr) * triangles;
+    if (before.atvr > 0.0f) {
+        builder.cacheVertices += static_cast<double>(before.acmr) * triangles / before.atvr;
+    }
+}
+
+// Renumbers the vertices in first-use order, moving locked (one flag per vertex) with them
+void OptimizeFetchOrder(std::vector<CookedVertex>& vertices, std::vector<uint32_t>& indices,
+    std::vector<unsigned char>* locked = nullptr) {
+    std::vector<uint32_t> remap;
+    OptimizeVertexFetch(indices.data(), indices.size(), vertices.size(), remap);
+    ApplyVertexRemap(vertices, remap);
+    if (locked) {
+        ApplyVertexRemap(*locked, remap);
+    }
+}
+
+// Primitives below this many triangles are cheap enough to always draw in full
+const size_t LOD_MIN_TRIANGLES = 256;
+
+// Simplification error allowed for the coarsest level, as a fraction of the bounds diagonal
+const float LOD_MAX_ERROR = 0.05f;
+
+// Builds up to COOKED_MAX_LODS - 1 simplified index lists for an indexed triangle
+// primitive, each aiming at half the previous level's triangles. A level that would
+// not drop at least 15% of its predecessor's triangles ends the chain
+void AppendLods(CookBuilder& builder, const std::vector<CookedVertex>& vertices, const std::vector<uint32_t>& indices,
+    CookedPrimitive& primitive, const unsigned char* lockedVertices = nullptr) {
+    primitive.firstLod = static_cast<uint32_t>(builder.lods.size());
+    primitive.lodCount = 0;
+    builder.lodTriangles[0] += (primitive.indexType != 0 ? indices.size() : vertices.size()) / 3;
+    if (primitive.mode != GL_TRIANGLES || primitive.indexType == 0 || indices.size() / 3 < LOD_MIN_TRIANGLES) {
+        return;
+    }
+
+    float diagonal = 0.0f;
+    for (int c = 0; c < 3; ++c) {
+        float extent = primitive.boundsMax[c] - primitive.boundsMin[c];
+        diagonal += extent * extent;
+    }
+    float maxError = std::sqrt(diagonal) * LOD_MAX_ERROR;
+
+    // Each level is simplified from the previous one, so errors add up along the chain
+    std::vector<uint32_t> previous = indices;
+    float previousError = 0.0f;
+    for (uint32_t level = 1; level < COOKED_MAX_LODS; ++level) {
+        std::vector<uint32_t> simplified;
+        float error = previousError + SimplifyMesh(previous.data(), previous.size(), vertices[0].position, vertices.size(),
+            sizeof(CookedVertex), previous.size() / 2, maxError - previousError, simplified, lockedVertices);
+        if (simplified.empty() || simplified.size() > previous.size() * 85 / 100) {
+            break;
+        }
+        // Simplification keeps the triangles in their old order, which the collapses have broken up
+        OptimizeVertexCache(simplified.data(), simplified.size(), vertices.size());
+
+        CookedLod lod;
+        lod.indexCount = static_cast<uint32_t>(simplified.size());
+        lod.indexOffset = AppendIndexData(builder, simplified, primitive.indexType);
+        lod.error = error;
+        previousError = error;
+        builder.lods.push_back(lod);
+        builder.lodTriangles[level] += simplified.size() / 3;
+        primitive.lodCount++;
+        previous.swap(simplified);
+    }
+}
+
+// Indexed triangle primitives above this many triangles (the city, the track) are split
+// into spatial chunks of at most this size, so the renderer culls, LODs and draws pieces
+// of the scene instead of the whole authored mesh
+const size_t CHUNK_TRIANGLES = 4096;
+
+// Orders the triangles in order[first, last) into runs of at most CHUNK_TRIANGLES by
+// halving them at the median centroid along the longest axis of the centroids' bounds.
+// Appends the end of each run to chunkEnds
+void SplitTriangles(std::vector<uint32_t>& order, size_t first, size_t last, const std::vector<float>& centroids,
+    std::vector<size_t>& chunkEnds) {
+    if (last - first <= CHUNK_TRIANGLES) {
+        chunkEnds.push_back(last);
+        return;
+    }
+
+    float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t t = first; t < last; ++t) {
+        for (int c = 0; c < 3; ++c) {
+            lower[c] = std::min(lower[c], centroids[order[t] * 3 + c]);
+            upper[c] = std::max(upper[c], centroids[order[t] * 3 + c]);
+        }
+    }
+    int axis = 0;
+    for (int c = 1; c < 3; ++c) {
+        if (upper[c] - lower[c] > upper[axis] - lower[axis]) {
+            axis = c;
+        }
+    }
+
+    size_t middle = first + (last - first) / 2;
+    std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + last, [&](uint32_t a, uint32_t b) {
+        return centroids[a * 3 + axis] < centroids[b * 3 + axis];
+    });
+    SplitTriangles(order, first, middle, centroids, chunkEnds);
+    SplitTriangles(order, middle, last, centroids, chunkEnds);
+}
+
+// Appends a large indexed triangle primitive as spatial chunks, each a primitive of its
+// own with the source's material and only the vertices it uses. Vertices on a cut between
+// chunks are locked while building the LODs, so neighbouring chunks stay crack-free at any level
+void AppendChunks(CookBuilder& builder, const std::vector<CookedVertex>& vertices, const std::vector<uint32_t>& indices,
+    const CookedPrimitive& source) {
+    size_t triangleCount = indices.size() / 3;
+    std::vector<float> centroids(triangleCount * 3);
+    std::vector<uint32_t> order(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int c = 0; c < 3; ++c) {
+            centroids[t * 3 + c] = (vertices[indices[t * 3]].position[c] + vertices[indices[t * 3 + 1]].position[c]
+                + vertices[indices[t * 3 + 2]].position[c]) / 3.0f;
+        }
+        order[t] = static_cast<uint32_t>(t);
+    }
+
+    std::vector<size_t> chunkEnds;
+    SplitTriangles(order, 0, triangleCount, centroids, chunkEnds);
+
+    std::vector<uint32_t> lastChunk(vertices.size(), UINT32_MAX);
+    std::vector<unsigned char> onCut(vertices.size(), 0);
+    size_t begin = 0;
+    for (size_t chunk = 0; chunk < chunkEnds.size(); begin = chunkEnds[chunk++]) {
+        for (size_t t = begin; t < chunkEnds[chunk]; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = indices[order[t] * 3 + k];
+                if (lastChunk[v] != UINT32_MAX && lastChunk[v] != chunk) {
+                    onCut[v] = 1;
+                }
+                lastChunk[v] = static_cast<uint32_t>(chunk);
+            }
+        }
+    }
+
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    begin = 0;
+    for (size_t chunk = 0; chunk < chunkEnds.size(); begin = chunkEnds[chunk++]) {
+        std::vector<CookedVertex> chunkVertices;
+        std::vector<uint32_t> chunkIndices;
+        std::vector<unsigned char> locked;
+        std::vector<uint32_t> used;
+        for (size_t t = begin; t < chunkEnds[chunk]; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = indices[order[t] * 3 + k];
+                if (remap[v] == UINT32_MAX) {
+                    remap[v] = static_cast<uint32_t>(chunkVertices.size());
+                    chunkVertices.push_back(vertices[v]);
+                    locked.push_back(onCut[v]);
+                    used.push_back(v);
+                }
+                chunkIndices.push_back(remap[v]);
+            }
+        }
+        for (uint32_t v : used) {
+            remap[v] = UINT32_MAX;
+        }
+
+        OptimizeIndexOrder(builder, chunkVertices, chunkIndices);
+        OptimizeFetchOrder(chunkVertices, chunkIndices, &locked);
+
+        CookedPrimitive primitive = source;
+        primitive.vertexCount = static_cast<uint32_t>(chunkVertices.size());
+        primitive.vertexOffset = builder.Append(chunkVertices.data(), chunkVertices.size() * sizeof(CookedVertex));
+        AppendIndices(builder, chunkIndices, primitive);
+        ComputeBounds(chunkVertices, primitive);
+        AppendLods(builder, chunkVertices, chunkIndices, primitive, locked.data());
+        builder.primitives.push_back(primitive);
+    }
+
+    builder.chunkedPrimitives++;
+    builder.chunks += chunkEnds.size();
+}
+
+bool ReadIndices(const tinygltf::Model& model, int accessorIndex, std::vector<uint32_t>& indices) {
+    const auto& accessor = model.accessors[accessorIndex];
+    int stride = 0;
+    const unsigned char* data = GetAccessorData(model, accessorIndex, stride);
+    if (!data) {
+        return false;
+    }
+
+    indices.resize(accessor.count);
+    for (size_t i = 0; i < accessor.count; ++i) {
+        const unsigned char* element = data + i * stride;
+        switch (accessor.componentType) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            indices[i] = *element;
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            indices[i] = *reinterpret_cast<const uint16_t*>(element);
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            indices[i] = *reinterpret_cast<const uint32_t*>(element);
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CookGLTFPrimitive(CookBuilder& builder, const tinygltf::Model& model, const tinygltf::Primitive& source) {
+    int positionAccessor = FindAttribute(source, "POSITION");
+    if (positionAccessor < 0) {
+        return false;
+    }
+
+    std::vector<CookedVertex> vertices(model.accessors[positionAccessor].count, CookedVertex());
+    if (!ReadFloatAttribute(model, positionAccessor, 3, vertices, offsetof(CookedVertex, position))) {
+        return false;
+    }
+
+    CookedPrimitive primitive = {};
+    if (ReadFloatAttribute(model, FindAttribute(source, "NORMAL"), 3, vertices, offsetof(CookedVertex, normal))) {
+        primitive.flags |= COOKED_HAS_NORMALS;
+    }
+    if (ReadFloatAttribute(model, FindAttribute(source, "TEXCOORD_0"), 2, vertices, offsetof(CookedVertex, texcoord))) {
+        primitive.flags |= COOKED_HAS_TEXCOORDS;
+    }
+    if (ReadFloatAttribute(model, FindAttribute(source, "TANGENT"), 4, vertices, offsetof(CookedVertex, tangent))) {
+        primitive.flags |= COOKED_HAS_TANGENTS;
+    }
+
+    std::vector<uint32_t> indices;
+    if (source.indices >= 0 && !ReadIndices(model, source.indices, indices)) {
+        return false;
+    }
+
+    primitive.mode = source.mode >= 0 ? source.mode : GL_TRIANGLES;
+    primitive.material = source.material;
+    bool validTriangles = primitive.mode == GL_TRIANGLES && source.indices >= 0 && !indices.empty() &&
+        *std::max_element(indices.begin(), indices.end()) < vertices.size();
+    if (validTriangles && indices.size() / 3 > CHUNK_TRIANGLES) {
+        AppendChunks(builder, vertices, indices, primitive);
+        return true;
+    }
+    if (validTriangles) {
+        OptimizeIndexOrder(builder, vertices, indices);
+        OptimizeFetchOrder(vertices, indices);
+    }
+
+    primitive.vertexCount = static_cast<uint32_t>(vertices.size());
+    primitive.vertexOffset = builder.Append(vertices.data(), vertices.size() * sizeof(CookedVertex));
+    if (source.indices >= 0) {
+        AppendIndices(builder, indices, primitive);
+    }
+    ComputeBounds(vertices, primitive);
+    AppendLods(builder, vertices, indices, primitive);
+
+    builder.primitives.push_back(primitive);
+    return true;
+}
+
+glm::mat4 ComputeLocalTransform(const tinygltf::Node& node) {
+    glm::mat4 localTransform = glm::mat4(1.0f);
+
+    if (node.matrix.size() == 16) {
+        localTransform = glm::make_mat4(node.matrix.data());
+    }
+    else {
+        if (node.translation.size() == 3) {
+            localTransform = glm::translate(localTransform,
+                glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+        }
+
+        if (node.rotation.size() == 4) {
+            glm::quat q = glm::quat(node.rotation[3], node.rotation[0],
+                node.rotation[1], node.rotation[2]);
+            localTransform = localTransform * glm::mat4_cast(q);
+        }
+
+        if (node.scale.size() == 3) {
+            localTransform = glm::scale(localTransform,
+                glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+        }
+    }
+
+    return localTransform;
+}
+
+void AppendNode(CookBuilder& builder, int node, int mesh, int parent, const glm::mat4& local) {
+    CookedNode cooked;
+    cooked.node = node;
+    cooked.mesh = mesh;
+    cooked.parent = parent;
+    glm::mat4 world = parent >= 0 ? glm::make_mat4(builder.nodes[parent].world) * local : local;
+    memcpy(cooked.local, glm::value_ptr(local), sizeof(cooked.local));
+    memcpy(cooked.world, glm::value_ptr(world), sizeof(cooked.world));
+    builder.nodes.push_back(cooked);
+}
+
+// Walks the default scene depth first (the order the original recursive draw used)
+// and bakes every node's world matrix
+void CookGLTFNodes(CookBuilder& builder, const tinygltf::Model& model) {
+    builder.sourceNodeCount = static_cast<uint32_t>(model.nodes.size());
+    if (model.scenes.empty()) {
+        return;
+    }
+
+    std::vector<bool> placed(model.nodes.size(), false);
+    const tinygltf::Scene& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+    std::vector<std::pair<int, int>> stack; // (node, parent cooked index)
+    for (auto it = scene.nodes.rbegin(); it != scene.nodes.rend(); ++it) {
+        stack.push_back({ *it, -1 });
+    }
+
+    while (!stack.empty()) {
+        int nodeIndex = stack.back().first;
+        int parent = stack.back().second;
+        stack.pop_back();
+        if (placed[nodeIndex]) {
+            continue; // Malformed file reusing a node; keep the first placement
+        }
+        placed[nodeIndex] = true;
+
+        const tinygltf::Node& node = model.nodes[nodeIndex];
+        int cookedIndex = static_cast<int>(builder.nodes.size());
+        AppendNode(builder, nodeIndex, node.mesh, parent, ComputeLocalTransform(node));
+
+        for (auto it = node.children.rbegin(); it != node.children.rend(); ++it) {
+            stack.push_back({ *it, cookedIndex });
+        }
+    }
+}
+
+void CookGLTF(CookBuilder& builder, const tinygltf::Model& model) {
+    // Only base colour images are drawn, so normal/metallic maps are left out
+    std::vector<int> imageMap(model.images.size(), -2);
+    for (const auto& material : model.materials) {
+        const auto& pbr = material.pbrMetallicRoughness;
+        CookedMaterial cooked = { -1, 0, { 1.0f, 1.0f, 1.0f, 1.0f } };
+
+        if (pbr.baseColorTexture.index >= 0) {
+            cooked.textured = 1;
+            int source = model.textures[pbr.baseColorTexture.index].source;
+            if (source >= 0) {
+                if (imageMap[source] == -2) {
+                    const auto& image = model.images[source];
+                    std::string label = !image.uri.empty() ? image.uri : !image.name.empty() ? image.name : "image " + std::to_string(source);
+                    imageMap[source] = AppendGLTFImage(builder, image, label);
+                }
+                cooked.image = imageMap[source];
+            }
+        }
+        else if (pbr.baseColorFactor.size() == 4) {
+            for (int c = 0; c < 4; ++c) {
+                cooked.baseColor[c] = static_cast<float>(pbr.baseColorFactor[c]);
+            }
+        }
+        builder.materials.push_back(cooked);
+    }
+
+    for (const auto& mesh : model.meshes) {
+        CookedMesh cooked;
+        cooked.firstPrimitive = static_cast<uint32_t>(builder.primitives.size());
+        for (const auto& primitive : mesh.primitives) {
+            CookGLTFPrimitive(builder, model, primitive);
+        }
+        cooked.primitiveCount = static_cast<uint32_t>(builder.primitives.size()) - cooked.firstPrimitive;
+        builder.meshes.push_back(cooked);
+    }
+
+    CookGLTFNodes(builder, model);
+}
+
+// Model_3DS uploads its textures while parsing, so this needs a current GL context
+bool Cook3DS(CookBuilder& builder, const std::string& filename) {
+    if (!std::filesystem::exists(filename)) {
+        std::cerr << "Failed to load 3DS: " << filename << std::endl;
+        return false;
+    }
+
+    Model_3DS source;
+    std::vector<char> name(filename.begin(), filename.end());
+    name.push_back('\0');
+    source.Load(name.data());
+
+    for (int i = 0; i < source.numMaterials; ++i) {
+        Model_3DS::Material& material = source.Materials[i];
+        CookedMaterial cooked = { -1, 1, { 1.0f, 1.0f, 1.0f, 1.0f } };
+
+        if (material.tex.texturename) {
+            builder.dependencies.push_back(material.tex.texturename);
+            int width, height, components;
+            unsigned char* pixels = stbi_load(material.tex.texturename, &width, &height, &components, 0);
+            if (pixels && (components == 3 || components == 4)) {
+                // GLTexture uploads bitmaps bottom row first; keep that orientation
+                size_t rowBytes = static_cast<size_t>(width) * components;
+                std::vector<unsigned char> flipped(rowBytes * height);
+                for (int y = 0; y < height; ++y) {
+                    memcpy(&flipped[y * rowBytes], pixels + (height - 1 - y) * rowBytes, rowBytes);
+                }
+                cooked.image = AppendImage(builder, flipped.data(), width, height, components, material.tex.texturename);
+            }
+            stbi_image_free(pixels);
+        }
+        else {
+            // Untextured materials draw through a solid colour texture, as in Model_3DS
+            unsigned char color[3] = { material.color.r, material.color.g, material.color.b };
+            cooked.image = AppendImage(builder, color, 1, 1, 3, material.name);
+        }
+        builder.materials.push_back(cooked);
+
+        // The loader's own copy of the texture is not needed
+        if (material.tex.texture[0]) {
+            glDeleteTextures(1, material.tex.texture);
+        }
+    }
+
+    builder.sourceNodeCount = source.numObjects;
+    for (int i = 0; i < source.numObjects; ++i) {
+        const Model_3DS::Object& object = source.Objects[i];
+
+        std::vector<CookedVertex> vertices(object.numVerts, CookedVertex());
+        for (int v = 0; v < object.numVerts; ++v) {
+            memcpy(vertices[v].position, &object.Vertexes[v * 3], sizeof(float) * 3);
+            memcpy(vertices[v].normal, &object.Normals[v * 3], sizeof(float) * 3);
+            if (v < object.numTexCoords) {
+                memcpy(vertices[v].texcoord, &object.TexCoords[v * 2], sizeof(float) * 2);
+            }
+        }
+
+        // Every material group shares the object's vertices: each group is reordered on its
+        // own, then the vertices once in the order the groups, drawn one after another, use them
+        std::vector<std::vector<uint32_t>> groups(object.numMatFaces);
+        std::vector<uint32_t> allIndices;
+        for (int j = 0; j < object.numMatFaces; ++j) {
+            const Model_3DS::MaterialFaces& faces = object.MatFaces[j];
+            groups[j].assign(faces.subFaces, faces.subFaces + faces.numSubFaces);
+            OptimizeIndexOrder(builder, vertices, groups[j]);
+            allIndices.insert(allIndices.end(), groups[j].begin(), groups[j].end());
+        }
+        OptimizeFetchOrder(vertices, allIndices);
+
+        // Vertices on a border between material groups are locked while building the LODs,
+        // as AppendChunks does for its cuts, so the groups stay crack-free at any level
+        std::vector<int> firstGroup(vertices.size(), -1);
+        std::vector<unsigned char> sharedVertices(vertices.size(), 0);
+        size_t groupEnd = 0;
+        for (int j = 0; j < object.numMatFaces; ++j) {
+            size_t groupBegin = groupEnd;
+            groupEnd += groups[j].size();
+            for (size_t k = groupBegin; k < groupEnd; ++k) {
+                uint32_t v = allIndices[k];
+                if (firstGroup[v] < 0) {
+                    firstGroup[v] = j;
+                }
+                else if (firstGroup[v] != j) {
+                    sharedVertices[v] = 1;
+                }
+            }
+        }
+
+        CookedPrimitive primitive = {};
+        primitive.mode = GL_TRIANGLES;
+        primitive.flags = COOKED_HAS_NORMALS | COOKED_HAS_TEXCOORDS;
+        primitive.vertexCount = object.numVerts;
+        primitive.vertexOffset = builder.Append(vertices.data(), vertices.size() * sizeof(CookedVertex));
+        ComputeBounds(vertices, primitive);
+
+        CookedMesh mesh;
+        mesh.firstPrimitive = static_cast<uint32_t>(builder.primitives.size());
+        mesh.primitiveCount = object.numMatFaces;
+        size_t groupStart = 0;
+        for (int j = 0; j < object.numMatFaces; ++j) {
+            std::vector<uint32_t> indices(allIndices.begin() + groupStart, allIndices.begin() + groupStart + groups[j].size());
+            groupStart += groups[j].size();
+            primitive.material = object.MatFaces[j].MatIndex;
+            primitive.indexType = GL_UNSIGNED_SHORT;
+            primitive.indexCount = static_cast<uint32_t>(indices.size());
+            primitive.indexOffset = AppendIndexData(builder, indices, GL_UNSIGNED_SHORT);
+            AppendLods(builder, vertices, indices, primitive, sharedVertices.data());
+            builder.primitives.push_back(primitive);
+        }
+        builder.meshes.push_back(mesh);
+
+        // Same order as Model_3DS::Draw: translate, then rotate about z, y, x (degrees)
+        glm::mat4 local = glm::translate(glm::mat4(1.0f), glm::vec3(object.pos.x, object.pos.y, object.pos.z));
+        local = glm::rotate(local, glm::radians(object.rot.z), glm::vec3(0.0f, 0.0f, 1.0f));
+        local = glm::rotate(local, glm::radians(object.rot.y), glm::vec3(0.0f, 1.0f, 0.0f));
+        local = glm::rotate(local, glm::radians(object.rot.x), glm::vec3(1.0f, 0.0f, 0.0f));
+        AppendNode(builder, i, i, -1, local);
+    }
+    return true;
+}
+
+// A standalone image: one image, one material using it, no meshes
+bool CookImage(CookBuilder& builder, const std::string& filename) {
+    // Grey and grey-alpha files are expanded so the upload only ever sees RGB or RGBA
+    int width, height, fileComponents;
+    if (!stbi_info(filename.c_str(), &width, &height, &fileComponents)) {
+        std::cerr << "Failed to load texture: " << filename << std::endl;
+        return false;
+    }
+    int components = (fileComponents == 2 || fileComponents == 4) ? 4 : 3;
+
+    unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &fileComponents, components);
+    if (!pixels) {
+        std::cerr << "Failed to load texture: " << filename << std::endl;
+        return false;
+    }
+
+    CookedMaterial material = { -1, 1, { 1.0f, 1.0f, 1.0f, 1.0f } };
+    material.image = AppendImage(builder, pixels, width, height, components, filename);
+    builder.materials.push_back(material);
+    stbi_image_free(pixels);
+    return true;
+}
+
+bool IsUpToDate(const std::string& cookedPath, const std::string& sourcePath) {
+    std::error_code error;
+    if (!std::filesystem::exists(cookedPath, error)) {
+        return false;
+    }
+    auto cookedTime = std::filesystem::last_write_time(cookedPath, error);
+    auto sourceTime = std::filesystem::last_write_time(sourcePath, error);
+    return !error && cookedTime >= sourceTime;
+}
+
+// A dependency that has gone missing does not make the blob stale: the source could not be cooked again anyway
+bool DependenciesUpToDate(const CookedAsset& cooked, const std::string& cookedPath) {
+    std::error_code error;
+    auto cookedTime = std::filesystem::last_write_time(cookedPath, error);
+    if (error) {
+        return false;
+    }
+    for (const auto& path : cooked.Dependencies()) {
+        auto dependencyTime = std::filesystem::last_write_time(path, error);
+        if (!error && dependencyTime > cookedTime) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The .glb read in place of the .gltf, and the external buffers and images either one names
+void AddGLTFDependencies(CookBuilder& builder, const tinygltf::Model& model, const std::string& sourcePath,
+    const std::string& loadedPath) {
+    if (loadedPath != sourcePath) {
+        builder.dependencies.push_back(loadedPath);
+    }
+    std::filesystem::path baseDir = std::filesystem::path(loadedPath).parent_path();
+    auto add = [&](const std::string& uri) {
+        if (uri.empty() || tinygltf::IsDataURI(uri)) {
+            return;
+        }
+        std::string decoded;
+        tinygltf::URIDecode(uri, &decoded, nullptr);
+        builder.dependencies.push_back((baseDir / decoded).string());
+    };
+    for (const auto& buffer : model.buffers) {
+        add(buffer.uri);
+    }
+    for (const auto& image : model.images) {
+        add(image.uri);
+    }
+}
+
+// Bytes the image's levels need; UINT64_MAX for a layout the loader cannot upload
+uint64_t ImageDataSize(const CookedImage& image) {
+    if (image.width == 0 || image.height == 0 || image.mipCount == 0 ||
+        image.mipCount > static_cast<uint32_t>(MipLevelCount(image.width, image.height)) ||
+        (image.components != 3 && image.components != 4)) {
+        return UINT64_MAX;
+    }
+    if (image.format == 0) {
+        return MipChainSize(image.width, image.height, image.components, image.mipCount);
+    }
+    if (!IsBlockFormat(image.format)) {
+        return UINT64_MAX;
+    }
+
+    uint64_t size = 0;
+    int width = image.width;
+    int height = image.height;
+    for (uint32_t level = 0; level < image.mipCount; ++level) {
+        size += CompressedLevelSize(width, height, image.format);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return size;
+}
+
+// Writes through a temporary file, so a reader never maps a half-written blob
+bool WriteCookedFile(const std::string& cookedPath, const std::vector<unsigned char>& blob) {
+    std::error_code error;
+    std::string temporaryPath = cookedPath + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(blob.data()), blob.size());
+        if (!out) {
+            std::cerr << "Cook: failed writing " << cookedPath << std::endl;
+            out.close();
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporaryPath, cookedPath, error);
+    if (error) {
+        std::cerr << "Cook: failed writing " << cookedPath << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+CookedAsset::~CookedAsset() {
+    Close();
+}
+
+bool CookedAsset::Open(const std::string& filename) {
+    Close();
+
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    const void* view = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= static_cast<LONGLONG>(sizeof(CookedHeader))) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    base = static_cast<const unsigned char*>(view);
+    size = view ? static_cast<size_t>(fileSize.QuadPart) : 0;
+
+    if (!base || !Validate()) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool CookedAsset::Assign(std::vector<unsigned char>&& blob) {
+    Close();
+    owned = std::move(blob);
+    base = owned.data();
+    size = owned.size();
+    if (size < sizeof(CookedHeader) || !Validate()) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void CookedAsset::Close() {
+    if (base && base != owned.data()) {
+        UnmapViewOfFile(base);
+    }
+    if (mappingHandle) {
+        CloseHandle(static_cast<HANDLE>(mappingHandle));
+    }
+    if (fileHandle) {
+        CloseHandle(static_cast<HANDLE>(fileHandle));
+    }
+    base = nullptr;
+    size = 0;
+    owned.clear();
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+}
+
+// Checks the header and that every table and payload range lies inside the blob,
+// so the loader can use the offsets without further checks
+bool CookedAsset::Validate() const {
+    const CookedHeader& header = Header();
+    if (header.magic != COOKED_MAGIC || header.version != COOKED_VERSION || header.fileSize != size) {
+        return false;
+    }
+
+    auto inside = [this](uint64_t offset, uint64_t bytes) {
+        return offset <= size && bytes <= size - offset;
+    };
+    if (!inside(header.materialsOffset, header.materialCount * sizeof(CookedMaterial)) ||
+        !inside(header.imagesOffset, header.imageCount * sizeof(CookedImage)) ||
+        !inside(header.meshesOffset, header.meshCount * sizeof(CookedMesh)) ||
+        !inside(header.primitivesOffset, header.primitiveCount * sizeof(CookedPrimitive)) ||
+        !inside(header.nodesOffset, header.nodeCount * sizeof(CookedNode)) ||
+        !inside(header.lodsOffset, header.lodCount * sizeof(CookedLod))) {
+        return false;
+    }
+
+    // Each path has to end inside the blob
+    uint64_t dependencyOffset = header.dependenciesOffset;
+    for (uint32_t i = 0; i < header.dependencyCount; ++i) {
+        if (dependencyOffset >= size) {
+            return false;
+        }
+        const void* end = memchr(base + dependencyOffset, '\0', size - dependencyOffset);
+        if (!end) {
+            return false;
+        }
+        dependencyOffset = static_cast<const unsigned char*>(end) - base + 1;
+    }
+
+    for (uint32_t i = 0; i < header.imageCount; ++i) {
+        const CookedImage& image = Images()[i];
+        if (!inside(image.dataOffset, image.dataSize) || image.dataSize < ImageDataSize(image)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header.meshCount; ++i) {
+        if (Meshes()[i].firstPrimitive + static_cast<uint64_t>(Meshes()[i].primitiveCount) > header.primitiveCount) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header.primitiveCount; ++i) {
+        const CookedPrimitive& primitive = Primitives()[i];
+        uint64_t indexSize = primitive.indexType == GL_UNSIGNED_INT ? 4 : 2;
+        if (!inside(primitive.vertexOffset, primitive.vertexCount * static_cast<uint64_t>(sizeof(CookedVertex))) ||
+            (primitive.indexType != 0 && !inside(primitive.indexOffset, primitive.indexCount * indexSize)) ||
+            primitive.material >= static_cast<int32_t>(header.materialCount) ||
+            primitive.firstLod + static_cast<uint64_t>(primitive.lodCount) > header.lodCount ||
+            (primitive.lodCount > 0 && primitive.indexType == 0) || primitive.lodCount >= COOKED_MAX_LODS) {
+            return false;
+        }
+        for (uint32_t l = 0; l < primitive.lodCount; ++l) {
+            const CookedLod& lod = Lods()[primitive.firstLod + l];
+            if (!inside(lod.indexOffset, lod.indexCount * indexSize)) {
+                return false;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < header.materialCount; ++i) {
+        if (Materials()[i].image >= static_cast<int32_t>(header.imageCount)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header.nodeCount; ++i) {
+        const CookedNode& node = Nodes()[i];
+        if (node.mesh >= static_cast<int32_t>(header.meshCount) || node.parent >= static_cast<int32_t>(i) ||
+            node.node < 0 || node.node >= static_cast<int32_t>(header.sourceNodeCount)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::string> CookedAsset::Dependencies() const {
+    std::vector<std::string> paths;
+    const char* path = reinterpret_cast<const char*>(base + Header().dependenciesOffset);
+    for (uint32_t i = 0; i < Header().dependencyCount; ++i) {
+        paths.push_back(path);
+        path += paths.back().size() + 1;
+    }
+    return paths;
+}
+
+std::string CookedPath(const std::string& sourcePath) {
+    if (IsImageFile(sourcePath)) {
+        return sourcePath + ".cooked";
+    }
+    return std::filesystem::path(sourcePath).replace_extension(".cooked").string();
+}
+
+bool CookAssetFile(const std::string& sourcePath, CookTextures textures, std::vector<unsigned char>& blob) {
+    CookBuilder builder;
+    builder.textures = textures;
+
+    if (HasExtension(sourcePath, ".3ds")) {
+        if (!Cook3DS(builder, sourcePath)) {
+            return false;
+        }
+    }
+    else if (IsImageFile(sourcePath)) {
+        if (!CookImage(builder, sourcePath)) {
+            return false;
+        }
+    }
+    else {
+        tinygltf::Model model;
+        std::string err;
+        std::string warn;
+
+        // A converted .glb comes in with one read instead of an open per buffer and image
+        std::string loadedPath = PreferBinaryGLTF(sourcePath);
+        bool ret = LoadGLTFFile(model, loadedPath, err, warn);
+
+        if (!warn.empty()) {
+            std::cout << "GLTF loading warning: " << warn << std::endl;
+        }
+
+        if (!err.empty()) {
+            std::cerr << "GLTF loading error: " << err << std::endl;
+        }
+
+        if (!ret) {
+            std::cerr << "Failed to load glTF: " << sourcePath << std::endl;
+            return false;
+        }
+
+        CookGLTF(builder, model);
+        AddGLTFDependencies(builder, model, sourcePath, loadedPath);
+    }
+
+    if (builder.chunkedPrimitives > 0) {
+        std::cout << "  split " << builder.chunkedPrimitives << " large primitives into " << builder.chunks << " chunks" << std::endl;
+    }
+
+    if (builder.cacheTriangles > 0 && builder.cacheVertices > 0.0) {
+        std::cout << "  vertex cache: ACMR " << builder.cacheMissesBefore / builder.cacheTriangles << " -> "
+            << builder.cacheMissesAfter / builder.cacheTriangles << ", ATVR " << builder.cacheMissesBefore / builder.cacheVertices
+            << " -> " << builder.cacheMissesAfter / builder.cacheVertices << std::endl;
+    }
+
+    if (builder.lodTriangles[1] > 0) {
+        std::cout << "  LOD triangles:";
+        for (uint32_t level = 0; level < COOKED_MAX_LODS && builder.lodTriangles[level] > 0; ++level) {
+            std::cout << (level > 0 ? " / " : " ") << builder.lodTriangles[level];
+        }
+        std::cout << std::endl;
+    }
+
+    if (builder.compressedImageBytes > 0) {
+        std::cout << "  textures: " << builder.uncompressedImageBytes / 1024 << " KB -> "
+            << builder.compressedImageBytes / 1024 << " KB" << std::endl;
+    }
+
+    builder.Finish(blob);
+    return true;
+}
+
+bool LoadCookedAsset(const std::string& sourcePath, CookedAsset& cooked, bool hasGLContext) {
+    std::string cookedPath = CookedPath(sourcePath);
+    if (IsUpToDate(cookedPath, sourcePath)) {
+        if (cooked.Open(cookedPath) && DependenciesUpToDate(cooked, cookedPath)) {
+            return true;
+        }
+        cooked.Close();
+        std::cout << "Rebuilding unreadable or outdated " << cookedPath << std::endl;
+    }
+
+    // Cook3DS goes through Model_3DS, which creates GL textures while parsing
+    if (!hasGLContext && HasExtension(sourcePath, ".3ds")) {
+        return false;
+    }
+
+    // Cook once, as --cook would, and keep the result: later runs map the file.
+    // Where it cannot be written the blob is still used from memory
+    std::cout << "Cooking " << sourcePath << std::endl;
+    std::vector<unsigned char> blob;
+    if (!CookAssetFile(sourcePath, COOK_TEXTURES_BC, blob)) {
+        return false;
+    }
+    if (WriteCookedFile(cookedPath, blob) && cooked.Open(cookedPath)) {
+        return true;
+    }
+    return cooked.Assign(std::move(blob));
+}
+
+int CookDirectory(const std::string& root, CookTextures textures, const std::vector<std::string>& extensions) {
+    int cooked = 0;
+    std::error_code error;
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(root, error)) {
+        std::string sourcePath = entry.path().string();
+        bool matches = std::any_of(extensions.begin(), extensions.end(),
+            [&](const std::string& extension) { return HasExtension(sourcePath, extension.c_str()); });
+        if (!entry.is_regular_file() || !matches) {
+            continue;
+        }
+
+        std::cout << "Cooking " << sourcePath << std::endl;
+        std::vector<unsigned char> blob;
+        if (!CookAssetFile(sourcePath, textures, blob)) {
+            continue;
+        }
+
+        std::string cookedPath = CookedPath(sourcePath);
+        if (!WriteCookedFile(cookedPath, blob)) {
+            continue;
+        }
+
+        std::cout << "Cooked " << sourcePath << " -> " << cookedPath << " (" << blob.size() / 1024 << " KB)" << std::endl;
+        cooked++;
+    }
+
+    if (error) {
+        std::cerr << "Cook: unable to scan " << root << ": " << error.message() << std::endl;
+    }
+    return cooked;
+}
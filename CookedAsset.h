@@ -0,0 +1,193 @@
+#ifndef COOKEDASSET_H
+#define COOKEDASSET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Runtime-ready mesh and texture blob written by the asset cooker (--cook) and
+// read back by GLTFAsset straight from a memory mapping. Layout:
+//
+//   CookedHeader
+//   CookedMaterial[materialCount]
+//   CookedImage[imageCount]
+//   CookedMesh[meshCount]
+//   CookedPrimitive[primitiveCount]
+//   CookedNode[nodeCount]
+//   CookedLod[lodCount]
+//   dependencies: dependencyCount NUL-terminated paths
+//   payload: interleaved vertices, indices and image mip chains
+//
+// Every section and payload block starts on a 16-byte boundary and all offsets
+// are from the start of the file. Bump COOKED_VERSION whenever a struct changes;
+// stale blobs are then ignored and the source asset is loaded instead. The
+// dependencies are the files other than the source that went into the blob
+// (.glb, .bin buffers, textures); a blob older than any of them is stale too.
+
+const uint32_t COOKED_MAGIC = 0x4B4F4F43; // "COOK"
+const uint32_t COOKED_VERSION = 8;
+
+// Full detail plus up to three simplified levels per primitive
+const uint32_t COOKED_MAX_LODS = 4;
+
+// Interleaved vertex layout shared by every primitive
+struct CookedVertex {
+    float position[3];
+    float normal[3];
+    float texcoord[2];
+    float tangent[4];
+};
+
+enum CookedPrimitiveFlags {
+    COOKED_HAS_NORMALS = 1,
+    COOKED_HAS_TEXCOORDS = 2,
+    COOKED_HAS_TANGENTS = 4,
+    COOKED_WIDE_TEXCOORDS = 8  // Some texcoord is too large for half floats (tiled UVs); upload as float
+};
+
+struct CookedHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t materialCount;
+    uint32_t imageCount;
+    uint32_t meshCount;
+    uint32_t primitiveCount;
+    uint32_t nodeCount;
+    uint32_t sourceNodeCount; // Node count of the source file, for node index lookups
+    uint32_t lodCount;
+    uint32_t dependencyCount;
+    uint64_t materialsOffset;
+    uint64_t imagesOffset;
+    uint64_t meshesOffset;
+    uint64_t primitivesOffset;
+    uint64_t nodesOffset;
+    uint64_t lodsOffset;
+    uint64_t dependenciesOffset;
+    uint64_t fileSize;
+};
+
+struct CookedMaterial {
+    int32_t image;        // Index into the images, -1 if none
+    uint32_t textured;    // The source material has a base colour texture, even if it failed to load
+    float baseColor[4];
+};
+
+// 8-bit RGB or RGBA, or block-compressed (see BlockCompression.h); levels are
+// stored largest first, each halving down to 1x1
+struct CookedImage {
+    uint32_t width;
+    uint32_t height;
+    uint32_t components;  // Of the source pixels, also for compressed images
+    uint32_t mipCount;    // 1 when the chain is left for UploadTexture to build
+    uint32_t format;      // 0 for raw pixels, otherwise a BLOCK_FORMAT_* value
+    uint32_t reserved;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+};
+
+struct CookedMesh {
+    uint32_t firstPrimitive;
+    uint32_t primitiveCount;
+};
+
+struct CookedPrimitive {
+    uint32_t mode;        // GL primitive mode
+    int32_t material;     // -1 if none
+    uint32_t flags;       // CookedPrimitiveFlags
+    uint32_t vertexCount;
+    uint64_t vertexOffset;
+    uint32_t indexType;   // GL_UNSIGNED_SHORT, GL_UNSIGNED_INT, or 0 when not indexed
+    uint32_t indexCount;
+    uint64_t indexOffset;
+    float boundsMin[3];   // Object-space bounds of the positions
+    float boundsMax[3];
+    uint32_t firstLod;    // Simplified levels, coarsest last; the indices above are level 0
+    uint32_t lodCount;
+};
+
+// A simplified index list over its primitive's vertices, same index type as level 0
+struct CookedLod {
+    uint64_t indexOffset;
+    uint32_t indexCount;
+    float error;          // Largest distance from the full-detail surface, in object units
+};
+
+// Scene nodes flattened depth first; parents always come before children
+struct CookedNode {
+    int32_t node;         // Index of the node in the source file
+    int32_t mesh;         // -1 if none
+    int32_t parent;       // Index into the cooked nodes, -1 for roots
+    float local[16];      // Column-major, relative to the parent
+    float world[16];      // Column-major, relative to the model root
+};
+
+// A validated cooked blob, either memory-mapped from disk or cooked in memory
+class CookedAsset {
+public:
+    CookedAsset() {}
+    CookedAsset(const CookedAsset&) = delete;
+    CookedAsset& operator=(const CookedAsset&) = delete;
+    ~CookedAsset();
+
+    // Maps a .cooked file; fails on a missing, truncated or out-of-date blob
+    bool Open(const std::string& filename);
+
+    // Takes ownership of a blob built by CookGLTF/Cook3DS
+    bool Assign(std::vector<unsigned char>&& blob);
+
+    void Close();
+
+    const CookedHeader& Header() const { return *reinterpret_cast<const CookedHeader*>(base); }
+    const CookedMaterial* Materials() const { return Section<CookedMaterial>(Header().materialsOffset); }
+    const CookedImage* Images() const { return Section<CookedImage>(Header().imagesOffset); }
+    const CookedMesh* Meshes() const { return Section<CookedMesh>(Header().meshesOffset); }
+    const CookedPrimitive* Primitives() const { return Section<CookedPrimitive>(Header().primitivesOffset); }
+    const CookedNode* Nodes() const { return Section<CookedNode>(Header().nodesOffset); }
+    const CookedLod* Lods() const { return Section<CookedLod>(Header().lodsOffset); }
+    const unsigned char* Data(uint64_t offset) const { return base + offset; }
+    std::vector<std::string> Dependencies() const;
+
+private:
+    const unsigned char* base = nullptr;
+    size_t size = 0;
+    std::vector<unsigned char> owned;
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+
+    template <typename T>
+    const T* Section(uint64_t offset) const {
+        return reinterpret_cast<const T*>(base + offset);
+    }
+
+    bool Validate() const;
+};
+
+// How CookAssetFile stores images
+enum CookTextures {
+    COOK_TEXTURES_RAW,       // Level 0 only; UploadTexture builds the chain on the GL thread
+    COOK_TEXTURES_MIPMAPPED, // Full 8-bit chain
+    COOK_TEXTURES_BC,        // Full chain in BC1, or BC3 when the image has alpha
+    COOK_TEXTURES_BC7        // Full chain in BC7
+};
+
+// .cooked file that sits next to a source asset. Standalone images keep their
+// extension (bugatti.png.cooked) so same-named files of different types stay apart
+std::string CookedPath(const std::string& sourcePath);
+
+// Opens the cooked blob for a .gltf/.glb/.3ds/image when it is at least as new as the
+// source and its dependencies. Otherwise cooks the source the way --cook does and
+// writes the .cooked file next to it, so only the first run pays for the cook; the
+// blob is used from memory when the file cannot be written.
+// Loader threads pass hasGLContext = false: a 3DS file without a usable cooked
+// blob then fails quietly and has to be loaded again on the GL thread.
+bool LoadCookedAsset(const std::string& sourcePath, CookedAsset& cooked, bool hasGLContext = true);
+
+// Builds a blob from a .gltf/.glb, .3ds or .png/.jpg/.jpeg file. A standalone
+// image becomes a blob with one image and no meshes
+bool CookAssetFile(const std::string& sourcePath, CookTextures textures, std::vector<unsigned char>& blob);
+
+// Cooks every file under root with one of the given extensions (".gltf", ".png", ...)
+// into a sibling .cooked file, returns the number written
+int CookDirectory(const std::string& root, CookTextures textures, const std::vector<std::string>& extensions);
+
+#endif
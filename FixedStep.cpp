@@ -0,0 +1,14 @@
+#include "FixedStep.h"
+#include <algorithm>
+
+int FixedStep::Advance() {
+    Clock::time_point now = Clock::now();
+    double elapsed = started ? std::chrono::duration<double>(now - last).count() : 0.0;
+    last = now;
+    started = true;
+
+    accumulator += std::min(elapsed, step * maxSteps);
+    int steps = std::min(static_cast<int>(accumulator / step), maxSteps);
+    accumulator = std::min(accumulator - steps * step, step);
+    return steps;
+}
@@ -0,0 +1,35 @@
+#ifndef FIXEDSTEP_H
+#define FIXEDSTEP_H
+
+#include <chrono>
+
+// Accumulator for a simulation that runs at a fixed rate inside a loop that does
+// not. Each pass, Advance measures the real time since the previous pass on a
+// steady high-resolution clock and returns how many whole steps the simulation
+// owes; the remainder becomes Alpha, how far into the next step the pass falls. A
+// long pass (a level load, a debugger pause) runs at most maxStepsPerPass steps,
+// so the game slows down instead of spiralling into catch-up.
+class FixedStep {
+public:
+    FixedStep(double stepSeconds, int maxStepsPerPass) : step(stepSeconds), maxSteps(maxStepsPerPass) {}
+
+    // Steps to run this pass
+    int Advance();
+    // Forgets the time since the last pass, for when the simulation was paused
+    void Reset() { started = false; }
+
+    float Step() const { return static_cast<float>(step); }
+    // Fraction of a step already owed towards the next one
+    float Alpha() const { return static_cast<float>(accumulator / step); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double step;
+    int maxSteps;
+    double accumulator = 0.0;
+    Clock::time_point last;
+    bool started = false;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <Windows.h>
+#include <mmsystem.h>
+
+namespace {
+
+typedef BOOL(WINAPI* SwapIntervalProc)(int interval);
+SwapIntervalProc swapInterval = nullptr;
+
+double DisplayRefreshRate() {
+    DEVMODE display;
+    memset(&display, 0, sizeof(display));
+    display.dmSize = sizeof(display);
+    if (EnumDisplaySettings(nullptr, ENUM_CURRENT_SETTINGS, &display) && display.dmDisplayFrequency > 1) {
+        return display.dmDisplayFrequency;
+    }
+    return 60.0; // 0 and 1 mean "hardware default"
+}
+
+const char* const MODE_NAMES[PACING_MODE_COUNT] = { "vsync", "fixed", "uncapped" };
+
+} // namespace
+
+void FramePacer::Init(PacingMode initialMode, double fps) {
+    // Sleep granularity is 15.6 ms by default; the simulation thread's waits benefit too.
+    // Windows restores the default when the process exits
+    timeBeginPeriod(1);
+    // Through void* so the PROC -> function pointer cast does not trip -Wcast-function-type
+    swapInterval = reinterpret_cast<SwapIntervalProc>(reinterpret_cast<void*>(wglGetProcAddress("wglSwapIntervalEXT")));
+    targetFps = fps > 0.0 ? fps : DisplayRefreshRate();
+    period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+    SetMode(initialMode);
+}
+
+void FramePacer::SetMode(PacingMode newMode) {
+    if (newMode == PACING_VSYNC && !swapInterval) {
+        std::cerr << "FramePacer: no wglSwapIntervalEXT, pacing at a fixed " << targetFps << " fps instead of vsync" << std::endl;
+        newMode = PACING_FIXED;
+    }
+    mode = newMode;
+    if (swapInterval) {
+        swapInterval(mode == PACING_VSYNC ? 1 : 0);
+    }
+    deadline = Clock::now();
+    haveLastFrame = false;
+    frameCount = 0;
+    nextFrame = 0;
+}
+
+const char* FramePacer::ModeName() const {
+    return MODE_NAMES[mode];
+}
+
+void FramePacer::WaitForNextFrame() {
+    if (mode != PACING_FIXED) {
+        return;
+    }
+
+    // More than a frame late (a load, a stall): start over rather than rush to catch up
+    Clock::time_point now = Clock::now();
+    if (now - deadline > period) {
+        deadline = now;
+    }
+    // Sleep(1) is often longer than a millisecond, by how much depends on the machine
+    // and its load, so sleeping stops once the longest recent one would overshoot and
+    // the rest is spun. The estimate decays so one slow sleep is forgotten
+    for (;;) {
+        Clock::time_point before = Clock::now();
+        if (deadline - before <= longestSleep) {
+            break;
+        }
+        Sleep(1);
+        Clock::duration slept = Clock::now() - before;
+        longestSleep = std::max(slept, longestSleep - longestSleep / 64);
+    }
+    while (Clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+    deadline += period;
+}
+
+void FramePacer::FrameDone() {
+    Clock::time_point now = Clock::now();
+    if (haveLastFrame) {
+        frameMs[nextFrame] = std::chrono::duration<float, std::milli>(now - lastFrame).count();
+        nextFrame = (nextFrame + 1) % FRAME_HISTORY;
+        frameCount = std::min(frameCount + 1, FRAME_HISTORY);
+    }
+    lastFrame = now;
+    haveLastFrame = true;
+}
+
+FrameTimeStats FramePacer::Stats() const {
+    FrameTimeStats stats = { frameCount, 0.0, 0.0, 0.0, 0.0 };
+    if (frameCount == 0) {
+        return stats;
+    }
+    double sum = 0.0;
+    stats.minMs = stats.maxMs = frameMs[0];
+    for (int i = 0; i < frameCount; ++i) {
+        sum += frameMs[i];
+        stats.minMs = std::min(stats.minMs, static_cast<double>(frameMs[i]));
+        stats.maxMs = std::max(stats.maxMs, static_cast<double>(frameMs[i]));
+    }
+    stats.meanMs = sum / frameCount;
+    double variance = 0.0;
+    for (int i = 0; i < frameCount; ++i) {
+        double deviation = frameMs[i] - stats.meanMs;
+        variance += deviation * deviation;
+    }
+    stats.stdDevMs = std::sqrt(variance / frameCount);
+    return stats;
+}
+
+bool ParsePacingMode(const char* name, PacingMode& mode) {
+    for (int i = 0; i < PACING_MODE_COUNT; ++i) {
+        if (strcmp(name, MODE_NAMES[i]) == 0) {
+            mode = static_cast<PacingMode>(i);
+            return true;
+        }
+    }
+    return false;
+}
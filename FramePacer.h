@@ -0,0 +1,68 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <chrono>
+
+// Decides when the next frame starts and keeps a history of frame times.
+//
+//   PACING_VSYNC     the buffer swap waits for the display's refresh (swap interval 1)
+//   PACING_FIXED     frames start at a target rate: the pacer sleeps until shortly
+//                    before the deadline, then spins, so frames leave on time even
+//                    where the OS sleeps in whole milliseconds
+//   PACING_UNCAPPED  no waiting and no vsync, for throughput tests
+//
+// Without the swap control extension, vsync falls back to fixed pacing at the
+// display's refresh rate.
+enum PacingMode {
+    PACING_VSYNC,
+    PACING_FIXED,
+    PACING_UNCAPPED,
+    PACING_MODE_COUNT
+};
+
+struct FrameTimeStats {
+    int frames;         // Frames in the window the figures cover
+    double meanMs;
+    double stdDevMs;    // Square root of the frame time variance
+    double minMs;
+    double maxMs;
+};
+
+class FramePacer {
+public:
+    // Call once with the window's context current. targetFps 0 uses the display's refresh rate
+    void Init(PacingMode mode, double targetFps);
+    void SetMode(PacingMode mode);
+    PacingMode Mode() const { return mode; }
+    const char* ModeName() const;
+    double TargetFps() const { return targetFps; }
+
+    // Call before posting a redisplay; returns when the next frame may start
+    void WaitForNextFrame();
+    // Call right after the buffer swap
+    void FrameDone();
+
+    // Over the last FRAME_HISTORY frames
+    FrameTimeStats Stats() const;
+
+    static const int FRAME_HISTORY = 240;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    PacingMode mode = PACING_FIXED;
+    double targetFps = 60.0;
+    Clock::duration period = Clock::duration::zero();
+    Clock::time_point deadline;
+    Clock::duration longestSleep = std::chrono::milliseconds(2);
+    Clock::time_point lastFrame;
+    bool haveLastFrame = false;
+    float frameMs[FRAME_HISTORY];
+    int frameCount = 0;  // Valid entries in frameMs
+    int nextFrame = 0;   // Where the next frame time goes
+};
+
+// Parses "vsync", "fixed" or "uncapped"; false leaves mode unchanged
+bool ParsePacingMode(const char* name, PacingMode& mode);
+
+#endif
@@ -35,6 +35,7 @@
 //////////////////////////////////////////////////////////////////////
 
 #include "GLTexture.h"
+#include "TextureUpload.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -47,7 +48,11 @@
 
 GLTexture::GLTexture()
 {
-
+	// No file yet; the asset cooker tells bitmaps from colour textures by this
+	texturename = NULL;
+	texture[0] = 0;
+	width = 0;
+	height = 0;
 }
 
 GLTexture::~GLTexture()
@@ -176,18 +181,8 @@ void GLTexture::LoadBMP(char* name)
 	// we're done.
 	fclose(file);
 
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
-
-	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
-
-	// Use mipmapping filter
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// Generate the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
+	// Generate the OpenGL texture and its mipmaps
+	texture[0] = UploadTexture(data, width, height, 3, 1, GL_REPEAT, GL_LINEAR_MIPMAP_NEAREST);
 
 	// Cleanup
 	free(data);
@@ -268,18 +263,8 @@ void GLTexture::LoadTGA(char *name)
 	if (bpp == 24)
 		type = GL_RGB;
 	
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
-
-	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
-
-	// Use mipmapping filter
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-
-	// Generate the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, type, width, height, type, GL_UNSIGNED_BYTE, imageData);
+	// Generate the OpenGL texture and its mipmaps
+	texture[0] = UploadTexture(imageData, width, height, bytesPerPixel, 1, GL_REPEAT, GL_LINEAR_MIPMAP_NEAREST);
 
 	// Cleanup
 	free(imageData);
@@ -323,18 +308,8 @@ void GLTexture::LoadBMPResource(char *name)
 		ptr[i*3+2] = temp;
 	}
 
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
-
-	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
-
-	// Use mipmapping filter
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-
-	// Generate the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, (unsigned char *)buffer+sizeof(BITMAPINFO)+2);
+	// Generate the OpenGL texture and its mipmaps
+	texture[0] = UploadTexture((unsigned char *)buffer+sizeof(BITMAPINFO)+2, width, height, 3, 1, GL_REPEAT, GL_LINEAR_MIPMAP_NEAREST);
 	//gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, bmp->bmBits);
 
 	// Cleanup
@@ -417,18 +392,8 @@ void GLTexture::LoadTGAResource(char *name)
 	if (bpp == 24)
 		type = GL_RGB;
 	
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
-
-	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
-
-	// Use mipmapping filter
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-
-	// Generate the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, type, width, height, type, GL_UNSIGNED_BYTE, imageData);
+	// Generate the OpenGL texture and its mipmaps
+	texture[0] = UploadTexture(imageData, width, height, bytesPerPixel, 1, GL_REPEAT, GL_LINEAR_MIPMAP_NEAREST);
 
 	// Cleanup
 	free(imageData);
@@ -448,18 +413,6 @@ void GLTexture::BuildColorTexture(unsigned char r, unsigned char g, unsigned cha
 		data[i+2] = b;
 	}
 
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
-
-	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
-
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-	// Use mipmapping filter
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-
-	// Generate the texture
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, 2, 2, GL_RGB, GL_UNSIGNED_BYTE, data);
+	// Generate the OpenGL texture and its mipmaps
+	texture[0] = UploadTexture(data, 2, 2, 3, 1, GL_REPEAT, GL_LINEAR_MIPMAP_NEAREST);
 }
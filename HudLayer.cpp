@@ -0,0 +1,239 @@
+#include "HudLayer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <glew.h>
+#include <glut.h>
+
+namespace {
+
+const int CORNER_SEGMENTS = 5;
+const float HALF_PI = 1.57079633f;
+
+uint8_t ToByte(float value) {
+    return static_cast<uint8_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+} // namespace
+
+void HudLayer::Clear() {
+    vertices.clear();
+    groupStarts.clear();
+    groupVisible.clear();
+    rebuilt = true;
+    dirtyBegin = dirtyEnd = 0;
+}
+
+int HudLayer::BeginGroup() {
+    groupStarts.push_back(static_cast<int>(vertices.size()));
+    groupVisible.push_back(true);
+    return static_cast<int>(groupStarts.size()) - 1;
+}
+
+void HudLayer::SetGroupVisible(int group, bool visible) {
+    groupVisible[group] = visible;
+}
+
+void HudLayer::SetColor(float r, float g, float b, float a) {
+    color[0] = ToByte(r);
+    color[1] = ToByte(g);
+    color[2] = ToByte(b);
+    color[3] = ToByte(a);
+}
+
+void HudLayer::Push(const float* position) {
+    HudVertex vertex = { { position[0], position[1] }, { color[0], color[1], color[2], color[3] } };
+    vertices.push_back(vertex);
+    rebuilt = true;
+}
+
+void HudLayer::AddTriangle(const float* a, const float* b, const float* c) {
+    Push(a);
+    Push(b);
+    Push(c);
+}
+
+void HudLayer::AddQuad(const float* a, const float* b, const float* c, const float* d) {
+    AddTriangle(a, b, c);
+    AddTriangle(a, c, d);
+}
+
+void HudLayer::AddLine(float x0, float y0, float x1, float y1, float width) {
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float length = std::sqrt(dx * dx + dy * dy);
+    if (length <= 0.0f) {
+        return;
+    }
+    float nx = -dy / length * width * 0.5f;
+    float ny = dx / length * width * 0.5f;
+    float a[2] = { x0 + nx, y0 + ny };
+    float b[2] = { x0 - nx, y0 - ny };
+    float c[2] = { x1 - nx, y1 - ny };
+    float d[2] = { x1 + nx, y1 + ny };
+    AddQuad(a, b, c, d);
+}
+
+void HudLayer::ArcPoints(float centerX, float centerY, float radius, float startAngle, int segments, std::vector<float>& points) const {
+    for (int i = 0; i <= segments; ++i) {
+        float angle = startAngle + HALF_PI * i / segments;
+        points.push_back(centerX + radius * std::cos(angle));
+        points.push_back(centerY + radius * std::sin(angle));
+    }
+}
+
+// Counter-clockwise outline, a quarter circle at each corner
+void HudLayer::RoundedRectPath(float x, float y, float width, float height, float radius, std::vector<float>& points) const {
+    points.clear();
+    ArcPoints(x + radius, y + radius, radius, 2.0f * HALF_PI, CORNER_SEGMENTS, points);
+    ArcPoints(x + width - radius, y + radius, radius, 3.0f * HALF_PI, CORNER_SEGMENTS, points);
+    ArcPoints(x + width - radius, y + height - radius, radius, 0.0f, CORNER_SEGMENTS, points);
+    ArcPoints(x + radius, y + height - radius, radius, HALF_PI, CORNER_SEGMENTS, points);
+}
+
+void HudLayer::AddDisc(float centerX, float centerY, float radius, int segments) {
+    float center[2] = { centerX, centerY };
+    for (int i = 0; i < segments; ++i) {
+        float a0 = 4.0f * HALF_PI * i / segments;
+        float a1 = 4.0f * HALF_PI * (i + 1) / segments;
+        float p0[2] = { centerX + radius * std::cos(a0), centerY + radius * std::sin(a0) };
+        float p1[2] = { centerX + radius * std::cos(a1), centerY + radius * std::sin(a1) };
+        AddTriangle(center, p0, p1);
+    }
+}
+
+void HudLayer::AddGradientDisc(float centerX, float centerY, float radius, int segments, const float* rimColor) {
+    uint8_t centerColor[4];
+    memcpy(centerColor, color, sizeof(color));
+    float center[2] = { centerX, centerY };
+    for (int i = 0; i < segments; ++i) {
+        float a0 = 4.0f * HALF_PI * i / segments;
+        float a1 = 4.0f * HALF_PI * (i + 1) / segments;
+        float p0[2] = { centerX + radius * std::cos(a0), centerY + radius * std::sin(a0) };
+        float p1[2] = { centerX + radius * std::cos(a1), centerY + radius * std::sin(a1) };
+        memcpy(color, centerColor, sizeof(color));
+        Push(center);
+        SetColor(rimColor[0], rimColor[1], rimColor[2], rimColor[3]);
+        Push(p0);
+        Push(p1);
+    }
+    memcpy(color, centerColor, sizeof(color));
+}
+
+void HudLayer::AddRoundedRect(float x, float y, float width, float height, float radius) {
+    RoundedRectPath(x, y, width, height, radius, scratch);
+    float center[2] = { x + width * 0.5f, y + height * 0.5f };
+    size_t count = scratch.size() / 2;
+    for (size_t i = 0; i < count; ++i) {
+        size_t next = (i + 1) % count;
+        AddTriangle(center, &scratch[i * 2], &scratch[next * 2]);
+    }
+}
+
+void HudLayer::AddRoundedRectOutline(float x, float y, float width, float height, float radius, float lineWidth) {
+    RoundedRectPath(x, y, width, height, radius, scratch);
+    size_t count = scratch.size() / 2;
+    for (size_t i = 0; i < count; ++i) {
+        size_t next = (i + 1) % count;
+        AddLine(scratch[i * 2], scratch[i * 2 + 1], scratch[next * 2], scratch[next * 2 + 1], lineWidth);
+    }
+}
+
+int HudLayer::ReserveDynamic(int vertexCount) {
+    int handle = static_cast<int>(vertices.size());
+    const float origin[2] = { 0.0f, 0.0f };
+    for (int i = 0; i < vertexCount; ++i) {
+        Push(origin);
+    }
+    return handle;
+}
+
+void HudLayer::UpdateDynamic(int handle, const HudVertex* source, int count) {
+    std::copy(source, source + count, vertices.begin() + handle);
+    size_t begin = static_cast<size_t>(handle);
+    size_t end = begin + count;
+    if (dirtyEnd > dirtyBegin) {
+        begin = std::min(begin, dirtyBegin);
+        end = std::max(end, dirtyEnd);
+    }
+    dirtyBegin = begin;
+    dirtyEnd = end;
+}
+
+void HudLayer::MakeQuad(const float* a, const float* b, const float* c, const float* d, HudVertex* out) const {
+    const float* corners[6] = { a, b, c, a, c, d };
+    for (int i = 0; i < 6; ++i) {
+        HudVertex vertex = { { corners[i][0], corners[i][1] }, { color[0], color[1], color[2], color[3] } };
+        out[i] = vertex;
+    }
+}
+
+void HudLayer::Draw() {
+    lastDrawCalls = 0;
+    if (vertices.empty()) {
+        return;
+    }
+
+    if (!buffer) {
+        glGenBuffers(1, &buffer);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (rebuilt || bufferCapacity < vertices.size()) {
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(HudVertex), vertices.data(), GL_DYNAMIC_DRAW);
+        bufferCapacity = vertices.size();
+        rebuilt = false;
+    } else if (dirtyEnd > dirtyBegin) {
+        glBufferSubData(GL_ARRAY_BUFFER, dirtyBegin * sizeof(HudVertex), (dirtyEnd - dirtyBegin) * sizeof(HudVertex), &vertices[dirtyBegin]);
+    }
+    dirtyBegin = dirtyEnd = 0;
+
+    // Visible groups, with neighbours merged into one range
+    drawFirsts.clear();
+    drawCounts.clear();
+    size_t groupCount = std::max<size_t>(groupStarts.size(), 1);
+    for (size_t g = 0; g < groupCount; ++g) {
+        if (!groupStarts.empty() && !groupVisible[g]) {
+            continue;
+        }
+        int first = groupStarts.empty() ? 0 : groupStarts[g];
+        int end = g + 1 < groupStarts.size() ? groupStarts[g + 1] : static_cast<int>(vertices.size());
+        if (end <= first) {
+            continue;
+        }
+        if (!drawFirsts.empty() && drawFirsts.back() + drawCounts.back() == first) {
+            drawCounts.back() += end - first;
+        } else {
+            drawFirsts.push_back(first);
+            drawCounts.push_back(end - first);
+        }
+    }
+
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(HudVertex), reinterpret_cast<const void*>(offsetof(HudVertex, position)));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(HudVertex), reinterpret_cast<const void*>(offsetof(HudVertex, color)));
+    if (drawFirsts.size() > 1 && GLEW_VERSION_1_4) {
+        glMultiDrawArrays(GL_TRIANGLES, drawFirsts.data(), drawCounts.data(), static_cast<GLsizei>(drawFirsts.size()));
+        lastDrawCalls = 1;
+    } else {
+        for (size_t i = 0; i < drawFirsts.size(); ++i) {
+            glDrawArrays(GL_TRIANGLES, drawFirsts[i], drawCounts[i]);
+        }
+        lastDrawCalls = static_cast<int>(drawFirsts.size());
+    }
+    glPopClientAttrib();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glPopAttrib();
+}
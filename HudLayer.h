@@ -0,0 +1,75 @@
+#ifndef HUDLAYER_H
+#define HUDLAYER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Retained 2D geometry for the HUD. Panels, dials and markers are built once as
+// coloured triangles in window pixels and kept in one buffer object; parts that
+// move (a needle) reserve a vertex range that is rewritten only when they change.
+// Geometry is split into groups that can be shown or hidden without a rebuild, and
+// Draw renders every visible group with a single call, blended, in build order.
+//
+// Text is not part of the layer; queue it through TextRenderer.h as usual.
+
+struct HudVertex {
+    float position[2];
+    uint8_t color[4];
+};
+
+class HudLayer {
+public:
+    // Drops all geometry so the layer can be rebuilt (after a window resize); the
+    // buffer object is kept for the new geometry
+    void Clear();
+    bool Empty() const { return vertices.empty(); }
+
+    // Starts a group; everything added until the next call belongs to it
+    int BeginGroup();
+    void SetGroupVisible(int group, bool visible);
+
+    void SetColor(float r, float g, float b, float a = 1.0f);
+    void AddTriangle(const float* a, const float* b, const float* c);
+    void AddQuad(const float* a, const float* b, const float* c, const float* d);
+    void AddLine(float x0, float y0, float x1, float y1, float width);
+    void AddDisc(float centerX, float centerY, float radius, int segments);
+    // Disc shaded from the current colour at the centre to rimColor (RGBA) at the edge
+    void AddGradientDisc(float centerX, float centerY, float radius, int segments, const float* rimColor);
+    void AddRoundedRect(float x, float y, float width, float height, float radius);
+    void AddRoundedRectOutline(float x, float y, float width, float height, float radius, float lineWidth);
+
+    // Reserves vertexCount vertices (whole triangles) at this point in the draw order,
+    // initially degenerate. Returns the handle for UpdateDynamic
+    int ReserveDynamic(int vertexCount);
+    // Overwrites a reserved range; uploaded by the next Draw
+    void UpdateDynamic(int handle, const HudVertex* source, int count);
+    // Packs a quad in the current colour as two triangles, for UpdateDynamic
+    void MakeQuad(const float* a, const float* b, const float* c, const float* d, HudVertex* out) const;
+
+    // Uploads what changed, then draws the visible groups. Expects a projection that
+    // maps window pixels, as drawHUD's gluOrtho2D does
+    void Draw();
+    int LastDrawCalls() const { return lastDrawCalls; }
+
+private:
+    void Push(const float* position);
+    void ArcPoints(float centerX, float centerY, float radius, float startAngle, int segments, std::vector<float>& points) const;
+    void RoundedRectPath(float x, float y, float width, float height, float radius, std::vector<float>& points) const;
+
+    std::vector<HudVertex> vertices;
+    std::vector<int> groupStarts;
+    std::vector<bool> groupVisible;
+    std::vector<int> drawFirsts;    // Reused every Draw, so drawing never allocates
+    std::vector<int> drawCounts;
+    std::vector<float> scratch;
+    uint8_t color[4] = { 255, 255, 255, 255 };
+    unsigned int buffer = 0;
+    size_t bufferCapacity = 0;       // Vertices the buffer object holds
+    bool rebuilt = true;             // Whole layer needs uploading
+    size_t dirtyBegin = 0;
+    size_t dirtyEnd = 0;
+    int lastDrawCalls = 0;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "InstancedDraw.h"
+#include "ShaderLighting.h"
+#include <iostream>
+#include <glew.h>
+#include <glut.h>
+
+namespace {
+
+bool instancingEnabled = true;
+bool unavailableReported = false;
+
+} // namespace
+
+bool InstancingAvailable() {
+    // The divisor comes from ARB_instanced_arrays, the instanced draw calls from GL 3.1 or ARB_draw_instanced
+    bool available = GLEW_ARB_instanced_arrays && (GLEW_VERSION_3_1 || GLEW_ARB_draw_instanced) && ShadingAvailable();
+    if (!available && !unavailableReported) {
+        std::cout << "InstancedDraw: no ARB_instanced_arrays, instanced draw calls or scene shaders, props are drawn one at a time" << std::endl;
+        unavailableReported = true;
+    }
+    return available;
+}
+
+void SetInstancingEnabled(bool enabled) {
+    instancingEnabled = enabled;
+}
+
+bool InstancingEnabled() {
+    return instancingEnabled;
+}
+
+void BeginInstancing() {
+    BeginShading(SHADER_INSTANCED);
+}
+
+void EndInstancing() {
+    EndShading();
+}
+
+void SetInstanceNodeMatrix(const float* matrix) {
+    SetShaderNodeMatrix(matrix);
+}
+
+void SetInstanceTexturing(bool textured) {
+    SetShadingTextured(textured);
+}
+
+void BindInstanceMatrices(unsigned int buffer) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (GLuint column = 0; column < 4; ++column) {
+        GLuint attrib = INSTANCE_MATRIX_ATTRIB + column;
+        glEnableVertexAttribArray(attrib);
+        glVertexAttribPointer(attrib, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), reinterpret_cast<const void*>(column * 4 * sizeof(float)));
+        glVertexAttribDivisorARB(attrib, 1);
+    }
+}
+
+void UnbindInstanceMatrices() {
+    for (GLuint column = 0; column < 4; ++column) {
+        GLuint attrib = INSTANCE_MATRIX_ATTRIB + column;
+        glVertexAttribDivisorARB(attrib, 0);
+        glDisableVertexAttribArray(attrib);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DrawElementsInstanced(unsigned int mode, int count, unsigned int type, size_t indexOffset, int instanceCount) {
+    const void* indices = reinterpret_cast<const void*>(indexOffset);
+    if (GLEW_VERSION_3_1) {
+        glDrawElementsInstanced(mode, count, type, indices, instanceCount);
+    }
+    else {
+        glDrawElementsInstancedARB(mode, count, type, indices, instanceCount);
+    }
+}
+
+void DrawArraysInstanced(unsigned int mode, int vertexCount, int instanceCount) {
+    if (GLEW_VERSION_3_1) {
+        glDrawArraysInstanced(mode, 0, vertexCount, instanceCount);
+    }
+    else {
+        glDrawArraysInstancedARB(mode, 0, vertexCount, instanceCount);
+    }
+}
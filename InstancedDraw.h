@@ -0,0 +1,45 @@
+#ifndef INSTANCEDDRAW_H
+#define INSTANCEDDRAW_H
+
+#include <cstddef>
+
+// Hardware instancing for props drawn many times a frame (cones, coins, stones,
+// logs, nitros). Each instance's model matrix comes from a per-instance vertex
+// attribute, and the SHADER_INSTANCED variants of ShaderLighting.h light and texture
+// it the way DrawModel would. Needs the scene shaders and ARB_instanced_arrays.
+
+// First of the four generic attribute slots holding the instance matrix columns.
+// On drivers that alias generic slots with the fixed-function arrays, 12-15 are
+// texture units 4-7, which nothing here uses
+const unsigned int INSTANCE_MATRIX_ATTRIB = 12;
+
+// True when the driver can draw instanced and the scene shaders have linked. They
+// are compiled on the first call, which must come after glewInit
+bool InstancingAvailable();
+
+// Switch for comparing against the per-instance path (DrawInstanced then loops DrawModel)
+void SetInstancingEnabled(bool enabled);
+bool InstancingEnabled();
+
+// Starts an instanced shading pass (see BeginShading): the current lights go into
+// the light buffer, the modelview is read by the shader at draw time
+void BeginInstancing();
+void EndInstancing();
+
+// Whether the primitives that follow are modulated by the bound GL_TEXTURE_2D. May
+// switch programs, so call it before SetInstanceNodeMatrix
+void SetInstanceTexturing(bool textured);
+
+// Transform applied inside each instance (a glTF node's world matrix), column-major
+void SetInstanceNodeMatrix(const float* matrix);
+
+// Points the instance matrix attributes at a buffer of column-major 4x4 float
+// matrices, one per instance. Call with the primitive's vertex layout bound
+void BindInstanceMatrices(unsigned int buffer);
+void UnbindInstanceMatrices();
+
+// glDrawElementsInstanced / glDrawArraysInstanced through whichever entry point the driver has
+void DrawElementsInstanced(unsigned int mode, int count, unsigned int type, size_t indexOffset, int instanceCount);
+void DrawArraysInstanced(unsigned int mode, int vertexCount, int instanceCount);
+
+#endif
@@ -0,0 +1,132 @@
+#include "LightClusters.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+int Clamp(int value, int low, int high) {
+    return std::min(std::max(value, low), high);
+}
+
+} // namespace
+
+bool LightClusters::Build(const float* projection, const int* viewport, const ClusterLight* lights, int count, int firstIndex) {
+    clusterTexels.assign(CLUSTER_COUNT * 4, 0);
+    indices.clear();
+    entryCount = 0;
+    busiestCluster = 0;
+
+    // Perspective projections have -1 in the w row's z column; near and far come back out of the depth terms
+    if (projection[11] != -1.0f || projection[15] != 0.0f || viewport[2] <= 0 || viewport[3] <= 0) {
+        return false;
+    }
+    float nearPlane = projection[14] / (projection[10] - 1.0f);
+    float farPlane = projection[14] / (projection[10] + 1.0f);
+    if (!(nearPlane > 0.0f) || !(farPlane > nearPlane)) {
+        return false;
+    }
+
+    grid.tileScale[0] = static_cast<float>(CLUSTER_X) / viewport[2];
+    grid.tileScale[1] = static_cast<float>(CLUSTER_Y) / viewport[3];
+    grid.viewportOrigin[0] = static_cast<float>(viewport[0]);
+    grid.viewportOrigin[1] = static_cast<float>(viewport[1]);
+    grid.inverseNear = 1.0f / CLUSTER_NEAR;
+    grid.sliceScale = CLUSTER_Z / std::log(std::max(farPlane * grid.inverseNear, 2.0f));
+
+    auto sliceOf = [this](float depth) {
+        float slice = std::floor(std::log(std::max(depth * grid.inverseNear, 1.0f)) * grid.sliceScale);
+        return Clamp(static_cast<int>(std::min(slice, static_cast<float>(CLUSTER_Z))), 0, CLUSTER_Z - 1);
+    };
+
+    // Cluster range of each light: depth slices from its sphere, screen tiles from the
+    // projected corners of its bounding box, or every tile when it reaches the near plane
+    bounds.assign(count * 6, 0);
+    for (int i = 0; i < count; ++i) {
+        const ClusterLight& light = lights[i];
+        int* range = &bounds[i * 6];
+        range[0] = 1; // Culled until proven visible
+        float depth = -light.position[2];
+        if (!(light.range > 0.0f) || depth + light.range <= nearPlane || depth - light.range >= farPlane) {
+            continue;
+        }
+
+        float tileMin[2] = { 0.0f, 0.0f };
+        float tileMax[2] = { static_cast<float>(CLUSTER_X - 1), static_cast<float>(CLUSTER_Y - 1) };
+        if (depth - light.range > nearPlane) {
+            float ndcMin[2] = { 1.0f, 1.0f };
+            float ndcMax[2] = { -1.0f, -1.0f };
+            for (int corner = 0; corner < 8; ++corner) {
+                float p[3];
+                for (int axis = 0; axis < 3; ++axis) {
+                    p[axis] = light.position[axis] + ((corner >> axis) & 1 ? light.range : -light.range);
+                }
+                float w = projection[3] * p[0] + projection[7] * p[1] + projection[11] * p[2] + projection[15];
+                for (int axis = 0; axis < 2; ++axis) {
+                    float ndc = (projection[axis] * p[0] + projection[4 + axis] * p[1] + projection[8 + axis] * p[2] + projection[12 + axis]) / w;
+                    ndcMin[axis] = std::min(ndcMin[axis], ndc);
+                    ndcMax[axis] = std::max(ndcMax[axis], ndc);
+                }
+            }
+            const int tiles[2] = { CLUSTER_X, CLUSTER_Y };
+            for (int axis = 0; axis < 2; ++axis) {
+                tileMin[axis] = std::floor((ndcMin[axis] * 0.5f + 0.5f) * tiles[axis]);
+                tileMax[axis] = std::floor((ndcMax[axis] * 0.5f + 0.5f) * tiles[axis]);
+            }
+            if (tileMax[0] < 0.0f || tileMax[1] < 0.0f || tileMin[0] >= CLUSTER_X || tileMin[1] >= CLUSTER_Y) {
+                continue; // Off screen
+            }
+        }
+
+        range[0] = Clamp(static_cast<int>(tileMin[0]), 0, CLUSTER_X - 1);
+        range[1] = Clamp(static_cast<int>(tileMax[0]), 0, CLUSTER_X - 1);
+        range[2] = Clamp(static_cast<int>(tileMin[1]), 0, CLUSTER_Y - 1);
+        range[3] = Clamp(static_cast<int>(tileMax[1]), 0, CLUSTER_Y - 1);
+        range[4] = sliceOf(depth - light.range);
+        range[5] = sliceOf(depth + light.range);
+    }
+
+    // Count, then lay the lists out back to back and fill them in light order
+    counts.assign(CLUSTER_COUNT, 0);
+    for (int i = 0; i < count; ++i) {
+        const int* range = &bounds[i * 6];
+        for (int z = range[4]; z <= range[5]; ++z) {
+            for (int y = range[2]; y <= range[3]; ++y) {
+                for (int x = range[0]; x <= range[1]; ++x) {
+                    counts[(z * CLUSTER_Y + y) * CLUSTER_X + x]++;
+                }
+            }
+        }
+    }
+    std::vector<int> fill(CLUSTER_COUNT, 0);
+    for (int c = 0; c < CLUSTER_COUNT; ++c) {
+        int size = std::min({ counts[c], MAX_CLUSTER_LIGHTS, MAX_CLUSTER_ENTRIES - entryCount });
+        fill[c] = entryCount;
+        clusterTexels[c * 4] = static_cast<uint8_t>(entryCount & 0xFF);
+        clusterTexels[c * 4 + 1] = static_cast<uint8_t>(entryCount >> 8);
+        clusterTexels[c * 4 + 2] = static_cast<uint8_t>(size);
+        counts[c] = size;
+        entryCount += size;
+        busiestCluster = std::max(busiestCluster, size);
+    }
+
+    indices.assign(static_cast<size_t>(IndexRows()) * INDEX_TEXTURE_WIDTH, 0);
+    for (int i = 0; i < count; ++i) {
+        const int* range = &bounds[i * 6];
+        for (int z = range[4]; z <= range[5]; ++z) {
+            for (int y = range[2]; y <= range[3]; ++y) {
+                for (int x = range[0]; x <= range[1]; ++x) {
+                    int c = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+                    if (counts[c] > 0) {
+                        indices[fill[c]++] = static_cast<uint8_t>(firstIndex + i);
+                        counts[c]--;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int LightClusters::IndexRows() const {
+    return std::max((entryCount + INDEX_TEXTURE_WIDTH - 1) / INDEX_TEXTURE_WIDTH, 1);
+}
@@ -0,0 +1,71 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <cstdint>
+#include <vector>
+
+// Clustered light culling for the scene shaders (see ShaderLighting.h). The view
+// frustum is cut into CLUSTER_X x CLUSTER_Y screen tiles and CLUSTER_Z depth slices,
+// spaced exponentially from CLUSTER_NEAR to the far plane, and each cluster lists the
+// lights whose range reaches it. A pixel then only loops over its own cluster's list,
+// so its cost follows the lights nearby rather than the lights in the scene.
+//
+// Both tables are byte arrays ready for GL_UNSIGNED_BYTE textures, which GLSL 1.20
+// can read without integer or buffer texture support:
+//
+//   clusters  RGBA, one texel per cluster, x fastest, then y, then z; R and G hold
+//             the first entry of its list (low and high byte), B the entry count
+//   indices   one byte per entry, the light's index in the shader's light array,
+//             INDEX_TEXTURE_WIDTH entries per row
+
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+const float CLUSTER_NEAR = 1.0f;     // Far edge of the first slice; nearer pixels use it too
+const int INDEX_TEXTURE_WIDTH = 1024;
+const int MAX_CLUSTER_ENTRIES = 65535; // Offsets are 16-bit; lights past this are dropped
+const int MAX_CLUSTER_LIGHTS = 255;  // Per cluster, and light indices are bytes
+
+// Eye-space sphere a light's contribution is confined to
+struct ClusterLight {
+    float position[3];
+    float range;
+};
+
+// Shader uniforms locating a pixel's cluster:
+//   tile  = floor((gl_FragCoord.xy - viewportOrigin) * tileScale)
+//   slice = floor(log(max(-eyeZ * inverseNear, 1)) * sliceScale)
+struct ClusterGrid {
+    float tileScale[2];
+    float viewportOrigin[2];
+    float sliceScale;
+    float inverseNear;
+};
+
+class LightClusters {
+public:
+    // Bins the lights for a perspective projection (column-major, as glGetFloatv
+    // returns it) and viewport. Light i gets index firstIndex + i. Returns false for
+    // projections it cannot slice (orthographic), leaving the tables empty
+    bool Build(const float* projection, const int* viewport, const ClusterLight* lights, int count, int firstIndex);
+
+    const ClusterGrid& Grid() const { return grid; }
+    const std::vector<uint8_t>& ClusterTexels() const { return clusterTexels; }
+    const std::vector<uint8_t>& Indices() const { return indices; }
+    int IndexRows() const;   // Height of the index texture, at least 1
+
+    int EntryCount() const { return entryCount; }
+    int BusiestCluster() const { return busiestCluster; } // Largest list
+
+private:
+    ClusterGrid grid = {};
+    std::vector<uint8_t> clusterTexels;
+    std::vector<uint8_t> indices;
+    std::vector<int> bounds;  // Per light: min and max tile x, y and slice; empty x range when culled
+    std::vector<int> counts;
+    int entryCount = 0;
+    int busiestCluster = 0;
+};
+
+#endif
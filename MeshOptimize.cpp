@@ -0,0 +1,311 @@
+#include "MeshOptimize.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// FIFO cache model shared by the statistics and the overdraw pass
+class FifoCache {
+public:
+    FifoCache(size_t vertexCount) : timestamps(vertexCount, 0) {}
+
+    // Returns true on a miss, which puts the vertex in the cache
+    bool Access(uint32_t vertex) {
+        if (time - timestamps[vertex] < VERTEX_CACHE_SIZE && timestamps[vertex] != 0) {
+            return false;
+        }
+        timestamps[vertex] = ++time;
+        return true;
+    }
+
+    // Forgets every vertex, as if the walk had jumped elsewhere
+    void Flush() {
+        time += VERTEX_CACHE_SIZE;
+    }
+
+private:
+    std::vector<size_t> timestamps; // Miss count when the vertex last entered, 0 for never
+    size_t time = 0;
+};
+
+// Triangles around each vertex, in compressed row form
+struct Adjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+
+    Adjacency(const uint32_t* indices, size_t indexCount, size_t vertexCount) : offsets(vertexCount + 1, 0) {
+        for (size_t i = 0; i < indexCount; ++i) {
+            offsets[indices[i] + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; ++v) {
+            offsets[v + 1] += offsets[v];
+        }
+        triangles.resize(indexCount);
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indexCount; ++i) {
+            triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+};
+
+} // namespace
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount) {
+    FifoCache cache(vertexCount);
+    std::vector<bool> used(vertexCount, false);
+    size_t misses = 0;
+    size_t usedCount = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        uint32_t v = indices[i];
+        if (v >= vertexCount) {
+            continue;
+        }
+        misses += cache.Access(v) ? 1 : 0;
+        if (!used[v]) {
+            used[v] = true;
+            usedCount++;
+        }
+    }
+
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if (indexCount >= 3) {
+        stats.acmr = static_cast<float>(misses) / (indexCount / 3);
+    }
+    if (usedCount > 0) {
+        stats.atvr = static_cast<float>(misses) / usedCount;
+    }
+    return stats;
+}
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<size_t>* clusters) {
+    size_t triangleCount = indexCount / 3;
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        if (indices[i] >= vertexCount) {
+            return;
+        }
+    }
+    if (clusters) {
+        clusters->clear();
+    }
+    if (triangleCount == 0) {
+        return;
+    }
+
+    Adjacency adjacency(indices, triangleCount * 3, vertexCount);
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+
+    const size_t cacheSize = VERTEX_CACHE_SIZE;
+    std::vector<size_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;       // Recently used vertices, to restart from when the fan runs dry
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;                   // Next vertex in input order to try after a dead end
+    int64_t fan = 0;
+    while (fan >= 0) {
+        candidates.clear();
+        uint32_t f = static_cast<uint32_t>(fan);
+        for (uint32_t a = adjacency.offsets[f]; a < adjacency.offsets[f + 1]; ++a) {
+            uint32_t triangle = adjacency.triangles[a];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = true;
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = indices[triangle * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+        }
+
+        // Best candidate: the one that stays in the cache longest once its remaining triangles are emitted
+        fan = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveTriangles[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = static_cast<int64_t>(time - cacheTime[v]);
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                fan = v;
+            }
+        }
+        if (fan >= 0) {
+            continue;
+        }
+
+        // Dead end: back to a recently used vertex with work left, else the next one in input order
+        while (!deadEnd.empty() && fan < 0) {
+            uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0) {
+                fan = v;
+            }
+        }
+        while (fan < 0 && cursor < vertexCount) {
+            if (liveTriangles[cursor] > 0) {
+                fan = static_cast<int64_t>(cursor);
+            }
+            cursor++;
+        }
+        if (fan >= 0 && clusters) {
+            clusters->push_back(result.size());
+        }
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+    if (clusters) {
+        clusters->insert(clusters->begin(), 0);
+    }
+}
+
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t positionStride, const std::vector<size_t>& clusters, float threshold) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0 || clusters.empty()) {
+        return;
+    }
+    indexCount = triangleCount * 3;
+
+    // Soft boundaries: inside each cache cluster, start a new one wherever the triangles
+    // since the last split already run at or below the allowed miss ratio
+    std::vector<size_t> starts;
+    FifoCache cache(vertexCount);
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        size_t begin = clusters[c];
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : indexCount;
+        if (begin >= end) {
+            continue;
+        }
+
+        cache.Flush();
+        size_t clusterMisses = 0;
+        for (size_t i = begin; i < end; ++i) {
+            clusterMisses += cache.Access(indices[i]) ? 1 : 0;
+        }
+        float allowed = threshold * clusterMisses / ((end - begin) / 3);
+
+        cache.Flush();
+        starts.push_back(begin);
+        size_t misses = 0;
+        size_t triangles = 0;
+        for (size_t i = begin; i < end; i += 3) {
+            for (int k = 0; k < 3; ++k) {
+                misses += cache.Access(indices[i + k]) ? 1 : 0;
+            }
+            triangles++;
+            if (i + 3 < end && misses <= allowed * triangles) {
+                starts.push_back(i + 3);
+                cache.Flush();
+                misses = 0;
+                triangles = 0;
+            }
+        }
+    }
+
+    auto position = [&](uint32_t v, int axis) {
+        return reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(positions) + v * positionStride)[axis];
+    };
+
+    // Area-weighted centroid and normal of each cluster, and the centroid of the whole mesh
+    std::vector<float> clusterData(starts.size() * 6, 0.0f);
+    double meshCentroid[3] = { 0, 0, 0 };
+    double meshArea = 0;
+    for (size_t c = 0; c < starts.size(); ++c) {
+        size_t end = c + 1 < starts.size() ? starts[c + 1] : indexCount;
+        double centroid[3] = { 0, 0, 0 };
+        double normal[3] = { 0, 0, 0 };
+        double area = 0;
+        for (size_t i = starts[c]; i < end; i += 3) {
+            double p[3][3];
+            for (int k = 0; k < 3; ++k) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    p[k][axis] = position(indices[i + k], axis);
+                }
+            }
+            double e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+            double e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+            double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            double triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int axis = 0; axis < 3; ++axis) {
+                centroid[axis] += (p[0][axis] + p[1][axis] + p[2][axis]) / 3.0 * triangleArea;
+                normal[axis] += n[axis];
+            }
+            area += triangleArea;
+        }
+
+        double normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        for (int axis = 0; axis < 3; ++axis) {
+            meshCentroid[axis] += centroid[axis];
+            clusterData[c * 6 + axis] = static_cast<float>(area > 0 ? centroid[axis] / area : 0.0);
+            clusterData[c * 6 + 3 + axis] = static_cast<float>(normalLength > 0 ? normal[axis] / normalLength : 0.0);
+        }
+        meshArea += area;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        meshCentroid[axis] = meshArea > 0 ? meshCentroid[axis] / meshArea : 0.0;
+    }
+
+    // Clusters facing away from the centre are on the outside and go first
+    std::vector<float> sortKey(starts.size());
+    std::vector<size_t> order(starts.size());
+    for (size_t c = 0; c < starts.size(); ++c) {
+        float key = 0.0f;
+        for (int axis = 0; axis < 3; ++axis) {
+            key += static_cast<float>(clusterData[c * 6 + axis] - meshCentroid[axis]) * clusterData[c * 6 + 3 + axis];
+        }
+        sortKey[c] = key;
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indexCount);
+    for (size_t c : order) {
+        size_t end = c + 1 < starts.size() ? starts[c + 1] : indexCount;
+        result.insert(result.end(), indices + starts[c], indices + end);
+    }
+    std::copy(result.begin(), result.end(), indices);
+}
+
+void OptimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>& remap) {
+    const uint32_t unused = ~0u;
+    remap.assign(vertexCount, unused);
+    for (size_t i = 0; i < indexCount; ++i) {
+        if (indices[i] >= vertexCount) {
+            for (size_t v = 0; v < vertexCount; ++v) {
+                remap[v] = static_cast<uint32_t>(v);
+            }
+            return;
+        }
+    }
+
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        uint32_t& target = remap[indices[i]];
+        if (target == unused) {
+            target = next++;
+        }
+        indices[i] = target;
+    }
+    for (auto& target : remap) {
+        if (target == unused) {
+            target = next++;
+        }
+    }
+}
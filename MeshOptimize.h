@@ -0,0 +1,52 @@
+#ifndef MESHOPTIMIZE_H
+#define MESHOPTIMIZE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Index and vertex reordering for the cooker, so triangle lists reach the GPU in an
+// order its post-transform cache, early depth test and vertex fetch all like. The
+// usual sequence is OptimizeVertexCache, OptimizeOverdraw, then OptimizeVertexFetch.
+// Triangle lists only; every function works in place and keeps the set of triangles.
+
+// Size of the FIFO post-transform cache the optimizer and the statistics model
+const size_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats {
+    float acmr; // Average cache miss ratio: vertices transformed per triangle (0.5 is ideal, 3 is worst)
+    float atvr; // Average transform to vertex ratio: vertices transformed per vertex used (1 is ideal)
+};
+
+// Replays the indices through a FIFO cache of VERTEX_CACHE_SIZE entries
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+// Tipsify (Sander, Nehab and Barczak 2007): fans out around the vertex most likely
+// to still be in the cache. clusters, when given, receives the index offset of each
+// point where the walk hit a dead end and jumped, which is where the cache restarts
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<size_t>* clusters = nullptr);
+
+// Reorders the clusters of a cache-optimized list so those facing outwards from the
+// mesh centre draw first and occlude the rest. Clusters are split further wherever
+// that costs less than threshold times the cluster's own ACMR (1.05 keeps the cache
+// within 5%). positions points at the first vertex's xyz floats, positionStride is the
+// byte distance between vertices
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t positionStride, const std::vector<size_t>& clusters, float threshold);
+
+// Renumbers vertices in the order the indices first use them, so fetching walks the
+// vertex buffer forwards. Unused vertices go to the end. Rewrites the indices and
+// returns remap, where remap[old] is the new position of each vertex
+void OptimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>& remap);
+
+// Moves items so that item i ends up at remap[i]
+template <typename T>
+void ApplyVertexRemap(std::vector<T>& items, const std::vector<uint32_t>& remap) {
+    std::vector<T> reordered(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        reordered[remap[i]] = items[i];
+    }
+    items.swap(reordered);
+}
+
+#endif
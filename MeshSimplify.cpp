@@ -0,0 +1,440 @@
+#include "MeshSimplify.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Border planes are weighted up so open edges (the rim of a road, a cut-off wall) keep their outline
+const double BORDER_WEIGHT = 10.0;
+
+// A collapse is refused when it turns any remaining triangle's normal by more than about 80 degrees
+const double MIN_NORMAL_DOT = 0.2;
+
+struct Vec3 {
+    double x, y, z;
+};
+
+Vec3 operator-(const Vec3& a, const Vec3& b) {
+    return Vec3{ a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+Vec3 Cross(const Vec3& a, const Vec3& b) {
+    return Vec3{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+double Dot(const Vec3& a, const Vec3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+double Length(const Vec3& a) {
+    return std::sqrt(Dot(a, a));
+}
+
+Vec3 Scale(const Vec3& a, double s) {
+    return Vec3{ a.x * s, a.y * s, a.z * s };
+}
+
+enum VertexKind {
+    KIND_MANIFOLD, // Interior vertex, may collapse along any edge
+    KIND_BORDER,   // On an open border, may only slide along it
+    KIND_LOCKED    // Border corner or non-manifold, never moves
+};
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix, plus the planes' total weight
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+};
+
+void AddPlane(Quadric& q, const Vec3& n, double d, double weight) {
+    q.a00 += weight * n.x * n.x;
+    q.a01 += weight * n.x * n.y;
+    q.a02 += weight * n.x * n.z;
+    q.a03 += weight * n.x * d;
+    q.a11 += weight * n.y * n.y;
+    q.a12 += weight * n.y * n.z;
+    q.a13 += weight * n.y * d;
+    q.a22 += weight * n.z * n.z;
+    q.a23 += weight * n.z * d;
+    q.a33 += weight * d * d;
+    q.weight += weight;
+}
+
+void AddQuadric(Quadric& q, const Quadric& other) {
+    q.a00 += other.a00;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a03 += other.a03;
+    q.a11 += other.a11;
+    q.a12 += other.a12;
+    q.a13 += other.a13;
+    q.a22 += other.a22;
+    q.a23 += other.a23;
+    q.a33 += other.a33;
+    q.weight += other.weight;
+}
+
+// Weighted mean squared distance from p to the quadric's planes
+double QuadricError(const Quadric& q, const Vec3& p) {
+    double x = p.x, y = p.y, z = p.z;
+    double error = q.a00 * x * x + 2 * q.a01 * x * y + 2 * q.a02 * x * z + 2 * q.a03 * x
+        + q.a11 * y * y + 2 * q.a12 * y * z + 2 * q.a13 * y
+        + q.a22 * z * z + 2 * q.a23 * z
+        + q.a33;
+    return q.weight > 0 ? std::fabs(error) / q.weight : 0;
+}
+
+uint64_t EdgeKey(uint32_t a, uint32_t b) {
+    return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+struct PositionKey {
+    float p[3];
+
+    bool operator==(const PositionKey& other) const {
+        return p[0] == other.p[0] && p[1] == other.p[1] && p[2] == other.p[2];
+    }
+};
+
+struct PositionHash {
+    size_t operator()(const PositionKey& key) const {
+        uint32_t bits[3];
+        memcpy(bits, key.p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+class Simplifier {
+public:
+    Simplifier(const float* positions, size_t vertexCount, size_t positionStride)
+        : vertexCount(vertexCount) {
+        // Vertices that share a position are wedges of one canonical vertex; the
+        // canonical vertex carries the quadric and kind for all of them
+        position.resize(vertexCount);
+        canonical.resize(vertexCount);
+        std::unordered_map<PositionKey, uint32_t, PositionHash> firstAt;
+        for (size_t v = 0; v < vertexCount; ++v) {
+            const float* p = reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(positions) + v * positionStride);
+            PositionKey key = { { p[0] + 0.0f, p[1] + 0.0f, p[2] + 0.0f } }; // + 0 folds -0 into 0
+            position[v] = Vec3{ key.p[0], key.p[1], key.p[2] };
+            canonical[v] = firstAt.emplace(key, static_cast<uint32_t>(v)).first->second;
+        }
+        quadrics.resize(vertexCount);
+        kind.assign(vertexCount, KIND_MANIFOLD);
+    }
+
+    float Run(const uint32_t* indices, size_t indexCount, size_t targetIndexCount, float maxError,
+        const unsigned char* lockedVertices, std::vector<uint32_t>& result) {
+        triangles.clear();
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            if (a >= vertexCount || b >= vertexCount || c >= vertexCount) {
+                continue;
+            }
+            if (canonical[a] != canonical[b] && canonical[b] != canonical[c] && canonical[a] != canonical[c]) {
+                triangles.insert(triangles.end(), { a, b, c });
+            }
+        }
+
+        ClassifyVertices();
+        if (lockedVertices) {
+            for (size_t v = 0; v < vertexCount; ++v) {
+                if (lockedVertices[v]) {
+                    kind[canonical[v]] = KIND_LOCKED;
+                }
+            }
+        }
+        BuildQuadrics();
+
+        double maxCost = static_cast<double>(maxError) * maxError;
+        double resultCost = 0;
+        while (triangles.size() > targetIndexCount) {
+            size_t removed = RunPass(targetIndexCount, maxCost, resultCost);
+            if (removed == 0) {
+                break;
+            }
+            RemoveDegenerates();
+        }
+
+        result = triangles;
+        return static_cast<float>(std::sqrt(resultCost));
+    }
+
+private:
+    size_t vertexCount;
+    std::vector<Vec3> position;
+    std::vector<uint32_t> canonical;
+    std::vector<Quadric> quadrics;  // Indexed by canonical vertex
+    std::vector<unsigned char> kind; // Indexed by canonical vertex
+    std::unordered_set<uint64_t> borderEdges;
+    std::vector<uint32_t> triangles; // Wedge indices
+
+    // Triangles around each canonical vertex, rebuilt every pass
+    std::vector<uint32_t> adjacencyOffsets;
+    std::vector<uint32_t> adjacency;
+
+    void ClassifyVertices() {
+        std::unordered_map<uint64_t, int> edgeUse;
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            for (int e = 0; e < 3; ++e) {
+                edgeUse[EdgeKey(canonical[triangles[i + e]], canonical[triangles[i + (e + 1) % 3]])]++;
+            }
+        }
+
+        std::vector<int> borderCount(vertexCount, 0);
+        for (const auto& edge : edgeUse) {
+            uint32_t a = static_cast<uint32_t>(edge.first >> 32);
+            uint32_t b = static_cast<uint32_t>(edge.first & 0xFFFFFFFFu);
+            if (edge.second == 1) {
+                borderEdges.insert(edge.first);
+                borderCount[a]++;
+                borderCount[b]++;
+            }
+            else if (edge.second > 2) {
+                kind[a] = KIND_LOCKED;
+                kind[b] = KIND_LOCKED;
+            }
+        }
+        for (size_t v = 0; v < vertexCount; ++v) {
+            if (kind[v] != KIND_LOCKED && borderCount[v] > 0) {
+                kind[v] = borderCount[v] == 2 ? KIND_BORDER : KIND_LOCKED;
+            }
+        }
+    }
+
+    void BuildQuadrics() {
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            uint32_t v[3] = { canonical[triangles[i]], canonical[triangles[i + 1]], canonical[triangles[i + 2]] };
+            Vec3 p[3] = { position[v[0]], position[v[1]], position[v[2]] };
+
+            Vec3 normal = Cross(p[1] - p[0], p[2] - p[0]);
+            double doubleArea = Length(normal);
+            if (doubleArea <= 0) {
+                continue;
+            }
+            normal = Scale(normal, 1.0 / doubleArea);
+
+            Quadric plane;
+            AddPlane(plane, normal, -Dot(normal, p[0]), doubleArea * 0.5);
+            for (int c = 0; c < 3; ++c) {
+                AddQuadric(quadrics[v[c]], plane);
+            }
+
+            // Keep open edges in place with a plane through the edge, perpendicular to the triangle
+            for (int e = 0; e < 3; ++e) {
+                uint32_t a = v[e], b = v[(e + 1) % 3];
+                if (!borderEdges.count(EdgeKey(a, b))) {
+                    continue;
+                }
+                Vec3 edge = p[(e + 1) % 3] - p[e];
+                double length = Length(edge);
+                if (length <= 0) {
+                    continue;
+                }
+                Vec3 borderNormal = Scale(Cross(edge, normal), 1.0 / length);
+                Quadric border;
+                AddPlane(border, borderNormal, -Dot(borderNormal, p[e]), length * length * BORDER_WEIGHT);
+                AddQuadric(quadrics[a], border);
+                AddQuadric(quadrics[b], border);
+            }
+        }
+    }
+
+    void BuildAdjacency() {
+        adjacencyOffsets.assign(vertexCount + 1, 0);
+        for (uint32_t wedge : triangles) {
+            adjacencyOffsets[canonical[wedge] + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; ++v) {
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        }
+        adjacency.resize(triangles.size());
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangles.size(); ++i) {
+            adjacency[fill[canonical[triangles[i]]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    bool CanCollapse(uint32_t from, uint32_t to) const {
+        if (kind[from] == KIND_LOCKED) {
+            return false;
+        }
+        return kind[from] == KIND_MANIFOLD || borderEdges.count(EdgeKey(from, to)) != 0;
+    }
+
+    // Cheapest collapse for every canonical vertex, cheapest first
+    std::vector<Collapse> FindCollapses(double maxCost) const {
+        std::vector<Collapse> best(vertexCount, Collapse{ 0, 0, std::numeric_limits<double>::max() });
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            for (int e = 0; e < 3; ++e) {
+                uint32_t a = canonical[triangles[i + e]];
+                uint32_t b = canonical[triangles[i + (e + 1) % 3]];
+                const uint32_t ends[2][2] = { { a, b }, { b, a } };
+                for (const auto& end : ends) {
+                    if (!CanCollapse(end[0], end[1])) {
+                        continue;
+                    }
+                    double cost = QuadricError(quadrics[end[0]], position[end[1]]);
+                    if (cost < best[end[0]].cost) {
+                        best[end[0]] = Collapse{ end[0], end[1], cost };
+                    }
+                }
+            }
+        }
+
+        std::vector<Collapse> collapses;
+        for (const auto& collapse : best) {
+            if (collapse.cost <= maxCost) {
+                collapses.push_back(collapse);
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.cost < b.cost;
+        });
+        return collapses;
+    }
+
+    // Works out which wedge of `to` replaces each wedge of `from`, from the triangles
+    // that contain the edge, and checks that no other triangle flips. Fails when a
+    // wedge of `from` has no partner across the edge, which would smear a UV or normal seam
+    bool PlanCollapse(uint32_t from, uint32_t to, std::vector<std::pair<uint32_t, uint32_t>>& wedgeMap) const {
+        wedgeMap.clear();
+        for (uint32_t k = adjacencyOffsets[from]; k < adjacencyOffsets[from + 1]; ++k) {
+            const uint32_t* corner = &triangles[adjacency[k] * 3];
+            int fromCorner = -1;
+            int toCorner = -1;
+            for (int c = 0; c < 3; ++c) {
+                if (canonical[corner[c]] == from) {
+                    fromCorner = c;
+                }
+                else if (canonical[corner[c]] == to) {
+                    toCorner = c;
+                }
+            }
+
+            if (toCorner >= 0) {
+                auto it = std::find_if(wedgeMap.begin(), wedgeMap.end(),
+                    [&](const std::pair<uint32_t, uint32_t>& entry) { return entry.first == corner[fromCorner]; });
+                if (it == wedgeMap.end()) {
+                    wedgeMap.push_back({ corner[fromCorner], corner[toCorner] });
+                }
+                else if (it->second != corner[toCorner]) {
+                    return false;
+                }
+                continue;
+            }
+
+            Vec3 p[3] = { position[corner[0]], position[corner[1]], position[corner[2]] };
+            Vec3 before = Cross(p[1] - p[0], p[2] - p[0]);
+            p[fromCorner] = position[to];
+            Vec3 after = Cross(p[1] - p[0], p[2] - p[0]);
+            double lengths = Length(before) * Length(after);
+            if (lengths <= 0 || Dot(before, after) < MIN_NORMAL_DOT * lengths) {
+                return false;
+            }
+        }
+
+        for (uint32_t k = adjacencyOffsets[from]; k < adjacencyOffsets[from + 1]; ++k) {
+            const uint32_t* corner = &triangles[adjacency[k] * 3];
+            for (int c = 0; c < 3; ++c) {
+                if (canonical[corner[c]] == from &&
+                    std::none_of(wedgeMap.begin(), wedgeMap.end(),
+                        [&](const std::pair<uint32_t, uint32_t>& entry) { return entry.first == corner[c]; })) {
+                    return false;
+                }
+            }
+        }
+        return !wedgeMap.empty();
+    }
+
+    // One round of independent collapses, each touching a neighbourhood no earlier
+    // collapse of the round has changed. Stops after half the remaining excess is
+    // gone so the next round re-ranks with fresh costs. Returns the triangles removed
+    size_t RunPass(size_t targetIndexCount, double maxCost, double& resultCost) {
+        BuildAdjacency();
+        std::vector<Collapse> collapses = FindCollapses(maxCost);
+
+        size_t liveTriangles = triangles.size() / 3;
+        size_t targetTriangles = targetIndexCount / 3;
+        size_t passGoal = std::max<size_t>(1, (liveTriangles - std::min(liveTriangles, targetTriangles) + 1) / 2);
+        size_t removed = 0;
+
+        std::vector<unsigned char> touched(vertexCount, 0);
+        std::vector<std::pair<uint32_t, uint32_t>> wedgeMap;
+        for (const Collapse& collapse : collapses) {
+            if (removed >= passGoal) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to] || !PlanCollapse(collapse.from, collapse.to, wedgeMap)) {
+                continue;
+            }
+
+            for (uint32_t k = adjacencyOffsets[collapse.from]; k < adjacencyOffsets[collapse.from + 1]; ++k) {
+                uint32_t* corner = &triangles[adjacency[k] * 3];
+                bool hasTo = false;
+                for (int c = 0; c < 3; ++c) {
+                    touched[canonical[corner[c]]] = 1;
+                    hasTo = hasTo || canonical[corner[c]] == collapse.to;
+                }
+                for (int c = 0; c < 3; ++c) {
+                    if (canonical[corner[c]] == collapse.from) {
+                        for (const auto& entry : wedgeMap) {
+                            if (entry.first == corner[c]) {
+                                corner[c] = entry.second;
+                                break;
+                            }
+                        }
+                    }
+                    else if (kind[collapse.from] == KIND_BORDER && canonical[corner[c]] != collapse.to &&
+                        borderEdges.count(EdgeKey(collapse.from, canonical[corner[c]]))) {
+                        // The border edge beyond `from` now ends at `to`
+                        borderEdges.insert(EdgeKey(collapse.to, canonical[corner[c]]));
+                    }
+                }
+                if (hasTo) {
+                    removed++;
+                }
+            }
+
+            AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            resultCost = std::max(resultCost, collapse.cost);
+        }
+        return removed;
+    }
+
+    void RemoveDegenerates() {
+        size_t write = 0;
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            uint32_t a = canonical[triangles[i]], b = canonical[triangles[i + 1]], c = canonical[triangles[i + 2]];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            triangles[write++] = triangles[i];
+            triangles[write++] = triangles[i + 1];
+            triangles[write++] = triangles[i + 2];
+        }
+        triangles.resize(write);
+    }
+};
+
+} // namespace
+
+float SimplifyMesh(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t positionStride, size_t targetIndexCount, float maxError, std::vector<uint32_t>& result,
+    const unsigned char* lockedVertices) {
+    Simplifier simplifier(positions, vertexCount, positionStride);
+    return simplifier.Run(indices, indexCount, targetIndexCount, maxError, lockedVertices, result);
+}
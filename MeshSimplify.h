@@ -0,0 +1,25 @@
+#ifndef MESHSIMPLIFY_H
+#define MESHSIMPLIFY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Quadric-error mesh simplification for the cooker's LOD chains. Edges are collapsed
+// onto existing vertices, so every level indexes the original vertex buffer and only
+// needs an index buffer of its own. Vertices that share a position but not their
+// attributes (UV and normal seams) collapse together along the seam, open borders
+// only slide along themselves, and collapses that would flip a triangle are skipped.
+
+// Reduces a triangle list towards targetIndexCount indices, never accepting a collapse
+// whose error exceeds maxError. positions points at the first vertex's xyz floats,
+// positionStride is the byte distance between vertices. Returns the error of the
+// result: the largest distance, in the positions' units, between the simplified and
+// the original surface as estimated by the quadrics. Vertices flagged in lockedVertices
+// (one byte per vertex, may be null) never move, which keeps the edges a mesh shares
+// with a neighbouring piece identical on both sides
+float SimplifyMesh(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t positionStride, size_t targetIndexCount, float maxError, std::vector<uint32_t>& result,
+    const unsigned char* lockedVertices = nullptr);
+
+#endif
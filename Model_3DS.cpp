@@ -193,8 +193,8 @@ void Model_3DS::Load(char *name)
 		else
 			temp = strrchr(name, '\\');
 
-		// Allocate space for the path
-		path = new char[strlen(name)-strlen(temp)+1];
+		// Allocate space for the path, its trailing slash and the terminator
+		path = new char[strlen(name)-strlen(temp)+2];
 
 		// Get a pointer to the end of the path and name
 		char *src = name + strlen(name) - 1;
@@ -492,7 +492,8 @@ void Model_3DS::EditChunkProcessor(long length, long findex)
 	// Load the Objects (individual meshes in the whole model)
 	if (numObjects > 0)
 	{
-		Objects = new Object[numObjects];
+		// Zeroed, so objects without mesh chunks (cameras, lights) have no vertices or faces
+		Objects = new Object[numObjects]();
 
 		// Set the textured variable to false until we find a texture
 		for (int k = 0; k < numObjects; k++)
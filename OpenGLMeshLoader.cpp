@@ -9,12 +9,33 @@
 #include "GLTexture.h"
 #include <glut.h>
 #include "tiny_gltf.h"
+#include "AssetTools.h"
+#include "CookedAsset.h"
+#include "ThreadPool.h"
+#include "TextureUpload.h"
+#include "InstancedDraw.h"
+#include "ShaderLighting.h"
+#include "SoftwareOcclusion.h"
+#include "VertexQuantize.h"
+#include "SkyDome.h"
+#include "TextRenderer.h"
+#include "HudLayer.h"
+#include "FixedStep.h"
+#include "SimulationThread.h"
+#include "TripleBuffer.h"
+#include "FramePacer.h"
 #include <glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <unordered_map>
+#include <map>
 #include <string>
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <chrono>
+#include <mutex>
 #include <Windows.h>
 #include <iostream>
 #include <mmsystem.h>
@@ -22,14 +43,15 @@
 
 #define M_PI 3.14159265358979323846
 void goToNextLevel(); 
+void PrefetchAssets2();
+void drawRenderStatsHUD();
+void addStressStreetlights(std::vector<PointLight>& lamps);
 
 
 int level = 1;
 boolean selectingCar = true;
 int selectedCar = 0;
 
-GLuint shaderProgram;
-
 
 class Vector
 {
@@ -60,210 +82,1566 @@ public:
 
 
 
-class GLTFModel {
-public:
-    bool LoadModel(const std::string& filename) {
-        tinygltf::TinyGLTF loader;
-        std::string err;
-        std::string warn;
+class GLTFAsset;
 
-        bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
+// Screen-space LOD selection. A primitive draws the coarsest cooked level whose
+// simplification error, projected at the primitive's distance, stays under pixelError
+struct LodSettings {
+    bool enabled = true;
+    float pixelError = 1.0f;      // Allowed error on screen, in pixels
+    float hysteresis = 0.6f;      // A coarser level is only taken once its error is under pixelError * hysteresis
+    float projectionScale = 0.0f; // Pixels covered by one unit at distance 1, from the current projection
+    unsigned frame = 0;           // Counts UpdateLodProjection calls, so assets can tell their draws in a frame apart
+};
+
+LodSettings lodSettings;
+
+// Reads the perspective projection and viewport the frame is drawn with; call before drawing the 3D scene
+void UpdateLodProjection() {
+    GLfloat projection[16];
+    GLint viewport[4];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    // projection[5] is cot(fovy / 2), which maps the half height at distance 1 to 1
+    lodSettings.projectionScale = projection[5] * viewport[3] * 0.5f;
+    lodSettings.frame++;
+}
 
-        if (!warn.empty()) {
-            std::cout << "GLTF loading warning: " << warn << std::endl;
+// The six clip planes (left, right, bottom, top, near, far) of a projection * modelview
+// matrix, in the space that matrix maps from. A point p is inside a plane when
+// dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Gribb-Hartmann: each plane is the sum or difference of the matrix's last row and one of the others
+    static Frustum FromMatrix(const glm::mat4& m) {
+        Frustum frustum;
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int side = 0; side < 2; ++side) {
+                float sign = side == 0 ? 1.0f : -1.0f;
+                glm::vec4& plane = frustum.planes[axis * 2 + side];
+                for (int column = 0; column < 4; ++column) {
+                    plane[column] = m[column][3] + sign * m[column][axis];
+                }
+            }
+        }
+        return frustum;
+    }
+
+    enum Containment { OUTSIDE, INTERSECTING, INSIDE };
+
+    // Conservative box test: OUTSIDE only when the box is entirely beyond one plane,
+    // INSIDE when it is entirely within all six
+    Containment ClassifyBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const {
+        Containment result = INSIDE;
+        for (const glm::vec4& plane : planes) {
+            // The corners furthest along and against the plane normal
+            float nearX = plane.x >= 0.0f ? boxMax.x : boxMin.x;
+            float nearY = plane.y >= 0.0f ? boxMax.y : boxMin.y;
+            float nearZ = plane.z >= 0.0f ? boxMax.z : boxMin.z;
+            if (plane.x * nearX + plane.y * nearY + plane.z * nearZ + plane.w < 0.0f) {
+                return OUTSIDE;
+            }
+            float farX = plane.x >= 0.0f ? boxMin.x : boxMax.x;
+            float farY = plane.y >= 0.0f ? boxMin.y : boxMax.y;
+            float farZ = plane.z >= 0.0f ? boxMin.z : boxMax.z;
+            if (plane.x * farX + plane.y * farY + plane.z * farZ + plane.w < 0.0f) {
+                result = INTERSECTING;
+            }
         }
+        return result;
+    }
+
+    bool IntersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const {
+        return ClassifyBox(boxMin, boxMax) != OUTSIDE;
+    }
+};
+
+bool frustumCulling = true;
+bool occlusionCulling = true;
+
+// Upload glTF and 3DS vertices as QuantizedVertex where the driver takes half floats;
+// read when an asset is uploaded, so it is set once at startup (--float-vertices turns it off)
+bool quantizedVertices = true;
+
+// Runs the software occlusion passes, one at a time, off the GLUT thread
+ThreadPool occlusionPool(1);
+
+// Current projection times the given modelview (the gluLookAt camera times any model transform)
+glm::mat4 CurrentClipMatrix(const glm::mat4& modelView) {
+    glm::mat4 projection;
+    glGetFloatv(GL_PROJECTION_MATRIX, glm::value_ptr(projection));
+    return projection * modelView;
+}
+
+// Collects every glTF primitive drawn during a pass and issues them sorted by
+// texture and material, so shared textures are bound once instead of once per primitive
+class RenderQueue {
+public:
+    struct RenderItem {
+        uint64_t sortKey;
+        GLuint texture;          // 0 when the material is untextured
+        glm::vec4 color;
+        const GLTFAsset* model;
+        int mesh;
+        int primitive;
+        int lod;
+        glm::mat4 transform;     // Full modelview for the primitive
+    };
+
+    struct Stats {
+        int items = 0;
+        int textureBindsUnsorted = 0;    // What submission order would have cost
+        int materialChangesUnsorted = 0;
+        int textureBinds = 0;            // What the sorted order actually cost
+        int materialChanges = 0;
+        int instancedDraws = 0;          // Drawn straight away by DrawInstanced, not queued
+        int instances = 0;
+        int lodTriangles[COOKED_MAX_LODS] = {}; // Triangles drawn from each LOD level
+        int primitivesDrawn = 0;         // Primitive draws that passed frustum culling, one per instance
+        int primitivesCulled = 0;        // Primitive draws skipped by frustum culling
+        int primitivesOccluded = 0;      // Inside the frustum but hidden by the software occlusion pass
+    };
+
+    // Starts collecting draws for a frame; GLTFAsset::DrawModel submits instead of drawing while recording
+    void Begin() {
+        items.clear();
+        frameStats = Stats();
+        recording = true;
+    }
+
+    void Submit(const RenderItem& item) {
+        items.push_back(item);
+    }
+
+    void CountInstancedDraw(int instanceCount) {
+        frameStats.instancedDraws++;
+        frameStats.instances += instanceCount;
+    }
+
+    void CountTriangles(int lod, int triangles) {
+        frameStats.lodTriangles[lod] += triangles;
+    }
 
-        if (!err.empty()) {
-            std::cerr << "GLTF loading error: " << err << std::endl;
+    void CountCulling(int drawn, int culled, int occluded = 0) {
+        frameStats.primitivesDrawn += drawn;
+        frameStats.primitivesCulled += culled;
+        frameStats.primitivesOccluded += occluded;
+    }
+
+    // Draws what has been collected so far and keeps recording; used around fixed-function state changes
+    void Flush();
+
+    // Flushes the remaining draws and stops recording
+    void End() {
+        Flush();
+        recording = false;
+        lastFrameStats = frameStats;
+    }
+
+    bool IsRecording() const {
+        return recording;
+    }
+
+    const Stats& GetLastFrameStats() const {
+        return lastFrameStats;
+    }
+
+    static uint64_t MakeSortKey(GLuint texture, const glm::vec4& color, GLuint buffer) {
+        // texture | color quantised to 4 bits per channel | buffer, so equal state ends up adjacent
+        uint64_t colorKey = 0;
+        for (int i = 0; i < 4; ++i) {
+            colorKey = (colorKey << 4) | static_cast<uint64_t>(std::min(std::max(color[i], 0.0f), 1.0f) * 15.0f + 0.5f);
         }
+        return (static_cast<uint64_t>(texture) << 32) | (colorKey << 16) | (buffer & 0xFFFF);
+    }
 
-        if (!ret) {
-            std::cerr << "Failed to load glTF: " << filename << std::endl;
-            return false;
+private:
+    std::vector<RenderItem> items;
+    Stats frameStats;
+    Stats lastFrameStats;
+    bool recording = false;
+
+    // Counts texture binds and material changes for the current order of items
+    static void CountStateChanges(const std::vector<RenderItem>& list, int& textureBinds, int& materialChanges) {
+        const RenderItem* previous = nullptr;
+        for (const auto& item : list) {
+            bool textureChanged = !previous || previous->texture != item.texture;
+            bool colorChanged = !previous || previous->color != item.color;
+            if (textureChanged) {
+                textureBinds++;
+            }
+            if (textureChanged || colorChanged) {
+                materialChanges++;
+            }
+            previous = &item;
         }
+    }
+};
 
-        return true;
+RenderQueue renderQueue;
+
+// Creates the GL texture for one image of a cooked blob, raw or block-compressed
+GLuint UploadCookedImage(const CookedAsset& cooked, uint32_t index, GLenum wrap, GLenum minFilter) {
+    const CookedImage& image = cooked.Images()[index];
+    const unsigned char* levels = cooked.Data(image.dataOffset);
+    if (image.format != 0) {
+        return UploadCompressedTexture(levels, image.width, image.height, image.format, image.mipCount, wrap, minFilter);
+    }
+    return UploadTexture(levels, image.width, image.height, image.components, image.mipCount, wrap, minFilter);
+}
+
+// One loaded model and the GL objects built from it. Instances are shared
+// between every GLTFModel handle that loads the same file (see AssetRegistry).
+// Geometry and textures come from a memory-mapped CookedAsset, cooked by --cook
+// or by LoadCookedAsset the first time the asset is loaded
+class GLTFAsset {
+public:
+    GLTFAsset() {}
+    GLTFAsset(const GLTFAsset&) = delete;
+    GLTFAsset& operator=(const GLTFAsset&) = delete;
+
+    // GL half of loading; the CookedAsset itself can be loaded on any thread
+    void Upload(const CookedAsset& cooked) {
+        UploadTextures(cooked);
+        LoadMaterials(cooked);
+        UploadMeshes(cooked);
+        LoadNodeHierarchy(cooked);
+        LoadOccluders(cooked);
+    }
+
+    // Vertex buffer sizes as uploaded, and as they would be with float vertices
+    size_t VertexBytes() const { return vertexBytes; }
+    size_t FloatVertexBytes() const { return floatVertexBytes; }
+
+    // Software occlusion culling against the asset's own largest primitives. Meant for
+    // a scene the camera moves through (the city) and drawn once per frame: the pass
+    // started by one draw is consumed by the next
+    void SetOcclusionCulling(bool enabled) {
+        occlusionEnabled = enabled;
+        if (!enabled) {
+            FinishOcclusionPass();
+            occludedItems.clear();
+        }
     }
 
     void DrawModel(const glm::mat4& transform = glm::mat4(1.0f)) const {
-        const tinygltf::Scene& scene = model.scenes[model.defaultScene];
-        for (size_t i = 0; i < scene.nodes.size(); ++i) {
-            DrawNode(scene.nodes[i], transform);
+        UpdateTransforms();
+        BeginLodDraw();
+
+        if (renderQueue.IsRecording()) {
+            SubmitModel(transform);
+            return;
+        }
+
+        glm::mat4 modelView;
+        glGetFloatv(GL_MODELVIEW_MATRIX, glm::value_ptr(modelView));
+        modelView = modelView * transform;
+        CollectVisible(CurrentClipMatrix(modelView));
+
+        glPushMatrix();
+        glMultMatrixf(glm::value_ptr(transform));
+        DrawVisible(modelView);
+        glPopMatrix();
+    }
+
+    // Draws one copy of the model per transform, each relative to the current modelview,
+    // with a single instanced draw call per primitive. Bypasses the RenderQueue since the
+    // batch is already one call per primitive. Drivers without instancing get DrawModel per transform.
+    // Instances whose whole model is outside the frustum are dropped before the upload
+    void DrawInstanced(const std::vector<glm::mat4>& allTransforms) const {
+        if (allTransforms.empty() || bvh.empty()) {
+            return;
         }
+        if (!InstancingEnabled() || !InstancingAvailable()) {
+            for (const auto& transform : allTransforms) {
+                DrawModel(transform);
+            }
+            return;
+        }
+        UpdateTransforms();
+        BeginLodDraw();
+
+        glm::mat4 modelView;
+        glGetFloatv(GL_MODELVIEW_MATRIX, glm::value_ptr(modelView));
+
+        const std::vector<glm::mat4>* visible = &allTransforms;
+        if (frustumCulling) {
+            glm::mat4 viewProjection = CurrentClipMatrix(modelView);
+
+            visibleInstances.clear();
+            for (const auto& transform : allTransforms) {
+                if (Frustum::FromMatrix(viewProjection * transform).IntersectsBox(bvh[0].boundsMin, bvh[0].boundsMax)) {
+                    visibleInstances.push_back(transform);
+                }
+            }
+            visible = &visibleInstances;
+            int culled = static_cast<int>(allTransforms.size() - visibleInstances.size());
+            renderQueue.CountCulling(0, culled * static_cast<int>(nodePrimitives.size()));
+            if (visibleInstances.empty()) {
+                return;
+            }
+        }
+        const std::vector<glm::mat4>& transforms = *visible;
+        renderQueue.CountCulling(static_cast<int>(transforms.size() * nodePrimitives.size()), 0);
+
+        // Orphan the previous contents so the driver need not wait for draws still reading them
+        GLsizeiptr size = static_cast<GLsizeiptr>(transforms.size() * sizeof(glm::mat4));
+        if (!instanceBuffer) {
+            glGenBuffers(1, &instanceBuffer);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, transforms.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        GLsizei instanceCount = static_cast<GLsizei>(transforms.size());
+        std::vector<glm::mat4>& eyeTransforms = instanceEyeTransforms;
+        eyeTransforms.resize(transforms.size());
+        int currentFlat = -1;
+        BeginInstancing();
+        for (size_t item = 0; item < nodePrimitives.size(); ++item) {
+            const NodePrimitive& placed = nodePrimitives[item];
+            const FlatNode& flat = flatNodes[placed.flat];
+            if (placed.flat != currentFlat) {
+                for (size_t k = 0; k < transforms.size(); ++k) {
+                    eyeTransforms[k] = modelView * transforms[k] * flat.world;
+                }
+                currentFlat = placed.flat;
+            }
+
+            // One level for the whole batch, fine enough for the nearest instance
+            const GPUPrimitive& gpu = gpuMeshes[flat.mesh][placed.primitive];
+            float pixelsPerUnit = 0.0f;
+            if (gpu.lods.size() > 1) {
+                for (const auto& eyeTransform : eyeTransforms) {
+                    pixelsPerUnit = std::max(pixelsPerUnit, ProjectedPixelsPerUnit(gpu, eyeTransform));
+                }
+            }
+            int lod = UpdateLod(static_cast<int>(item), pixelsPerUnit);
+
+            SetInstanceTexturing(SetMaterial(gpu.material));
+            SetInstanceNodeMatrix(glm::value_ptr(gpu.quantized ? flat.world * gpu.dequantize : flat.world));
+            DrawPrimitiveInstanced(flat.mesh, placed.primitive, lod, instanceCount);
+            renderQueue.CountInstancedDraw(instanceCount);
+        }
+        EndInstancing();
+        glEnable(GL_TEXTURE_2D);
+        glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
     }
 
     void UnloadModel() {
-        for (const auto& entry : textureCache) {
-            glDeleteTextures(1, &entry.second);
+        for (GLuint texture : textures) {
+            if (texture) {
+                glDeleteTextures(1, &texture);
+            }
+        }
+        textures.clear();
+        materials.clear();
+        ReleaseMeshes();
+        if (instanceBuffer) {
+            glDeleteBuffers(1, &instanceBuffer);
+            instanceBuffer = 0;
         }
-        textureCache.clear();
+        FinishOcclusionPass();
+        occludedItems.clear();
+        occluders.clear();
+        flatNodes.clear();
+        nodeToFlat.clear();
 
-        // Clear model data
-        model = tinygltf::Model();
         std::cout << "Model and textures unloaded successfully." << std::endl;
     }
 
-private:
-    tinygltf::Model model;
-    mutable std::unordered_map<int, GLuint> textureCache;
+    // A scene node flattened out of the hierarchy; parents always come before children
+    struct FlatNode {
+        int node;        // Index into the source file's nodes
+        int mesh;        // Mesh drawn at this node, -1 if none
+        int parent;      // Index into the flat list, -1 for scene roots
+        glm::mat4 local; // Transform relative to the parent
+        glm::mat4 world; // Transform relative to the model root
+        bool dirty;
+    };
+
+    // Flat node list in draw order, for systems that need node transforms (culling, collision)
+    const std::vector<FlatNode>& GetFlatNodes() const {
+        UpdateTransforms();
+        return flatNodes;
+    }
 
-    void DrawNode(int nodeIndex, const glm::mat4& parentTransform) const {
-        const tinygltf::Node& node = model.nodes[nodeIndex];
+    // Binds the primitive's buffers and draws one of its LOD levels; material state is left to the caller
+    void DrawPrimitive(int meshIndex, int primitiveIndex, int lod = 0) const {
+        const GPUPrimitive& gpu = gpuMeshes[meshIndex][primitiveIndex];
 
-        glm::mat4 localTransform = glm::mat4(1.0f);
+        if (gpu.quantized) {
+            glPushMatrix();
+            glMultMatrixf(glm::value_ptr(gpu.dequantize));
+        }
+        if (gpu.vao) {
+            glBindVertexArray(gpu.vao);
+        }
+        else {
+            BindVertexLayout(gpu);
+        }
 
-        if (node.matrix.size() == 16) {
-            localTransform = glm::make_mat4(node.matrix.data());
+        if (gpu.indexBuffer) {
+            const GPUPrimitive::Lod& level = gpu.lods[lod];
+            glDrawElements(gpu.mode, level.indexCount, gpu.indexType, reinterpret_cast<const void*>(level.indexOffset));
         }
         else {
-            if (node.translation.size() == 3) {
-                localTransform = glm::translate(localTransform,
-                    glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+            glDrawArrays(gpu.mode, 0, gpu.vertexCount);
+        }
+        renderQueue.CountTriangles(lod, TriangleCount(gpu, lod));
+
+        if (gpu.vao) {
+            glBindVertexArray(0);
+        }
+        else {
+            UnbindVertexLayout(gpu);
+        }
+        if (gpu.quantized) {
+            glPopMatrix();
+        }
+    }
+
+    // Overrides a node's local transform; its world matrix and its children's are refreshed before the next use
+    void SetNodeLocalTransform(int nodeIndex, const glm::mat4& local) {
+        if (nodeIndex < 0 || nodeIndex >= static_cast<int>(nodeToFlat.size()) || nodeToFlat[nodeIndex] < 0) {
+            return;
+        }
+        FlatNode& flat = flatNodes[nodeToFlat[nodeIndex]];
+        flat.local = local;
+        flat.dirty = true;
+        transformsDirty = true;
+    }
+
+private:
+    // GL objects for one primitive, built once in LoadModel
+    struct GPUPrimitive {
+        GLuint vao = 0;
+        GLuint vertexBuffer = 0;
+        GLuint indexBuffer = 0;
+        GLenum mode = GL_TRIANGLES;
+        GLenum indexType = GL_UNSIGNED_INT;
+        GLsizei indexCount = 0;
+        GLsizei vertexCount = 0;
+        int material = -1;
+        bool hasNormals = false;
+        bool hasTexCoords = false;
+        bool hasTangents = false;
+        bool quantized = false;  // vertexBuffer holds QuantizedVertex rather than CookedVertex
+        glm::mat4 dequantize = glm::mat4(1.0f); // Grid values to object space, identity unless quantized
+        glm::vec3 boundsMin;     // Object-space bounds from the cooker
+        glm::vec3 boundsMax;
+
+        // Index range of each LOD level inside indexBuffer; level 0 is the full mesh
+        struct Lod {
+            GLsizei indexCount;
+            size_t indexOffset;  // In bytes
+            float error;         // Object-space simplification error, 0 for level 0
+        };
+        std::vector<Lod> lods;
+    };
+
+    // A primitive as placed by one flat node: the unit that is culled, LOD-selected and drawn
+    struct NodePrimitive {
+        int flat;
+        int primitive;
+        glm::vec3 boundsMin;     // Model space
+        glm::vec3 boundsMax;
+    };
+
+    // Bounding volume hierarchy over nodePrimitives in model space. A node's children
+    // are stored after it, so sweeping the array backwards refits it bottom-up
+    struct BvhNode {
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        int left;                // Interior: index of the first child, the second follows it; -1 for leaves
+        int first;               // Leaf: its range of bvhItems
+        int count;
+    };
+
+    static const int BVH_LEAF_SIZE = 4;
+
+    // Occluders are only picked for scenes with at least this many node primitives,
+    // up to this many triangles of their coarsest LODs
+    static const size_t OCCLUSION_MIN_PRIMITIVES = 64;
+    static const size_t OCCLUDER_TRIANGLE_BUDGET = 16384;
+
+    // CPU copy of a primitive's coarsest LOD for the software rasterizer
+    struct OccluderMesh {
+        std::vector<float> positions;  // xyz per vertex, in the primitive's object space
+        std::vector<uint32_t> indices;
+    };
+
+    struct Occluder {
+        int item;                      // Index into nodePrimitives
+        std::shared_ptr<const OccluderMesh> mesh;
+    };
+
+    // Everything one occlusion pass reads, copied so the GLUT thread can move on
+    struct OcclusionPass {
+        glm::mat4 clip;                // Model space to clip space
+        size_t itemCount;
+        std::vector<int> items;        // Items to test: the frustum survivors of the frame
+        std::vector<glm::vec3> bounds; // Min/max pairs of items
+        std::vector<glm::mat4> occluderClips; // Object space to clip space, nearest occluder first
+        std::vector<std::shared_ptr<const OccluderMesh>> occluderMeshes;
+    };
+
+    struct Material {
+        bool textured;       // Has a base colour texture, even if it failed to load
+        GLuint texture;      // 0 when untextured or the upload failed
+        glm::vec4 baseColor; // Used for untextured materials
+    };
+
+    // Generic attribute slot for tangents; fixed-function rendering ignores it
+    static const GLuint TANGENT_ATTRIB = 6;
+
+    std::vector<GLuint> textures;                     // Same indexing as the cooked images
+    std::vector<Material> materials;
+    std::vector<std::vector<GPUPrimitive>> gpuMeshes; // Same indexing as the source meshes
+    mutable std::vector<FlatNode> flatNodes;
+    mutable GLuint instanceBuffer = 0;                // Per-instance matrices for DrawInstanced
+    mutable std::vector<NodePrimitive> nodePrimitives; // Grouped by flat node, in flat node order
+    mutable std::vector<BvhNode> bvh;                 // bvh[0] is the root and bounds the whole model
+    std::vector<int> bvhItems;                        // nodePrimitives indices, leaf by leaf
+    mutable std::vector<int> visibleItems;            // CollectVisible's result
+    mutable std::vector<glm::mat4> visibleInstances;  // DrawInstanced's transforms that survived culling
+    mutable std::vector<glm::mat4> instanceEyeTransforms; // DrawInstanced's per-instance modelviews for one node
+    mutable std::vector<uint8_t> lodStates;           // Current LOD level per nodePrimitives item, one run per draw in a frame
+    mutable size_t lodStateBase = 0;                  // Start of the current draw's run
+    mutable unsigned lodStateFrame = 0;               // lodSettings.frame of the last draw
+    mutable size_t lodDraw = 0;                       // Draws of this asset so far in that frame
+    std::vector<Occluder> occluders;                  // Chosen at load, largest first
+    bool occlusionEnabled = false;
+    mutable std::shared_ptr<OcclusionBuffer> occlusionBuffer; // Shared with the pass in flight
+    mutable std::future<std::vector<uint8_t>> occlusionJob;
+    mutable std::vector<uint8_t> occludedItems;       // Last finished pass, 1 per hidden item
+    std::vector<int> nodeToFlat;                      // Source node index -> flatNodes index
+    mutable bool transformsDirty = false;
+    size_t vertexBytes = 0;                           // Uploaded vertex data
+    size_t floatVertexBytes = 0;                      // The same vertices as CookedVertex
+
+    static bool VertexArraysSupported() {
+        return GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
+    }
+
+    static bool QuantizationSupported() {
+        return quantizedVertices && (GLEW_VERSION_3_0 || GLEW_ARB_half_float_vertex);
+    }
+
+    // Uploads straight from the cooked data; images without a baked mip chain get one from the driver
+    void UploadTextures(const CookedAsset& cooked) {
+        const CookedHeader& header = cooked.Header();
+        textures.assign(header.imageCount, 0);
+
+        for (uint32_t i = 0; i < header.imageCount; ++i) {
+            textures[i] = UploadCookedImage(cooked, i, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void LoadMaterials(const CookedAsset& cooked) {
+        const CookedHeader& header = cooked.Header();
+        materials.resize(header.materialCount);
+        for (uint32_t i = 0; i < header.materialCount; ++i) {
+            const CookedMaterial& source = cooked.Materials()[i];
+            materials[i].textured = source.textured != 0;
+            materials[i].texture = source.image >= 0 ? textures[source.image] : 0;
+            materials[i].baseColor = glm::make_vec4(source.baseColor);
+        }
+    }
+
+    // Every primitive of a mesh is quantized on one grid over the mesh's bounds
+    void UploadMeshes(const CookedAsset& cooked) {
+        const CookedHeader& header = cooked.Header();
+        gpuMeshes.resize(header.meshCount);
+        vertexBytes = 0;
+        floatVertexBytes = 0;
+        for (uint32_t m = 0; m < header.meshCount; ++m) {
+            const CookedMesh& mesh = cooked.Meshes()[m];
+            glm::vec3 meshMin(FLT_MAX);
+            glm::vec3 meshMax(-FLT_MAX);
+            for (uint32_t p = 0; p < mesh.primitiveCount; ++p) {
+                const CookedPrimitive& primitive = cooked.Primitives()[mesh.firstPrimitive + p];
+                meshMin = glm::min(meshMin, glm::make_vec3(primitive.boundsMin));
+                meshMax = glm::max(meshMax, glm::make_vec3(primitive.boundsMax));
             }
+            QuantizationGrid grid = MakeQuantizationGrid(&meshMin.x, &meshMax.x);
+            for (uint32_t p = 0; p < mesh.primitiveCount; ++p) {
+                gpuMeshes[m].push_back(UploadPrimitive(cooked, cooked.Primitives()[mesh.firstPrimitive + p], grid));
+            }
+        }
+    }
+
+    GPUPrimitive UploadPrimitive(const CookedAsset& cooked, const CookedPrimitive& primitive, const QuantizationGrid& grid) {
+        GPUPrimitive gpu;
+        gpu.mode = primitive.mode;
+        gpu.material = primitive.material;
+        gpu.vertexCount = static_cast<GLsizei>(primitive.vertexCount);
+        gpu.hasNormals = (primitive.flags & COOKED_HAS_NORMALS) != 0;
+        gpu.hasTexCoords = (primitive.flags & COOKED_HAS_TEXCOORDS) != 0;
+        gpu.hasTangents = (primitive.flags & COOKED_HAS_TANGENTS) != 0;
+        gpu.boundsMin = glm::make_vec3(primitive.boundsMin);
+        gpu.boundsMax = glm::make_vec3(primitive.boundsMax);
+
+        if (VertexArraysSupported()) {
+            glGenVertexArrays(1, &gpu.vao);
+            glBindVertexArray(gpu.vao);
+        }
 
-            if (node.rotation.size() == 4) {
-                glm::quat q = glm::quat(node.rotation[3], node.rotation[0],
-                    node.rotation[1], node.rotation[2]);
-                localTransform = localTransform * glm::mat4_cast(q);
+        glGenBuffers(1, &gpu.vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, gpu.vertexBuffer);
+        const CookedVertex* vertices = reinterpret_cast<const CookedVertex*>(cooked.Data(primitive.vertexOffset));
+        floatVertexBytes += primitive.vertexCount * sizeof(CookedVertex);
+        // Tiled texcoords (the track's run past 200) would lose too much as half floats
+        if (QuantizationSupported() && !(primitive.flags & COOKED_WIDE_TEXCOORDS)) {
+            std::vector<QuantizedVertex> packed;
+            QuantizeVertices(vertices, primitive.vertexCount, grid, packed);
+            glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(QuantizedVertex), packed.data(), GL_STATIC_DRAW);
+            vertexBytes += packed.size() * sizeof(QuantizedVertex);
+            gpu.quantized = true;
+            gpu.dequantize = glm::scale(glm::translate(glm::mat4(1.0f), glm::make_vec3(grid.offset)), glm::vec3(grid.scale));
+        }
+        else {
+            glBufferData(GL_ARRAY_BUFFER, primitive.vertexCount * sizeof(CookedVertex), vertices, GL_STATIC_DRAW);
+            vertexBytes += primitive.vertexCount * sizeof(CookedVertex);
+        }
+
+        if (primitive.indexType != 0) {
+            // Every LOD level indexes the same vertices, so the levels share one index buffer
+            GLsizeiptr indexSize = primitive.indexType == GL_UNSIGNED_INT ? sizeof(unsigned int) : sizeof(unsigned short);
+            std::vector<std::pair<const void*, GPUPrimitive::Lod>> levels;
+            levels.push_back({ cooked.Data(primitive.indexOffset), { static_cast<GLsizei>(primitive.indexCount), 0, 0.0f } });
+            size_t totalSize = primitive.indexCount * indexSize;
+            for (uint32_t l = 0; l < primitive.lodCount; ++l) {
+                const CookedLod& lod = cooked.Lods()[primitive.firstLod + l];
+                levels.push_back({ cooked.Data(lod.indexOffset), { static_cast<GLsizei>(lod.indexCount), totalSize, lod.error } });
+                totalSize += lod.indexCount * indexSize;
             }
 
-            if (node.scale.size() == 3) {
-                localTransform = glm::scale(localTransform,
-                    glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+            glGenBuffers(1, &gpu.indexBuffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.indexBuffer);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalSize, nullptr, GL_STATIC_DRAW);
+            for (const auto& level : levels) {
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, level.second.indexOffset, level.second.indexCount * indexSize, level.first);
+                gpu.lods.push_back(level.second);
             }
+            gpu.indexType = primitive.indexType;
+            gpu.indexCount = static_cast<GLsizei>(primitive.indexCount);
+        }
+        else {
+            gpu.lods.push_back({ 0, 0, 0.0f });
+        }
+
+        if (gpu.vao) {
+            BindVertexLayout(gpu);
+            glBindVertexArray(0);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        return gpu;
+    }
+
+    // Points the fixed-function arrays (and the tangent attribute) at the primitive's buffers
+    void BindVertexLayout(const GPUPrimitive& gpu) const {
+        glBindBuffer(GL_ARRAY_BUFFER, gpu.vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.indexBuffer);
+        if (gpu.quantized) {
+            BindQuantizedLayout(gpu);
+            return;
         }
 
-        glm::mat4 nodeTransform = parentTransform * localTransform;
+        const GLsizei stride = sizeof(CookedVertex);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, stride, reinterpret_cast<const void*>(offsetof(CookedVertex, position)));
 
-        if (node.mesh >= 0) {
-            DrawMesh(model.meshes[node.mesh], nodeTransform);
+        if (gpu.hasNormals) {
+            glEnableClientState(GL_NORMAL_ARRAY);
+            glNormalPointer(GL_FLOAT, stride, reinterpret_cast<const void*>(offsetof(CookedVertex, normal)));
+        }
+        if (gpu.hasTexCoords) {
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glTexCoordPointer(2, GL_FLOAT, stride, reinterpret_cast<const void*>(offsetof(CookedVertex, texcoord)));
         }
+        if (gpu.hasTangents) {
+            glEnableVertexAttribArray(TANGENT_ATTRIB);
+            glVertexAttribPointer(TANGENT_ATTRIB, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(offsetof(CookedVertex, tangent)));
+        }
+    }
 
-        for (int child : node.children) {
-            DrawNode(child, nodeTransform);
+    // Same arrays over QuantizedVertex; positions come out as grid values, so draws go through gpu.dequantize
+    void BindQuantizedLayout(const GPUPrimitive& gpu) const {
+        const GLsizei stride = sizeof(QuantizedVertex);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_SHORT, stride, reinterpret_cast<const void*>(offsetof(QuantizedVertex, position)));
+
+        if (gpu.hasNormals) {
+            glEnableClientState(GL_NORMAL_ARRAY);
+            glNormalPointer(GL_BYTE, stride, reinterpret_cast<const void*>(offsetof(QuantizedVertex, normal)));
+        }
+        if (gpu.hasTexCoords) {
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glTexCoordPointer(2, GL_HALF_FLOAT, stride, reinterpret_cast<const void*>(offsetof(QuantizedVertex, texcoord)));
+        }
+        if (gpu.hasTangents) {
+            glEnableVertexAttribArray(TANGENT_ATTRIB);
+            glVertexAttribPointer(TANGENT_ATTRIB, 4, GL_BYTE, GL_TRUE, stride, reinterpret_cast<const void*>(offsetof(QuantizedVertex, tangent)));
         }
     }
 
-    void DrawMesh(const tinygltf::Mesh& mesh, const glm::mat4& transform) const {
-        glPushMatrix();
-        glMultMatrixf(glm::value_ptr(transform));
+    void UnbindVertexLayout(const GPUPrimitive& gpu) const {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        if (gpu.hasNormals) {
+            glDisableClientState(GL_NORMAL_ARRAY);
+        }
+        if (gpu.hasTexCoords) {
+            glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        }
+        if (gpu.hasTangents) {
+            glDisableVertexAttribArray(TANGENT_ATTRIB);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
 
-        for (const auto& primitive : mesh.primitives) {
-            if (primitive.indices < 0) continue;
+    void ReleasePrimitive(GPUPrimitive& gpu) {
+        if (gpu.vao) {
+            glDeleteVertexArrays(1, &gpu.vao);
+        }
+        if (gpu.vertexBuffer) {
+            glDeleteBuffers(1, &gpu.vertexBuffer);
+        }
+        if (gpu.indexBuffer) {
+            glDeleteBuffers(1, &gpu.indexBuffer);
+        }
+        gpu = GPUPrimitive();
+    }
 
-            if (primitive.material >= 0) {
-                const auto& material = model.materials[primitive.material];
-                SetMaterial(material);
+    void ReleaseMeshes() {
+        for (auto& primitives : gpuMeshes) {
+            for (auto& gpu : primitives) {
+                ReleasePrimitive(gpu);
             }
+        }
+        gpuMeshes.clear();
+    }
+
+    // The cooker has already flattened the default scene depth first and baked every world matrix
+    void LoadNodeHierarchy(const CookedAsset& cooked) {
+        const CookedHeader& header = cooked.Header();
+        flatNodes.resize(header.nodeCount);
+        nodeToFlat.assign(header.sourceNodeCount, -1);
+
+        for (uint32_t i = 0; i < header.nodeCount; ++i) {
+            const CookedNode& node = cooked.Nodes()[i];
+            FlatNode& flat = flatNodes[i];
+            flat.node = node.node;
+            flat.mesh = node.mesh;
+            flat.parent = node.parent;
+            flat.local = glm::make_mat4(node.local);
+            flat.world = glm::make_mat4(node.world);
+            flat.dirty = false;
+            nodeToFlat[node.node] = static_cast<int>(i);
+        }
+        transformsDirty = false;
 
-            const auto& posAccessor = model.accessors[primitive.attributes.at("POSITION")];
-            const auto& posView = model.bufferViews[posAccessor.bufferView];
-            const float* positions = reinterpret_cast<const float*>(
-                &model.buffers[posView.buffer].data[posView.byteOffset + posAccessor.byteOffset]);
-
-            const float* texcoords = nullptr;
-            if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-                const auto& texAccessor = model.accessors[primitive.attributes.at("TEXCOORD_0")];
-                const auto& texView = model.bufferViews[texAccessor.bufferView];
-                texcoords = reinterpret_cast<const float*>(
-                    &model.buffers[texView.buffer].data[texView.byteOffset + texAccessor.byteOffset]);
+        nodePrimitives.clear();
+        lodStates.clear();
+        for (size_t i = 0; i < flatNodes.size(); ++i) {
+            if (flatNodes[i].mesh < 0) {
+                continue;
+            }
+            for (size_t p = 0; p < gpuMeshes[flatNodes[i].mesh].size(); ++p) {
+                NodePrimitive placed = {};
+                placed.flat = static_cast<int>(i);
+                placed.primitive = static_cast<int>(p);
+                nodePrimitives.push_back(placed);
+            }
+        }
+        bvh.clear();
+        UpdateBounds(true);
+        BuildBvh();
+    }
+
+    // Moves each primitive's cooked bounds into model space through its node's world
+    // matrix (the box around the transformed box) for the nodes whose matrix changed,
+    // then refits the BVH
+    void UpdateBounds(bool all) const {
+        for (auto& placed : nodePrimitives) {
+            const FlatNode& flat = flatNodes[placed.flat];
+            if (!all && !flat.dirty) {
+                continue;
+            }
+            const GPUPrimitive& gpu = gpuMeshes[flat.mesh][placed.primitive];
+            glm::vec3 center = (gpu.boundsMin + gpu.boundsMax) * 0.5f;
+            glm::vec3 extent = (gpu.boundsMax - gpu.boundsMin) * 0.5f;
+            for (int axis = 0; axis < 3; ++axis) {
+                float c = flat.world[3][axis];
+                float e = 0.0f;
+                for (int k = 0; k < 3; ++k) {
+                    c += flat.world[k][axis] * center[k];
+                    e += std::abs(flat.world[k][axis]) * extent[k];
+                }
+                placed.boundsMin[axis] = c - e;
+                placed.boundsMax[axis] = c + e;
             }
+        }
+        RefitBvh();
+    }
 
-            const auto& indexAccessor = model.accessors[primitive.indices];
-            const auto& indexView = model.bufferViews[indexAccessor.bufferView];
-            const void* indices = &model.buffers[indexView.buffer].data[indexView.byteOffset +
-                indexAccessor.byteOffset];
-
-            glBegin(GL_TRIANGLES);
-            for (size_t i = 0; i < indexAccessor.count; i++) {
-                unsigned int idx;
-                switch (indexAccessor.componentType) {
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                    idx = ((unsigned short*)indices)[i];
-                    break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                    idx = ((unsigned int*)indices)[i];
-                    break;
-                default:
+    // Top-down median split of the primitives' centres along the longest axis. Run once
+    // at load; moving nodes later only refits the boxes, which keeps the static scenery
+    // the hierarchy is for tight and costs the few animated nodes a looser box
+    void BuildBvh() {
+        bvh.clear();
+        bvhItems.resize(nodePrimitives.size());
+        for (size_t i = 0; i < bvhItems.size(); ++i) {
+            bvhItems[i] = static_cast<int>(i);
+        }
+        if (bvhItems.empty()) {
+            return;
+        }
+        bvh.push_back(BvhNode());
+        BuildBvhNode(0, 0, static_cast<int>(bvhItems.size()));
+        RefitBvh();
+    }
+
+    void BuildBvhNode(int index, int first, int count) {
+        bvh[index].left = -1;
+        bvh[index].first = first;
+        bvh[index].count = count;
+        if (count <= BVH_LEAF_SIZE) {
+            return;
+        }
+
+        float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (int i = first; i < first + count; ++i) {
+            const NodePrimitive& placed = nodePrimitives[bvhItems[i]];
+            for (int axis = 0; axis < 3; ++axis) {
+                float center = (placed.boundsMin[axis] + placed.boundsMax[axis]) * 0.5f;
+                lower[axis] = std::min(lower[axis], center);
+                upper[axis] = std::max(upper[axis], center);
+            }
+        }
+        int axis = 0;
+        for (int c = 1; c < 3; ++c) {
+            if (upper[c] - lower[c] > upper[axis] - lower[axis]) {
+                axis = c;
+            }
+        }
+
+        int half = count / 2;
+        std::nth_element(bvhItems.begin() + first, bvhItems.begin() + first + half, bvhItems.begin() + first + count,
+            [this, axis](int a, int b) {
+                return nodePrimitives[a].boundsMin[axis] + nodePrimitives[a].boundsMax[axis]
+                    < nodePrimitives[b].boundsMin[axis] + nodePrimitives[b].boundsMax[axis];
+            });
+
+        int left = static_cast<int>(bvh.size());
+        bvh.resize(bvh.size() + 2);
+        bvh[index].left = left;
+        BuildBvhNode(left, first, half);
+        BuildBvhNode(left + 1, first + half, count - half);
+    }
+
+    void RefitBvh() const {
+        for (int i = static_cast<int>(bvh.size()) - 1; i >= 0; --i) {
+            BvhNode& node = bvh[i];
+            node.boundsMin = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+            node.boundsMax = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+            for (int k = 0; k < (node.left >= 0 ? 2 : node.count); ++k) {
+                const glm::vec3& childMin = node.left >= 0 ? bvh[node.left + k].boundsMin : nodePrimitives[bvhItems[node.first + k]].boundsMin;
+                const glm::vec3& childMax = node.left >= 0 ? bvh[node.left + k].boundsMax : nodePrimitives[bvhItems[node.first + k]].boundsMax;
+                for (int axis = 0; axis < 3; ++axis) {
+                    node.boundsMin[axis] = std::min(node.boundsMin[axis], childMin[axis]);
+                    node.boundsMax[axis] = std::max(node.boundsMax[axis], childMax[axis]);
+                }
+            }
+        }
+    }
+
+    // Fills visibleItems with the primitives whose boxes touch the frustum of clip (model
+    // space to clip space), in nodePrimitives order. Subtrees entirely inside it are taken
+    // without testing their children, and subtrees entirely outside cost a single test.
+    // With occlusion culling on, the items the previous pass found hidden are dropped too
+    void CollectVisible(const glm::mat4& clip) const {
+        Frustum frustum = Frustum::FromMatrix(clip);
+        visibleItems.clear();
+        if (!frustumCulling) {
+            for (size_t i = 0; i < nodePrimitives.size(); ++i) {
+                visibleItems.push_back(static_cast<int>(i));
+            }
+            renderQueue.CountCulling(static_cast<int>(visibleItems.size()), 0);
+            return;
+        }
+
+        // Node index and whether an ancestor already lies entirely inside the frustum
+        std::vector<std::pair<int, bool>> stack;
+        if (!bvh.empty()) {
+            stack.push_back({ 0, false });
+        }
+        while (!stack.empty()) {
+            int index = stack.back().first;
+            bool inside = stack.back().second;
+            stack.pop_back();
+
+            const BvhNode& node = bvh[index];
+            if (!inside) {
+                Frustum::Containment containment = frustum.ClassifyBox(node.boundsMin, node.boundsMax);
+                if (containment == Frustum::OUTSIDE) {
                     continue;
                 }
+                inside = containment == Frustum::INSIDE;
+            }
+            if (node.left >= 0) {
+                stack.push_back({ node.left + 1, inside });
+                stack.push_back({ node.left, inside });
+            }
+            else {
+                visibleItems.insert(visibleItems.end(), bvhItems.begin() + node.first, bvhItems.begin() + node.first + node.count);
+            }
+        }
+
+        // Back to node order, so each node's matrix is set up once
+        std::sort(visibleItems.begin(), visibleItems.end());
+        int culled = static_cast<int>(nodePrimitives.size() - visibleItems.size());
+        int occluded = 0;
+        if (occlusionEnabled && occlusionCulling && !occluders.empty()) {
+            occluded = ApplyOcclusion(clip);
+        }
+        renderQueue.CountCulling(static_cast<int>(visibleItems.size()), culled, occluded);
+    }
+
+    // Picks the primitives with the largest model-space boxes as occluders and keeps a
+    // CPU copy of their coarsest LOD. The simplified meshes are not strictly inside the
+    // originals, which can hide a sliver of geometry right behind an occluder's edge
+    void LoadOccluders(const CookedAsset& cooked) {
+        occluders.clear();
+        if (nodePrimitives.size() < OCCLUSION_MIN_PRIMITIVES) {
+            return;
+        }
+
+        std::vector<int> bySize(nodePrimitives.size());
+        std::vector<float> size(nodePrimitives.size());
+        for (size_t i = 0; i < nodePrimitives.size(); ++i) {
+            bySize[i] = static_cast<int>(i);
+            size[i] = glm::length(nodePrimitives[i].boundsMax - nodePrimitives[i].boundsMin);
+        }
+        std::sort(bySize.begin(), bySize.end(), [&size](int a, int b) { return size[a] > size[b]; });
+
+        std::map<std::pair<int, int>, std::shared_ptr<const OccluderMesh>> meshes;
+        size_t triangles = 0;
+        for (int item : bySize) {
+            const NodePrimitive& placed = nodePrimitives[item];
+            int mesh = flatNodes[placed.flat].mesh;
+            const CookedPrimitive& primitive = cooked.Primitives()[cooked.Meshes()[mesh].firstPrimitive + placed.primitive];
+            if (primitive.mode != GL_TRIANGLES || primitive.indexType == 0) {
+                continue;
+            }
+
+            std::shared_ptr<const OccluderMesh>& occluderMesh = meshes[{ mesh, placed.primitive }];
+            if (!occluderMesh) {
+                occluderMesh = BuildOccluderMesh(cooked, primitive);
+            }
+            if (triangles + occluderMesh->indices.size() / 3 > OCCLUDER_TRIANGLE_BUDGET) {
+                break;
+            }
+            triangles += occluderMesh->indices.size() / 3;
+            occluders.push_back({ item, occluderMesh });
+        }
+        std::cout << "Occlusion culling: " << occluders.size() << " occluders, " << triangles << " triangles" << std::endl;
+    }
+
+    static std::shared_ptr<const OccluderMesh> BuildOccluderMesh(const CookedAsset& cooked, const CookedPrimitive& primitive) {
+        auto mesh = std::make_shared<OccluderMesh>();
+        const CookedVertex* vertices = reinterpret_cast<const CookedVertex*>(cooked.Data(primitive.vertexOffset));
+        for (uint32_t v = 0; v < primitive.vertexCount; ++v) {
+            mesh->positions.insert(mesh->positions.end(), vertices[v].position, vertices[v].position + 3);
+        }
+
+        uint64_t indexOffset = primitive.indexOffset;
+        uint32_t indexCount = primitive.indexCount;
+        if (primitive.lodCount > 0) {
+            const CookedLod& coarsest = cooked.Lods()[primitive.firstLod + primitive.lodCount - 1];
+            indexOffset = coarsest.indexOffset;
+            indexCount = coarsest.indexCount;
+        }
+        if (primitive.indexType == GL_UNSIGNED_SHORT) {
+            const uint16_t* indices = reinterpret_cast<const uint16_t*>(cooked.Data(indexOffset));
+            mesh->indices.assign(indices, indices + indexCount);
+        }
+        else {
+            const uint32_t* indices = reinterpret_cast<const uint32_t*>(cooked.Data(indexOffset));
+            mesh->indices.assign(indices, indices + indexCount);
+        }
+        return mesh;
+    }
+
+    // Drops the visible items the previous frame's pass found hidden, then starts this
+    // frame's pass on occlusionPool, where it runs while the frame is drawn. Items
+    // outside the previous frustum have no result and stay visible, and everything in
+    // this frustum is retested, so a hidden item reappears one frame after it is uncovered.
+    // Returns the number of items dropped
+    int ApplyOcclusion(const glm::mat4& clip) const {
+        auto pass = std::make_shared<OcclusionPass>();
+        pass->clip = clip;
+        pass->itemCount = nodePrimitives.size();
+        pass->items = visibleItems;
+        for (int item : visibleItems) {
+            pass->bounds.push_back(nodePrimitives[item].boundsMin);
+            pass->bounds.push_back(nodePrimitives[item].boundsMax);
+        }
+
+        // Occluders in the frustum, nearest first by the clip-space w of their box centres
+        std::vector<std::pair<float, size_t>> nearest;
+        for (size_t i = 0; i < occluders.size(); ++i) {
+            const NodePrimitive& placed = nodePrimitives[occluders[i].item];
+            if (std::binary_search(visibleItems.begin(), visibleItems.end(), occluders[i].item)) {
+                glm::vec3 center = (placed.boundsMin + placed.boundsMax) * 0.5f;
+                nearest.push_back({ (clip * glm::vec4(center, 1.0f)).w, i });
+            }
+        }
+        std::sort(nearest.begin(), nearest.end());
+        for (const auto& entry : nearest) {
+            const Occluder& occluder = occluders[entry.second];
+            pass->occluderClips.push_back(clip * flatNodes[nodePrimitives[occluder.item].flat].world);
+            pass->occluderMeshes.push_back(occluder.mesh);
+        }
 
-                if (texcoords) {
-                    glTexCoord2f(texcoords[idx * 2], texcoords[idx * 2 + 1]);
+        FinishOcclusionPass();
+        int hidden = 0;
+        if (occludedItems.size() == nodePrimitives.size()) {
+            size_t write = 0;
+            for (int item : visibleItems) {
+                if (!occludedItems[item]) {
+                    visibleItems[write++] = item;
                 }
-                glVertex3fv(&positions[idx * 3]);
             }
-            glEnd();
+            hidden = static_cast<int>(visibleItems.size() - write);
+            visibleItems.resize(write);
         }
 
-        glPopMatrix();
+        if (!occlusionBuffer) {
+            occlusionBuffer = std::make_shared<OcclusionBuffer>();
+        }
+        std::shared_ptr<OcclusionBuffer> buffer = occlusionBuffer;
+        occlusionJob = occlusionPool.Submit([buffer, pass]() { return RunOcclusionPass(*buffer, *pass); });
+        return hidden;
+    }
+
+    // Waits for the pass in flight, if any, and keeps its results
+    void FinishOcclusionPass() const {
+        if (occlusionJob.valid()) {
+            occludedItems = occlusionJob.get();
+        }
+    }
+
+    // Runs on occlusionPool: rasterizes the occluders, then tests every item's box
+    static std::vector<uint8_t> RunOcclusionPass(OcclusionBuffer& buffer, const OcclusionPass& pass) {
+        buffer.Clear();
+        for (size_t i = 0; i < pass.occluderMeshes.size(); ++i) {
+            const OccluderMesh& mesh = *pass.occluderMeshes[i];
+            buffer.RasterizeTriangles(glm::value_ptr(pass.occluderClips[i]), mesh.positions.data(), mesh.positions.size() / 3,
+                3 * sizeof(float), mesh.indices.data(), mesh.indices.size());
+        }
+        buffer.Finish();
+
+        std::vector<uint8_t> hidden(pass.itemCount, 0);
+        for (size_t i = 0; i < pass.items.size(); ++i) {
+            if (!buffer.IsBoxVisible(glm::value_ptr(pass.clip), &pass.bounds[i * 2].x, &pass.bounds[i * 2 + 1].x)) {
+                hidden[pass.items[i]] = 1;
+            }
+        }
+        return hidden;
     }
 
-    void SetMaterial(const tinygltf::Material& material) const {
+    // Single linear pass: parents precede children, so dirtiness propagates downwards as we go
+    void UpdateTransforms() const {
+        if (!transformsDirty) {
+            return;
+        }
+
+        for (auto& flat : flatNodes) {
+            if (flat.parent >= 0 && flatNodes[flat.parent].dirty) {
+                flat.dirty = true;
+            }
+            if (flat.dirty) {
+                flat.world = flat.parent >= 0 ? flatNodes[flat.parent].world * flat.local : flat.local;
+            }
+        }
+        UpdateBounds(false);
+        for (auto& flat : flatNodes) {
+            flat.dirty = false;
+        }
+        transformsDirty = false;
+    }
+
+    void DrawPrimitiveInstanced(int meshIndex, int primitiveIndex, int lod, GLsizei instanceCount) const {
+        const GPUPrimitive& gpu = gpuMeshes[meshIndex][primitiveIndex];
+
+        if (gpu.vao) {
+            glBindVertexArray(gpu.vao);
+        }
+        else {
+            BindVertexLayout(gpu);
+        }
+        BindInstanceMatrices(instanceBuffer);
+
+        if (gpu.indexBuffer) {
+            const GPUPrimitive::Lod& level = gpu.lods[lod];
+            DrawElementsInstanced(gpu.mode, level.indexCount, gpu.indexType, level.indexOffset, instanceCount);
+        }
+        else {
+            DrawArraysInstanced(gpu.mode, gpu.vertexCount, instanceCount);
+        }
+        renderQueue.CountTriangles(lod, TriangleCount(gpu, lod) * instanceCount);
+
+        UnbindInstanceMatrices();
+        if (gpu.vao) {
+            glBindVertexArray(0);
+        }
+        else {
+            UnbindVertexLayout(gpu);
+        }
+    }
+
+    // Draws visibleItems with one matrix push per node, through the scene shaders when they
+    // are on; modelView maps model space to eye space, for LOD selection
+    void DrawVisible(const glm::mat4& modelView) const {
+        bool shaded = ShadingEnabled() && ShadingAvailable();
+        if (shaded) {
+            BeginShading();
+        }
+        int currentFlat = -1;
+        glm::mat4 eyeTransform;
+        for (int item : visibleItems) {
+            const NodePrimitive& placed = nodePrimitives[item];
+            const FlatNode& flat = flatNodes[placed.flat];
+            if (placed.flat != currentFlat) {
+                if (currentFlat >= 0) {
+                    glPopMatrix();
+                }
+                glPushMatrix();
+                glMultMatrixf(glm::value_ptr(flat.world));
+                eyeTransform = modelView * flat.world;
+                currentFlat = placed.flat;
+            }
+
+            int lod = SelectLod(item, eyeTransform);
+            bool textured = SetMaterial(gpuMeshes[flat.mesh][placed.primitive].material);
+            if (shaded) {
+                SetShadingTextured(textured);
+            }
+            DrawPrimitive(flat.mesh, placed.primitive, lod);
+        }
+        if (currentFlat >= 0) {
+            glPopMatrix();
+        }
+        if (shaded) {
+            EndShading();
+        }
+
+        // Leave the state the immediate-mode code expects, as RenderQueue::Flush does
+        glEnable(GL_TEXTURE_2D);
         glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+    }
+
+    static int TriangleCount(const GPUPrimitive& gpu, int lod) {
+        GLsizei count = gpu.indexBuffer ? gpu.lods[lod].indexCount : gpu.vertexCount;
+        return gpu.mode == GL_TRIANGLES ? count / 3 : 0;
+    }
 
-        if (material.pbrMetallicRoughness.baseColorTexture.index >= 0) {
-            const auto& texture = model.textures[material.pbrMetallicRoughness.baseColorTexture.index];
-            if (texture.source >= 0) {
-                GLuint textureId = GetOrCreateTexture(texture.source);
-                if (textureId != 0) {
-                    glEnable(GL_TEXTURE_2D);
-                    glBindTexture(GL_TEXTURE_2D, textureId);
+    // How many pixels one object-space unit of the primitive covers at its nearest
+    // point to the camera; objects the camera is inside of get an effectively infinite value
+    static float ProjectedPixelsPerUnit(const GPUPrimitive& gpu, const glm::mat4& eyeTransform) {
+        glm::vec3 center = (gpu.boundsMin + gpu.boundsMax) * 0.5f;
+        float scale = std::max(glm::length(glm::vec3(eyeTransform[0])),
+            std::max(glm::length(glm::vec3(eyeTransform[1])), glm::length(glm::vec3(eyeTransform[2]))));
+        float radius = glm::length(gpu.boundsMax - gpu.boundsMin) * 0.5f * scale;
+        float distance = glm::length(glm::vec3(eyeTransform * glm::vec4(center, 1.0f))) - radius;
+        return lodSettings.projectionScale * scale / std::max(distance, 0.01f);
+    }
+
+    int SelectLod(int item, const glm::mat4& eyeTransform) const {
+        const NodePrimitive& placed = nodePrimitives[item];
+        const GPUPrimitive& gpu = gpuMeshes[flatNodes[placed.flat].mesh][placed.primitive];
+        if (gpu.lods.size() <= 1) {
+            return 0;
+        }
+        return UpdateLod(item, ProjectedPixelsPerUnit(gpu, eyeTransform));
+    }
+
+    // Picks the LOD state UpdateLod uses for this draw. Draws of a shared asset (the four
+    // wheels) come in the same order every frame, so the nth draw keeps the nth state
+    void BeginLodDraw() const {
+        if (lodStateFrame != lodSettings.frame) {
+            lodStateFrame = lodSettings.frame;
+            lodDraw = 0;
+        }
+        else {
+            lodDraw++;
+        }
+        lodStateBase = lodDraw * nodePrimitives.size();
+        if (lodStates.size() < lodStateBase + nodePrimitives.size()) {
+            lodStates.resize(lodStateBase + nodePrimitives.size(), 0);
+        }
+    }
+
+    // Refines as soon as the current level's error shows on screen, but only coarsens
+    // once the coarser level is well under budget, so a primitive sitting at a
+    // threshold distance does not flicker between two levels
+    int UpdateLod(int item, float pixelsPerUnit) const {
+        const NodePrimitive& placed = nodePrimitives[item];
+        const GPUPrimitive& gpu = gpuMeshes[flatNodes[placed.flat].mesh][placed.primitive];
+        uint8_t& current = lodStates[lodStateBase + item];
+        if (!lodSettings.enabled || lodSettings.projectionScale <= 0.0f || gpu.lods.size() <= 1) {
+            current = 0;
+            return 0;
+        }
+
+        int ideal = 0;
+        for (int level = static_cast<int>(gpu.lods.size()) - 1; level > 0; --level) {
+            if (gpu.lods[level].error * pixelsPerUnit <= lodSettings.pixelError) {
+                ideal = level;
+                break;
+            }
+        }
+
+        if (ideal > current) {
+            for (int level = ideal; level > current; --level) {
+                if (gpu.lods[level].error * pixelsPerUnit <= lodSettings.pixelError * lodSettings.hysteresis) {
+                    current = static_cast<uint8_t>(level);
+                    break;
                 }
             }
         }
-        else if (!material.pbrMetallicRoughness.baseColorFactor.empty()) {
-            glColor4f(
-                material.pbrMetallicRoughness.baseColorFactor[0],
-                material.pbrMetallicRoughness.baseColorFactor[1],
-                material.pbrMetallicRoughness.baseColorFactor[2],
-                material.pbrMetallicRoughness.baseColorFactor[3]
-            );
+        else {
+            current = static_cast<uint8_t>(ideal);
+        }
+        return current;
+    }
+
+    // Queues every visible primitive with the current modelview baked in, for RenderQueue to sort and draw
+    void SubmitModel(const glm::mat4& transform) const {
+        glm::mat4 modelView;
+        glGetFloatv(GL_MODELVIEW_MATRIX, glm::value_ptr(modelView));
+        modelView = modelView * transform;
+        CollectVisible(CurrentClipMatrix(modelView));
+
+        RenderQueue::RenderItem item;
+        item.model = this;
+        int currentFlat = -1;
+        for (int index : visibleItems) {
+            const NodePrimitive& placed = nodePrimitives[index];
+            const FlatNode& flat = flatNodes[placed.flat];
+            if (placed.flat != currentFlat) {
+                item.mesh = flat.mesh;
+                item.transform = modelView * flat.world;
+                currentFlat = placed.flat;
+            }
+
+            const GPUPrimitive& gpu = gpuMeshes[flat.mesh][placed.primitive];
+            ResolveMaterial(gpu.material, item.texture, item.color);
+            item.primitive = placed.primitive;
+            item.lod = SelectLod(index, item.transform);
+            item.sortKey = RenderQueue::MakeSortKey(item.texture, item.color, gpu.vertexBuffer);
+            renderQueue.Submit(item);
         }
     }
 
-    GLuint GetOrCreateTexture(int sourceIndex) const {
-        if (textureCache.find(sourceIndex) != textureCache.end()) {
-            return textureCache.at(sourceIndex);
+    // A material as plain state: textured materials draw white with their texture,
+    // untextured ones (and those whose texture failed to load) use their base colour factor
+    // without texturing. SetMaterial and RenderQueue::Flush both apply this
+    void ResolveMaterial(int materialIndex, GLuint& texture, glm::vec4& color) const {
+        texture = 0;
+        color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+        if (materialIndex < 0) {
+            return;
         }
 
-        const auto& image = model.images[sourceIndex];
-        GLuint textureId;
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
+        const Material& material = materials[materialIndex];
+        if (material.textured) {
+            texture = material.texture;
+        }
+        else {
+            color = material.baseColor;
+        }
+    }
 
-        GLenum format = GL_RGBA;
-        if (image.component == 3) {
-            format = GL_RGB;
+    // Applies ResolveMaterial's state; returns whether the primitive is drawn textured
+    bool SetMaterial(int materialIndex) const {
+        GLuint texture;
+        glm::vec4 color;
+        ResolveMaterial(materialIndex, texture, color);
+        if (texture != 0) {
+            glEnable(GL_TEXTURE_2D);
+            glBindTexture(GL_TEXTURE_2D, texture);
+        }
+        else {
+            glDisable(GL_TEXTURE_2D);
+        }
+        glColor4fv(glm::value_ptr(color));
+        return texture != 0;
+    }
+};
+
+
+
+// Worker threads for file loading and image decoding; OpenGL stays on the GLUT thread
+ThreadPool loaderPool;
+
+// Hands out shared GLTFAsset instances keyed by canonical path,
+// so a file that is loaded several times (the four wheels, models reused across
+// levels) is parsed and uploaded once. Prefetch moves the parsing and decoding
+// onto loaderPool; AcquireModel then only waits for the result and uploads it
+class AssetRegistry {
+public:
+    std::shared_ptr<GLTFAsset> AcquireModel(const std::string& filename) {
+        std::string key = CanonicalKey(filename);
+
+        auto assetIt = assets.find(key);
+        if (assetIt != assets.end()) {
+            return assetIt->second;
         }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, &image.image[0]);
+        // A prefetched file only has its GL upload left to do
+        auto pendingIt = pending.find(key);
+        if (pendingIt != pending.end()) {
+            PendingLoad load = pendingIt->second.get();
+            pending.erase(pendingIt);
+            if (load.cooked) {
+                return Commit(key, *load.cooked);
+            }
+        }
 
-        GLenum type = GL_UNSIGNED_BYTE;
-        if (image.bits == 16) {
-            type = GL_UNSIGNED_SHORT;
+        CookedAsset cooked;
+        if (!LoadCookedAsset(filename, cooked)) {
+            return nullptr;
         }
+        return Commit(key, cooked);
+    }
 
-        GLint internalFormat = (format == GL_RGB) ? GL_RGB8 : GL_RGBA8;
+    // Starts loading files on the loader threads ahead of AcquireModel.
+    // Files that are already resident or in flight are skipped
+    void Prefetch(const std::vector<std::string>& filenames) {
+        for (const std::string& filename : filenames) {
+            std::string key = CanonicalKey(filename);
+            if (assets.count(key) || pending.count(key)) {
+                continue;
+            }
 
-        GLint buildMipmapsResult = gluBuild2DMipmaps(GL_TEXTURE_2D, internalFormat, image.width, image.height, format, type, image.image.data());
+            pending[key] = loaderPool.Submit([filename]() {
+                PendingLoad load;
+                load.cooked = std::make_unique<CookedAsset>();
+                if (!LoadCookedAsset(filename, *load.cooked, false)) {
+                    load.cooked.reset();
+                }
+                return load;
+            });
+        }
+    }
 
-        if (buildMipmapsResult != 0) {
-            std::cerr << "Failed to build mipmaps for texture. GLU error: " << gluErrorString(buildMipmapsResult) << std::endl;
-            glDeleteTextures(1, &textureId);
-            return 0;
+    // Uploads up to maxUploads prefetched files whose loading has finished, without
+    // waiting on the rest. Spreads a background prefetch over several frames so
+    // AcquireModel later finds the assets already resident. Returns the number uploaded
+    int UploadReady(int maxUploads) {
+        int uploaded = 0;
+        for (auto it = pending.begin(); it != pending.end() && uploaded < maxUploads;) {
+            if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                ++it;
+                continue;
+            }
+
+            PendingLoad load = it->second.get();
+            if (load.cooked) {
+                Commit(it->first, *load.cooked);
+                uploaded++;
+            }
+            it = pending.erase(it);
+        }
+        return uploaded;
+    }
+
+    // True once no prefetch job is still running on the loader threads
+    bool PrefetchDone() const {
+        for (const auto& entry : pending) {
+            if (entry.second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Frees every asset no GLTFModel handle refers to anymore. Called once a level
+    // transition has acquired its new assets, so the ones both levels use survive it
+    void CollectUnused() {
+        int freed = 0;
+        for (auto it = assets.begin(); it != assets.end();) {
+            if (it->second.use_count() == 1) {
+                it->second->UnloadModel();
+                it = assets.erase(it);
+                freed++;
+            }
+            else {
+                ++it;
+            }
+        }
+        std::cout << "Asset registry: freed " << freed << " models, " << assets.size() << " still resident" << std::endl;
+    }
+
+private:
+    // Result of a prefetch job; cooked is null when the file has to be loaded on the GL thread
+    struct PendingLoad {
+        std::unique_ptr<CookedAsset> cooked;
+    };
+
+    std::unordered_map<std::string, std::shared_ptr<GLTFAsset>> assets; // The registry's own reference, by CanonicalKey
+    std::unordered_map<std::string, std::future<PendingLoad>> pending;
+
+    std::shared_ptr<GLTFAsset> Commit(const std::string& key, const CookedAsset& cooked) {
+        // Already resident, e.g. uploaded by an earlier Commit for the same key
+        auto assetIt = assets.find(key);
+        if (assetIt != assets.end()) {
+            return assetIt->second;
+        }
+
+        std::shared_ptr<GLTFAsset> asset = std::make_shared<GLTFAsset>();
+        asset->Upload(cooked);
+        if (asset->VertexBytes() < asset->FloatVertexBytes()) {
+            std::cout << "Quantized vertices of " << key << ": " << asset->FloatVertexBytes() / 1024 << " KB -> "
+                << asset->VertexBytes() / 1024 << " KB" << std::endl;
         }
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        assets[key] = asset;
+        return asset;
+    }
 
-        textureCache[sourceIndex] = textureId;
-        return textureId;
+    static std::string CanonicalKey(const std::string& filename) {
+        std::error_code error;
+        std::string key = std::filesystem::weakly_canonical(filename, error).generic_string();
+        if (error) {
+            key = filename;
+        }
+#ifdef _WIN32
+        // Paths are case-insensitive here ("Models/" and "models/" are the same file)
+        std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+#endif
+        return key;
     }
 };
 
+AssetRegistry assetRegistry;
+
+// Handle to a shared GLTFAsset. Loading the same file through several handles
+// reuses one parsed model and one set of GL buffers and textures
+class GLTFModel {
+public:
+    bool LoadModel(const std::string& filename) {
+        asset = assetRegistry.AcquireModel(filename);
+        return asset != nullptr;
+    }
+
+    void DrawModel(const glm::mat4& transform = glm::mat4(1.0f)) const {
+        if (asset) {
+            asset->DrawModel(transform);
+        }
+    }
+
+    // One draw call per primitive for all the transforms (see GLTFAsset::DrawInstanced)
+    void DrawInstanced(const std::vector<glm::mat4>& transforms) const {
+        if (asset) {
+            asset->DrawInstanced(transforms);
+        }
+    }
+
+    // See GLTFAsset::SetOcclusionCulling; applies to every handle sharing the asset
+    void SetOcclusionCulling(bool enabled) {
+        if (asset) {
+            asset->SetOcclusionCulling(enabled);
+        }
+    }
+
+    // Drops this handle's reference; the asset itself goes away in AssetRegistry::CollectUnused
+    void UnloadModel() {
+        asset.reset();
+    }
+
+    const GLTFAsset* GetAsset() const {
+        return asset.get();
+    }
+
+    GLTFAsset* GetAsset() {
+        return asset.get();
+    }
 
+private:
+    std::shared_ptr<GLTFAsset> asset;
+};
+
+void RenderQueue::Flush() {
+    if (items.empty()) {
+        return;
+    }
+
+    int binds = 0;
+    int changes = 0;
+    CountStateChanges(items, binds, changes);
+    frameStats.textureBindsUnsorted += binds;
+    frameStats.materialChangesUnsorted += changes;
+
+    std::sort(items.begin(), items.end(), [](const RenderItem& a, const RenderItem& b) {
+        return a.sortKey < b.sortKey;
+    });
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+
+    // Lights cannot change within a flush, so they are uploaded once for all of its draws
+    bool shaded = ShadingEnabled() && ShadingAvailable();
+    if (shaded) {
+        BeginShading();
+    }
+
+    const RenderItem* previous = nullptr;
+    for (const auto& item : items) {
+        bool textureChanged = !previous || previous->texture != item.texture;
+        if (textureChanged) {
+            if (item.texture != 0) {
+                glEnable(GL_TEXTURE_2D);
+                glBindTexture(GL_TEXTURE_2D, item.texture);
+            }
+            else {
+                glDisable(GL_TEXTURE_2D);
+            }
+            if (shaded) {
+                SetShadingTextured(item.texture != 0);
+            }
+            frameStats.textureBinds++;
+        }
+        if (textureChanged || previous->color != item.color) {
+            glColor4fv(glm::value_ptr(item.color));
+            frameStats.materialChanges++;
+        }
+
+        glLoadMatrixf(glm::value_ptr(item.transform));
+        item.model->DrawPrimitive(item.mesh, item.primitive, item.lod);
+        previous = &item;
+    }
+
+    if (shaded) {
+        EndShading();
+    }
+    glPopMatrix();
+
+    // Leave the state the immediate-mode code expects
+    glEnable(GL_TEXTURE_2D);
+    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+
+    frameStats.items += static_cast<int>(items.size());
+    items.clear();
+}
 
 struct Triangle {
     glm::vec3 v1, v2, v3; // Triangle vertices
@@ -287,6 +1665,7 @@ GLTFModel egpModel;
 GLTFModel rockModel;
 GLTFModel logModel;
 GLTFModel roadBlockModel;
+GLTFModel treeModel;
 
 
 
@@ -320,7 +1699,7 @@ private:
 
 public:
     SunriseEffect(float duration = 300.0f)
-        : time(0.0f), duration(duration), sunBrightness(0.0f) {
+        : time(0.0f), duration(duration), sunBrightness(0.0f), started(false) {
         sunPosition[0] = -1.0f; // Start from the left
         sunPosition[1] = -0.5f; // Start below the horizon
         sunPosition[2] = 1.0f;  // Sun is initially at a distant point on the z-axis
@@ -358,7 +1737,7 @@ public:
         sunBrightness = lerp(0.0f, 1.0f, t);
     }
 
-    void apply() {
+    void apply() const {
         float t = smoothStep(time / duration);
         t = smoothStep(t);
 
@@ -450,7 +1829,7 @@ public:
         sunBrightness = lerp(0.0f, 1.0f, t);
     }
 
-    void apply() {
+    void apply() const {
         float t = smoothStep(time / duration);
 
         // Sky color transition (sunrise colors)
@@ -692,7 +2071,6 @@ int cameraZoom = 0;
 
 // Model Variables
 Model_3DS model_house;
-Model_3DS model_tree;
 Model_3DS model_bugatti;
 //Model_GLB model_moscow;
 
@@ -779,6 +2157,7 @@ GLfloat headlight_dir[] = { 0.0f, 0.0f, -1.0f };        // Direction of headligh
 bool gameOver = false;
 Vector lastCarPosition(0, 0, 0);
 bool gameWon = false;
+boolean secondLevelLoading; // N was pressed; the level switch waits for the level 2 prefetch
 float gameTimer = 90.0f; // 90 seconds timer
 float playerTime = 0.0f;
 bool timerStarted = false;
@@ -946,6 +2325,8 @@ float headlightColor = 0.0f;
 
 // Function to set up the headlights
 void setupLighting() {
+    // Queued draws are lit with the state at the time they were submitted
+    renderQueue.Flush();
     glEnable(GL_LIGHTING);
 
     // Headlight 1 (Right)
@@ -1017,27 +2398,53 @@ float getRandomBrightness() {
 }
 
 
-void renderStreetlights() {
+// Lights 0-2 are the sun and the headlights, so fixed-function lighting has room for this many lamps
+const size_t FIXED_FUNCTION_STREETLIGHTS = 5;
+
+// Every lamp is a point light for the scene shaders. Without them only the lamps
+// nearest the car fit into GL_LIGHT3-GL_LIGHT7
+void renderStreetlights(const Vector& car) {
+    // What was queued before this point was drawn without this frame's lamps
+    renderQueue.Flush();
     glEnable(GL_COLOR_MATERIAL);
 
+    // Reused every frame; the peak is getRandomBrightness's maximum, so flicker keeps each lamp's range
+    static std::vector<PointLight> lamps;
+    lamps.resize(streetlightCoords.size());
     for (size_t i = 0; i < streetlightCoords.size(); ++i) {
         float brightness = getRandomBrightness(); // Generate random brightness for flicker
+        lamps[i] = { { streetlightCoords[i].first, 1.0f, streetlightCoords[i].second },
+            { brightness, brightness, 0.0f }, { 0.8f, 0.2f, 0.1f }, 1.0f }; // Yellow light, attenuated to limit its spread
+    }
+    addStressStreetlights(lamps);
 
-        // Set light properties
-        GLfloat lightColor[] = { brightness, brightness, 0.0f, 1.0f }; // Yellow light
-        GLfloat lightPos[] = { streetlightCoords[i].first, 1.0f, streetlightCoords[i].second, 1.0f }; // Position
-		GLfloat lightDir[] = { 0.0f, -1.0f, 0.0f }; // Direction
-
-        // Set attenuation (to limit light spread)
+    if (ShadingEnabled() && ShadingAvailable()) {
+        SetPointLights(lamps.data(), static_cast<int>(lamps.size()));
+        for (size_t i = 0; i < FIXED_FUNCTION_STREETLIGHTS; ++i) {
+            glDisable(GL_LIGHT3 + i);
+        }
+        return;
+    }
+    SetPointLights(nullptr, 0);
+
+    std::sort(lamps.begin(), lamps.end(), [&car](const PointLight& a, const PointLight& b) {
+        float da = (a.position[0] - car.x) * (a.position[0] - car.x) + (a.position[2] - car.z) * (a.position[2] - car.z);
+        float db = (b.position[0] - car.x) * (b.position[0] - car.x) + (b.position[2] - car.z) * (b.position[2] - car.z);
+        return da < db;
+    });
+    for (size_t i = 0; i < FIXED_FUNCTION_STREETLIGHTS; ++i) {
+        if (i >= lamps.size()) {
+            glDisable(GL_LIGHT3 + i);
+            continue;
+        }
+        GLfloat lightColor[] = { lamps[i].color[0], lamps[i].color[1], lamps[i].color[2], 1.0f };
+        GLfloat lightPos[] = { lamps[i].position[0], lamps[i].position[1], lamps[i].position[2], 1.0f };
         glEnable(GL_LIGHT3 + i);
         glLightfv(GL_LIGHT3 + i, GL_DIFFUSE, lightColor);
         glLightfv(GL_LIGHT3 + i, GL_POSITION, lightPos);
-        glLightf(GL_LIGHT3 + i, GL_CONSTANT_ATTENUATION, 0.8f);
-        glLightf(GL_LIGHT3 + i, GL_LINEAR_ATTENUATION, 0.2f);
-        glLightf(GL_LIGHT3 + i, GL_QUADRATIC_ATTENUATION, 0.1f);
-		//glLightf(GL_LIGHT0 + i, GL_SPOT_CUTOFF, 30.0f);            // Cone angle
-		//glLightf(GL_LIGHT0 + i, GL_SPOT_EXPONENT, 10.0f);          // Intensity falloff
-		glLightfv(GL_LIGHT3 + i, GL_SPOT_DIRECTION, lightDir); // Direction
+        glLightf(GL_LIGHT3 + i, GL_CONSTANT_ATTENUATION, lamps[i].attenuation[0]);
+        glLightf(GL_LIGHT3 + i, GL_LINEAR_ATTENUATION, lamps[i].attenuation[1]);
+        glLightf(GL_LIGHT3 + i, GL_QUADRATIC_ATTENUATION, lamps[i].attenuation[2]);
     }
 }
 
@@ -1057,42 +2464,43 @@ std::vector<Car> cars;
 int selectedCarIndex = -1;
 int hoverCarIndex = -1;
 
-GLuint loadTexture(const char* path) {
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (!data) {
-        std::cerr << "Failed to load texture: " << path << std::endl;
-        return 0;
-    }
-
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+// An image file loaded on any thread and uploaded on the GL thread. Goes through
+// the cooked blob (textures/*.png.cooked), which the first load writes
+struct DecodedImage {
+    std::string path;
+    std::unique_ptr<CookedAsset> cooked;
+};
 
-    GLenum format = GL_RGB;
-    if (nrChannels == 4) {
-        format = GL_RGBA;
+DecodedImage decodeImage(const char* path) {
+    DecodedImage image;
+    image.path = path;
+    image.cooked = std::make_unique<CookedAsset>();
+    if (!LoadCookedAsset(path, *image.cooked, false) || image.cooked->Header().imageCount == 0) {
+        image.cooked.reset();
     }
+    return image;
+}
 
-    // Old version for generating mipmaps
-    gluBuild2DMipmaps(GL_TEXTURE_2D, format, width, height, format, GL_UNSIGNED_BYTE, data);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_image_free(data);
-    return textureID;
+GLuint uploadTexture(const DecodedImage& image) {
+    if (!image.cooked) {
+        std::cerr << "Failed to load texture: " << image.path << std::endl;
+        return 0;
+    }
+    return UploadCookedImage(*image.cooked, 0, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR);
 }
 
 GLuint backgroundTexture; 
 
 
 void loadCars() {
-    backgroundTexture = loadTexture("textures/bg6.jpeg");
-    cars.push_back({ "Koenigsegg Agera", "SW", 1395, 1160, 1176, loadTexture("textures/koenigsegg2.png") });
-    cars.push_back({ "Bugatti Bolide", "DE", 1450, 1578, 1600, loadTexture("textures/bugatti2.png") });
+    // Decode the three images side by side, then upload them here in order
+    auto background = loaderPool.Submit([]() { return decodeImage("textures/bg6.jpeg"); });
+    auto koenigsegg = loaderPool.Submit([]() { return decodeImage("textures/koenigsegg2.png"); });
+    auto bugatti = loaderPool.Submit([]() { return decodeImage("textures/bugatti2.png"); });
+
+    backgroundTexture = uploadTexture(background.get());
+    cars.push_back({ "Koenigsegg Agera", "SW", 1395, 1160, 1176, uploadTexture(koenigsegg.get()) });
+    cars.push_back({ "Bugatti Bolide", "DE", 1450, 1578, 1600, uploadTexture(bugatti.get()) });
 
 }
 
@@ -1129,12 +2537,9 @@ void renderCarSelectScreen() {
     // Draw title
     glColor3f(1.0f, 1.0f, 1.0f);
     std::string title = "Select Your Car";
-    int titleWidth = glutBitmapLength(GLUT_BITMAP_HELVETICA_18, (const unsigned char*)title.c_str());
+    int titleWidth = TextWidth(TEXT_FONT_LARGE, title);
     int titleX = (WIDTH - titleWidth) / 2;
-    glRasterPos2i(titleX, 40);
-    for (char c : title) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-    }
+    QueueText(TEXT_FONT_LARGE, titleX, 40, title);
 
     // Draw car selection
     int carWidth = 300;
@@ -1186,30 +2591,21 @@ void renderCarSelectScreen() {
 
         // Draw car name
         glColor3f(1.0f, 1.0f, 1.0f);
-        int nameWidth = glutBitmapLength(GLUT_BITMAP_HELVETICA_18, (const unsigned char*)cars[i].name.c_str());
-        glRasterPos2i(x + (carWidth - nameWidth) / 2, y + carHeight + 20);
-        for (char c : cars[i].name) {
-            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-        }
+        int nameWidth = TextWidth(TEXT_FONT_LARGE, cars[i].name);
+        QueueText(TEXT_FONT_LARGE, x + (carWidth - nameWidth) / 2, y + carHeight + 20, cars[i].name);
 
         // Draw car stats
         std::string stats = cars[i].drivetrain + " | " + std::to_string(cars[i].weight) + "kg | " + std::to_string(cars[i].horsepower) + "hp | " + std::to_string(cars[i].performancePoints) + "PP";
-        int statsWidth = glutBitmapLength(GLUT_BITMAP_HELVETICA_18, (const unsigned char*)stats.c_str());
-        glRasterPos2i(x + (carWidth - statsWidth) / 2, y + carHeight + 40);
-        for (char c : stats) {
-            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-        }
+        int statsWidth = TextWidth(TEXT_FONT_LARGE, stats);
+        QueueText(TEXT_FONT_LARGE, x + (carWidth - statsWidth) / 2, y + carHeight + 40, stats);
 
         x += carWidth + carSpacing;
     }
 
     glColor3f(1.0f, 1.0f, 1.0f);
     std::string instructions = "Click on a car to select it. Press 'S' to start the game.";
-    int instructionsWidth = glutBitmapLength(GLUT_BITMAP_HELVETICA_18, (const unsigned char*)instructions.c_str());
-    glRasterPos2i((WIDTH - instructionsWidth) / 2, HEIGHT - 50);
-    for (char c : instructions) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-    }
+    int instructionsWidth = TextWidth(TEXT_FONT_LARGE, instructions);
+    QueueText(TEXT_FONT_LARGE, (WIDTH - instructionsWidth) / 2, HEIGHT - 50, instructions);
 
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
@@ -5396,6 +6792,90 @@ void updateCarPosition2(float deltaTime) {
 
 
 
+//=======================================================================
+// Fixed Step Simulation
+//=======================================================================
+// The game advances in fixed steps of SIM_STEP on its own thread, however fast
+// frames are drawn, so driving, collisions and timers play out the same on every
+// machine and a slow frame does not hold up the game. The game state globals belong
+// to the simulation thread: GLUT input callbacks lock simulationMutex before
+// touching them, and drawing reads only the GameSnapshot published after each
+// wake-up, drawing the car between its last two simulated poses.
+const double SIM_STEP = 1.0 / 120.0;
+const int SIM_MAX_STEPS = 12; // After a stall of more than 100 ms the game slows down instead
+
+struct CarPose {
+    Vector position;
+    float rotation;
+    float wheelRotation;
+};
+
+CarPose previousCarPose = { Vector(0, 0, 0), 0.0f, 0.0f };
+
+// Everything a frame draws that the simulation changes
+struct GameSnapshot {
+    CarPose previousPose;
+    CarPose pose;
+    std::chrono::steady_clock::time_point steppedAt; // When pose was simulated
+    float carSpeed = 0.0f;
+    CameraView view = CINEMATIC;
+    int cinematicPoint = 0;
+    float cinematicTimer = 0.0f;
+    bool gameOver = false;
+    bool gameWon = false;
+    bool carTooDamaged = false;
+    Vector lastCarPosition;
+    float gameTimer = 0.0f;
+    float playerTime = 0.0f;
+    int score = 0;
+    std::vector<Nitro> nitros;
+    std::vector<Coin> coins;
+
+    // Level 1 sunset
+    glm::vec3 skyColor;
+    glm::vec3 sunPosition;
+    glm::vec3 sunColor;
+    float sunVisibility = 0.0f;
+    GLfloat lightPosition[4];
+    GLfloat lightAmbient[4];
+    GLfloat lightDiffuse[4];
+
+    // Level 2 sunrise
+    SunriseEffect sunrise;
+    MovingSunEffect sunEffect;
+};
+
+std::mutex simulationMutex;
+TripleBuffer<GameSnapshot> snapshots;
+std::chrono::steady_clock::time_point lastStepAt = std::chrono::steady_clock::now();
+
+// How far the frame falls between the snapshot's two poses
+float snapshotAlpha(const GameSnapshot& snapshot) {
+    std::chrono::duration<float> since = std::chrono::steady_clock::now() - snapshot.steppedAt;
+    return std::min(std::max(since.count() / static_cast<float>(SIM_STEP), 0.0f), 1.0f);
+}
+
+CarPose currentCarPose() {
+    CarPose pose = { carPosition, carRotation, wheelRotationX };
+    return pose;
+}
+
+CarPose interpolateCarPose(const CarPose& from, const CarPose& to, float alpha) {
+    // The short way round when the heading wraps past 360
+    float turn = to.rotation - from.rotation;
+    if (turn > 180.0f) turn -= 360.0f;
+    if (turn < -180.0f) turn += 360.0f;
+    CarPose pose = {
+        Vector(from.position.x + (to.position.x - from.position.x) * alpha,
+            from.position.y + (to.position.y - from.position.y) * alpha,
+            from.position.z + (to.position.z - from.position.z) * alpha),
+        from.rotation + turn * alpha,
+        from.wheelRotation + (to.wheelRotation - from.wheelRotation) * alpha
+    };
+    return pose;
+}
+
+
 //=======================================================================
 // Lighting Configuration Function
 //=======================================================================
@@ -5409,23 +6889,27 @@ void InitLightSource() {
     glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
 }
 
-void updateNitroAnimation() {
+// Bobbing rates per second; the same motion the pickups had at 60 frames a second
+const float PICKUP_BOB_PHASE_RATE = 30.0f;
+const float PICKUP_BOB_HEIGHT_RATE = 4.8f;
+
+void updateNitroAnimation(float deltaTime) {
     for (auto& nitro : nitros) {
-        nitro.animationPhase += 0.5f;
+        nitro.animationPhase += PICKUP_BOB_PHASE_RATE * deltaTime;
         if (nitro.animationPhase > 360.0f) {
             nitro.animationPhase -= 360.0f;
         }
-        nitro.y = nitro.y + sin(nitro.animationPhase) * 0.08f;
+        nitro.y = nitro.y + sin(nitro.animationPhase) * PICKUP_BOB_HEIGHT_RATE * deltaTime;
     }
 }
 
-void updateCoinAnimation() {
+void updateCoinAnimation(float deltaTime) {
     for (auto& coin : coins) {
-        coin.animationPhase += 0.5f;
+        coin.animationPhase += PICKUP_BOB_PHASE_RATE * deltaTime;
         if (coin.animationPhase > 360.0f) {
             coin.animationPhase -= 360.0f;
         }
-        coin.y = coin.y + sin(coin.animationPhase) * 0.08f;
+        coin.y = coin.y + sin(coin.animationPhase) * PICKUP_BOB_HEIGHT_RATE * deltaTime;
     }
 }
 
@@ -5447,7 +6931,6 @@ void updateSunPosition(float deltaTime) {
         lightPosition[1] = sunPosition.y;
         lightPosition[2] = sunPosition.z;
         lightPosition[3] = 1.0f; // Ensure it's a positional light
-        glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
 
         // Update light color and intensity to simulate sunset
         float intensity = 1.0f - 0.7f * sunsetProgress; // Gradually reduce intensity
@@ -5458,12 +6941,10 @@ void updateSunPosition(float deltaTime) {
         lightDiffuse[0] = r * intensity;
         lightDiffuse[1] = g * intensity;
         lightDiffuse[2] = b * intensity;
-        glLightfv(GL_LIGHT0, GL_DIFFUSE, lightDiffuse);
 
         lightAmbient[0] = r * 0.3f * intensity;
         lightAmbient[1] = g * 0.3f * intensity;
         lightAmbient[2] = b * 0.3f * intensity;
-        glLightfv(GL_LIGHT0, GL_AMBIENT, lightAmbient);
 
         // Update sky color
         glm::vec3 midSkyColor;
@@ -5528,124 +7009,81 @@ int currentCinematicPoint = 0;
 float cinematicTimer = 0;
 const float CINEMATIC_DURATION = 7.0f;
 
-void updateCamera()
+// Moves the cinematic fly-through on, on the simulation thread
+void advanceCinematic(float deltaTime)
 {
+    if (currentView != CINEMATIC || selectingCar) {
+        return;
+    }
+    sunEffect.reset();
+    sunrise.reset();
 
-    if (currentView == CINEMATIC && !selectingCar) {
-        // Check if we're at the final point
-        sunEffect.reset();
-        sunrise.reset();
+    const std::vector<Vector>& points = level == 1 ? cinematicPoints : cinematicPoints2;
+    cinematicTimer += deltaTime;
+    if (currentCinematicPoint == points.size() - 1) {
+        // Move to the next point after the display duration
+        if (cinematicTimer >= FINAL_POINT_DURATION) {
+            cinematicTimer = 0;
+            currentCinematicPoint = 0; // Reset to the first point
+            currentView = THIRD_PERSON;
+        }
+    }
+    else if (cinematicTimer >= CINEMATIC_DURATION / points.size()) {
+        cinematicTimer = 0;
+        currentCinematicPoint = (currentCinematicPoint + 1) % points.size();
 
-        if (level == 1) {
-            if (currentCinematicPoint == cinematicPoints.size() - 1) {
-                float t = cinematicTimer / FINAL_POINT_DURATION;
-                Vector current = cinematicPoints[currentCinematicPoint];
-
-                // Move the camera backwards continuously from the current point
-                Eye.x = current.x;
-                Eye.y = current.y;
-                Eye.z = current.z - t * FINAL_POINT_RADIUS; // Continuously move away from the point
-                At = current;
-
-                // Update timer
-                cinematicTimer += 0.016; // Assuming 60 FPS
-
-                // Move to the next point after the display duration
-                if (cinematicTimer >= FINAL_POINT_DURATION) {
-                    cinematicTimer = 0;
-                    currentCinematicPoint = 0; // Reset to the first point
-                    currentView = THIRD_PERSON;
-                }
-            }
-            else {
-                // Cinematic camera movement for other points
-                float t = cinematicTimer / CINEMATIC_DURATION;
-                int nextPoint = (currentCinematicPoint + 1) % cinematicPoints.size();
-                Vector current = cinematicPoints[currentCinematicPoint];
-                Vector next = cinematicPoints[nextPoint];
-
-                // Interpolate between current and next point
-                Eye.x = current.x + (next.x - current.x) * t;
-                Eye.y = current.y + (next.y - current.y) * t;
-                Eye.z = current.z + (next.z - current.z) * t;
-
-                // Look at the next point
-                At = next;
-
-                // Update timer and current point
-                cinematicTimer += 0.016; // Assuming 60 FPS
-                if (cinematicTimer >= CINEMATIC_DURATION / cinematicPoints.size()) {
-                    cinematicTimer = 0;
-                    currentCinematicPoint = nextPoint;
-                }
+        // If cinematic is complete, switch to third person view
+        if (currentCinematicPoint == 0) {
+            if (level == 1)
+                stopCinemtic1Music();
+            else
+                stopCinemtic2Music();
+            playIdleEngine();
+            currentView = THIRD_PERSON;
+        }
+    }
+}
 
-                // If cinematic is complete, switch to third person view
-                if (currentCinematicPoint == 0 && cinematicTimer == 0) {
-					stopCinemtic1Music();
-                    playIdleEngine();
-                    currentView = THIRD_PERSON;
-                }
-            }
+// Places the camera for a frame drawn alpha of a step past the snapshot, with the car at pose
+void updateCamera(const GameSnapshot& state, const CarPose& pose, float alpha)
+{
+    const Vector& carPosition = pose.position;
+    float carRotation = pose.rotation;
+
+    if (state.view == CINEMATIC && !selectingCar) {
+        const std::vector<Vector>& points = level == 1 ? cinematicPoints : cinematicPoints2;
+        float cinematicTimer = state.cinematicTimer + alpha * static_cast<float>(SIM_STEP);
+        if (state.cinematicPoint == points.size() - 1) {
+            float t = std::min(cinematicTimer, FINAL_POINT_DURATION) / FINAL_POINT_DURATION;
+            Vector current = points[state.cinematicPoint];
+
+            // Move the camera backwards continuously from the current point
+            Eye.x = current.x;
+            Eye.y = current.y;
+            Eye.z = current.z - t * FINAL_POINT_RADIUS; // Continuously move away from the point
+            At = current;
         }
         else {
-            if (currentCinematicPoint == cinematicPoints2.size() - 1) {
-                sunEffect.reset();
-                sunrise.reset();
-                float t = cinematicTimer / FINAL_POINT_DURATION;
-                Vector current = cinematicPoints2[currentCinematicPoint];
-
-                // Move the camera backwards continuously from the current point
-                Eye.x = current.x;
-                Eye.y = current.y;
-                Eye.z = current.z - t * FINAL_POINT_RADIUS; // Continuously move away from the point
-                At = current;
-
-                // Update timer
-                cinematicTimer += 0.016; // Assuming 60 FPS
-
-                // Move to the next point after the display duration
-                if (cinematicTimer >= FINAL_POINT_DURATION) {
-                    cinematicTimer = 0;
-                    currentCinematicPoint = 0; // Reset to the first point
-                    currentView = THIRD_PERSON;
-                }
-            }
-            else {
-                // Cinematic camera movement for other points
-                float t = cinematicTimer / CINEMATIC_DURATION;
-                int nextPoint = (currentCinematicPoint + 1) % cinematicPoints2.size();
-                Vector current = cinematicPoints2[currentCinematicPoint];
-                Vector next = cinematicPoints2[nextPoint];
-
-                // Interpolate between current and next point
-                Eye.x = current.x + (next.x - current.x) * t;
-                Eye.y = current.y + (next.y - current.y) * t;
-                Eye.z = current.z + (next.z - current.z) * t;
-
-                // Look at the next point
-                At = next;
-
-                // Update timer and current point
-                cinematicTimer += 0.016; // Assuming 60 FPS
-                if (cinematicTimer >= CINEMATIC_DURATION / cinematicPoints2.size()) {
-                    cinematicTimer = 0;
-                    currentCinematicPoint = nextPoint;
-                }
-
-                // If cinematic is complete, switch to third person view
-                if (currentCinematicPoint == 0 && cinematicTimer == 0) {
-                    stopCinemtic2Music();
-                    playIdleEngine();
-                    currentView = THIRD_PERSON;
-                }
-            }
+            // Cinematic camera movement for other points
+            float t = std::min(cinematicTimer, CINEMATIC_DURATION / points.size()) / CINEMATIC_DURATION;
+            int nextPoint = (state.cinematicPoint + 1) % points.size();
+            Vector current = points[state.cinematicPoint];
+            Vector next = points[nextPoint];
+
+            // Interpolate between current and next point
+            Eye.x = current.x + (next.x - current.x) * t;
+            Eye.y = current.y + (next.y - current.y) * t;
+            Eye.z = current.z + (next.z - current.z) * t;
+
+            // Look at the next point
+            At = next;
         }
     }
-    else if (gameOver) {
-        Eye = Vector(lastCarPosition.x, lastCarPosition.y + 5.0f, lastCarPosition.z + 10.0f);
+    else if (state.gameOver) {
+        Eye = Vector(state.lastCarPosition.x, state.lastCarPosition.y + 5.0f, state.lastCarPosition.z + 10.0f);
         At = Vector(carPosition.x, 0, carPosition.z);
 	}
-    else if (gameWon) {
+    else if (state.gameWon) {
         // Position the camera in front of the car
         float radians = carRotation * M_PI / 180.0;
         Eye = Vector(
@@ -5656,7 +7094,7 @@ void updateCamera()
         At = Vector(carPosition.x, carPosition.y, carPosition.z);
     }
     else
-    if (currentView == INSIDE_FRONT)
+    if (state.view == INSIDE_FRONT)
     {
             float carRadians = -(carRotation * M_PI / 180.0);
             float yawRadians = cameraYaw * M_PI / 180.0;
@@ -5712,7 +7150,7 @@ void updateCamera()
        
     }
 
-    else if (currentView == THIRD_PERSON)
+    else if (state.view == THIRD_PERSON)
 	{
 		float radians = carRotation * M_PI / 180.0;
 		
@@ -5741,259 +7179,165 @@ void updateCamera()
 	gluLookAt(Eye.x, Eye.y, Eye.z, At.x, At.y, At.z, Up.x, Up.y, Up.z);
 }
 
-void drawGameOverText() {
-
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    gluOrtho2D(0, WIDTH, 0, HEIGHT);
-
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-
-    glColor3f(1.0f, 0.0f, 0.0f);  // Red color for text
-    glRasterPos2i(WIDTH / 2 - 50, HEIGHT / 2);
-
-    const char* text = "Game Over";
-    for (const char* c = text; *c != '\0'; c++) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-    }
-
-    if (carTooDamaged) {
-        glRasterPos2i(WIDTH / 2 - 100, HEIGHT / 2 - 30);
-        const char* restartText = "Car Too Damaged to continue";
-        for (const char* c = restartText; *c != '\0'; c++) {
-            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-        }
-    }
-
-    glRasterPos2i(WIDTH / 2 - 100, HEIGHT / 2 - 60);
-    const char* restartText = "Press 'R' to restart";
-    for (const char* c = restartText; *c != '\0'; c++) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
-    }
-    
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
-
-    //glEnable(GL_LIGHTING);
-    glEnable(GL_TEXTURE_2D);
-}
-
-void renderSpeedOMeter(float speed) {
-
-    if (currentView == CINEMATIC) {
-       return;
-    }
-    const float centerX = 1100.0f;  // Center of the speedometer (X position)
-    const float centerY = 100.0f;  // Center of the speedometer (Y position)
-    const float radius = 80.0f;    // Radius of the speedometer
-    const float maxSpeed = 200.0f; // Maximum speed
-    const int numMarkers = 10;     // Number of markers
-
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    gluOrtho2D(0, WIDTH, 0, HEIGHT);
-
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-
-    // Disable lighting for 2D rendering
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-
-    // **Draw Metallic Circular Border**
-    glColor3f(0.6f, 0.6f, 0.6f);  // Silver color
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(centerX, centerY);
-    for (int i = 0; i <= 360; ++i) {
-        float angle = i * M_PI / 180.0f;
-        glVertex2f(centerX + (radius + 5) * cos(angle), centerY + (radius + 5) * sin(angle));
-    }
-    glEnd();
-
-    // **Draw Gradient Background**
-    for (int i = 0; i < 100; ++i) {
-        glColor3f(0.0f, 0.0f, 0.0f + (i * 0.01f));  // Dark-to-light gradient
-        glBegin(GL_TRIANGLE_FAN);
-        for (int j = 0; j <= 360; ++j) {
-            float angle = j * M_PI / 180.0f;
-            glVertex2f(centerX + radius * (1 - i * 0.01f) * cos(angle),
-                centerY + radius * (1 - i * 0.01f) * sin(angle));
-        }
-        glEnd();
-    }
-
-    // **Draw Markers and Labels**
-    glColor3f(1.0f, 1.0f, 1.0f); // White color for markers and labels
-    for (int i = 0; i <= numMarkers; ++i) {
-        float angle = (135.0f - (270.0f * i / numMarkers)) * M_PI / 180.0f;
-        float innerX = centerX + (radius - 10) * cos(angle);
-        float innerY = centerY + (radius - 10) * sin(angle);
-        float outerX = centerX + radius * cos(angle);
-        float outerY = centerY + radius * sin(angle);
-        glBegin(GL_LINES);
-        glVertex2f(innerX, innerY);
-        glVertex2f(outerX, outerY);
-        glEnd();
-
-        // Draw speed labels
-        std::ostringstream oss;
-        oss << (i * maxSpeed / numMarkers);
-        std::string speedLabel = oss.str();
-        float textX = centerX + (radius - 25) * cos(angle) - 5;
-        float textY = centerY + (radius - 25) * sin(angle) - 5;
-        glRasterPos2f(textX, textY);
-        for (char c : speedLabel) {
-            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, c);
-        }
-    }
-
-    // **Draw Needle**
-    float needleAngle = (135.0f - (270.0f * speed / maxSpeed)) * M_PI / 180.0f;
-
-    // Needle Shadow
-    glColor3f(0.3f, 0.0f, 0.0f);  // Dark red shadow
-    glBegin(GL_QUADS);
-    glVertex2f(centerX + 2 * cos(needleAngle - M_PI / 2), centerY + 2 * sin(needleAngle - M_PI / 2)); // Left base
-    glVertex2f(centerX + 2 * cos(needleAngle + M_PI / 2), centerY + 2 * sin(needleAngle + M_PI / 2)); // Right base
-    glVertex2f(centerX + (radius - 20) * cos(needleAngle + 0.02f),
-        centerY + (radius - 20) * sin(needleAngle + 0.02f));  // Right tip
-    glVertex2f(centerX + (radius - 20) * cos(needleAngle - 0.02f),
-        centerY + (radius - 20) * sin(needleAngle - 0.02f));  // Left tip
-    glEnd();
+void drawGameOverText(bool carTooDamaged) {
 
-    // Needle Body
-    glColor3f(1.0f, 0.0f, 0.0f);  // Bright red
-    glBegin(GL_QUADS);
-    glVertex2f(centerX + 2 * cos(needleAngle - M_PI / 2), centerY + 2 * sin(needleAngle - M_PI / 2)); // Left base
-    glVertex2f(centerX + 2 * cos(needleAngle + M_PI / 2), centerY + 2 * sin(needleAngle + M_PI / 2)); // Right base
-    glVertex2f(centerX + (radius - 20) * cos(needleAngle + 0.02f),
-        centerY + (radius - 20) * sin(needleAngle + 0.02f));  // Right tip
-    glVertex2f(centerX + (radius - 20) * cos(needleAngle - 0.02f),
-        centerY + (radius - 20) * sin(needleAngle - 0.02f));  // Left tip
-    glEnd();
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0, WIDTH, 0, HEIGHT);
 
-    // **Draw Center Cap**
-    glColor3f(0.8f, 0.8f, 0.8f);  // Metallic silver
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(centerX, centerY);
-    for (int i = 0; i <= 360; ++i) {
-        float angle = i * M_PI / 180.0f;
-        glVertex2f(centerX + 5 * cos(angle), centerY + 5 * sin(angle));
-    }
-    glEnd();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
 
-    // **Glass Overlay**
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glColor4f(1.0f, 1.0f, 1.0f, 0.2f);  // Transparent white
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(centerX, centerY);
-    for (int i = 0; i <= 360; ++i) {
-        float angle = i * M_PI / 180.0f;
-        glVertex2f(centerX + radius * cos(angle), centerY + radius * sin(angle));
+    glColor3f(1.0f, 0.0f, 0.0f);  // Red color for text
+    QueueText(TEXT_FONT_LARGE, WIDTH / 2 - 50, HEIGHT / 2, "Game Over");
+
+    if (carTooDamaged) {
+        const char* restartText = "Car Too Damaged to continue";
+        QueueText(TEXT_FONT_LARGE, WIDTH / 2 - 100, HEIGHT / 2 - 30, restartText);
     }
-    glEnd();
-    glDisable(GL_BLEND);
 
-    // Re-enable lighting and depth testing
-    //glEnable(GL_LIGHTING);
-    glEnable(GL_DEPTH_TEST);
+    const char* restartText = "Press 'R' to restart";
+    QueueText(TEXT_FONT_SMALL, WIDTH / 2 - 100, HEIGHT / 2 - 60, restartText);
 
+    if (secondLevelLoading) {
+        const char* loadingText = "Loading next level...";
+        QueueText(TEXT_FONT_SMALL, WIDTH / 2 - 100, HEIGHT / 2 - 90, loadingText);
+    }
+    
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
     glMatrixMode(GL_MODELVIEW);
     glPopMatrix();
+
+    //glEnable(GL_LIGHTING);
+    glEnable(GL_TEXTURE_2D);
 }
 
-void drawRoundedRect(float x, float y, float width, float height, float radius) {
-    int segments = 20;
-    glBegin(GL_POLYGON);
-    for (int i = 0; i <= segments; i++) {
-        float theta = i * 2.0f * M_PI / segments;
-        float cx = x + radius - cosf(theta) * radius;
-        float cy = y + radius - sinf(theta) * radius;
-        glVertex2f(cx, cy);
-    }
-    for (int i = 0; i <= segments; i++) {
-        float theta = i * 2.0f * M_PI / segments;
-        float cx = x + width - radius + cosf(theta) * radius;
-        float cy = y + radius - sinf(theta) * radius;
-        glVertex2f(cx, cy);
-    }
-    for (int i = 0; i <= segments; i++) {
-        float theta = i * 2.0f * M_PI / segments;
-        float cx = x + width - radius + cosf(theta) * radius;
-        float cy = y + height - radius + sinf(theta) * radius;
-        glVertex2f(cx, cy);
-    }
-    for (int i = 0; i <= segments; i++) {
-        float theta = i * 2.0f * M_PI / segments;
-        float cx = x + radius - cosf(theta) * radius;
-        float cy = y + height - radius + sinf(theta) * radius;
-        glVertex2f(cx, cy);
-    }
-    glEnd();
+// Retained HUD: the stopwatch panel and the speedometer dial are built once per
+// window size, the needle is rewritten only when the speed changes, and the HUD
+// strings are reformatted only when the values they show do
+const float SPEEDOMETER_X = 1100.0f;     // Center of the speedometer
+const float SPEEDOMETER_Y = 100.0f;
+const float SPEEDOMETER_RADIUS = 80.0f;
+const float SPEEDOMETER_MAX_SPEED = 200.0f;
+const int SPEEDOMETER_MARKERS = 10;
+const int DIAL_SEGMENTS = 90;
+
+HudLayer hudLayer;
+int hudSpeedometerGroup = 0;
+int hudNeedle = 0;                       // Shadow quad, then body quad
+int hudBuiltWidth = 0;
+int hudBuiltHeight = 0;
+float hudNeedleSpeed = -1.0f;
+char speedLabels[SPEEDOMETER_MARKERS + 1][8];
+int hudTimerValue = -1;                  // Hundredths of a second hudTimerText shows
+char hudTimerText[32];
+int hudWalletValue = -1;
+char hudWalletText[48];
+float hudWinTime = -1.0f;
+int hudWinScore = 0;
+int hudWinLevel = 0;
+char hudWinText[96];
+char hudWinScoreText[32];
+
+float speedometerAngle(int marker) {
+    return (135.0f - (270.0f * marker / SPEEDOMETER_MARKERS)) * M_PI / 180.0f;
 }
 
-void drawRoundedRectOutline(float x, float y, float width, float height, float radius) {
-    int segments = 20;
-    glBegin(GL_LINE_LOOP);
-    for (int i = 0; i <= segments; i++) {
-        float theta = i * 2.0f * M_PI / segments;
-        float cx = x + radius - cosf(theta) * radius;
-        float cy = y + radius - sinf(theta) * radius;
-        glVertex2f(cx, cy);
-    }
-    for (int i = 0; i <= segments; i++) {
-        float theta = i * 2.0f * M_PI / segments;
-        float cx = x + width - radius + cosf(theta) * radius;
-        float cy = y + radius - sinf(theta) * radius;
-        glVertex2f(cx, cy);
-    }
-    for (int i = 0; i <= segments; i++) {
-        float theta = i * 2.0f * M_PI / segments;
-        float cx = x + width - radius + cosf(theta) * radius;
-        float cy = y + height - radius + sinf(theta) * radius;
-        glVertex2f(cx, cy);
-    }
-    for (int i = 0; i <= segments; i++) {
-        float theta = i * 2.0f * M_PI / segments;
-        float cx = x + radius - cosf(theta) * radius;
-        float cy = y + height - radius + sinf(theta) * radius;
-        glVertex2f(cx, cy);
-    }
-    glEnd();
+void buildHud() {
+    hudLayer.Clear();
+
+    // Stopwatch body, screen and screen border
+    float stopwatchX = 20;
+    float stopwatchY = HEIGHT - 100;
+    float stopwatchWidth = 180;
+    float stopwatchHeight = 60;
+    hudLayer.BeginGroup();
+    hudLayer.SetColor(0.2f, 0.2f, 0.2f); // Dark gray
+    hudLayer.AddRoundedRect(stopwatchX, stopwatchY, stopwatchWidth, stopwatchHeight, 10);
+    hudLayer.SetColor(0.0f, 0.0f, 0.0f); // Black screen
+    hudLayer.AddRoundedRect(stopwatchX + 5, stopwatchY + 5, stopwatchWidth - 10, stopwatchHeight - 10, 5);
+    hudLayer.SetColor(0.5f, 0.5f, 0.5f); // Gray border
+    hudLayer.AddRoundedRectOutline(stopwatchX + 5, stopwatchY + 5, stopwatchWidth - 10, stopwatchHeight - 10, 5, 2.0f);
+
+    const float centerX = SPEEDOMETER_X;
+    const float centerY = SPEEDOMETER_Y;
+    const float radius = SPEEDOMETER_RADIUS;
+    hudSpeedometerGroup = hudLayer.BeginGroup();
+
+    // Metallic circular border, then the dark-to-light blue face
+    hudLayer.SetColor(0.6f, 0.6f, 0.6f);
+    hudLayer.AddDisc(centerX, centerY, radius + 5, DIAL_SEGMENTS);
+    const float rim[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    hudLayer.SetColor(0.0f, 0.0f, 0.99f);
+    hudLayer.AddGradientDisc(centerX, centerY, radius, DIAL_SEGMENTS, rim);
+
+    // Markers; their labels are queued as text each frame
+    hudLayer.SetColor(1.0f, 1.0f, 1.0f);
+    for (int i = 0; i <= SPEEDOMETER_MARKERS; ++i) {
+        float angle = speedometerAngle(i);
+        hudLayer.AddLine(centerX + (radius - 10) * cos(angle), centerY + (radius - 10) * sin(angle),
+            centerX + radius * cos(angle), centerY + radius * sin(angle), 1.0f);
+        snprintf(speedLabels[i], sizeof(speedLabels[i]), "%g", i * SPEEDOMETER_MAX_SPEED / SPEEDOMETER_MARKERS);
+    }
+
+    // Needle between the face and the cap, then the glass over everything
+    hudNeedle = hudLayer.ReserveDynamic(12);
+    hudLayer.SetColor(0.8f, 0.8f, 0.8f); // Metallic silver
+    hudLayer.AddDisc(centerX, centerY, 5, DIAL_SEGMENTS / 3);
+    hudLayer.SetColor(1.0f, 1.0f, 1.0f, 0.2f); // Transparent white
+    hudLayer.AddDisc(centerX, centerY, radius, DIAL_SEGMENTS);
+
+    hudBuiltWidth = WIDTH;
+    hudBuiltHeight = HEIGHT;
+    hudNeedleSpeed = -1.0f;
 }
 
-void renderCenteredText(const char* text, float screenWidth, float posY) {
-    // Calculate the width of the text
-    int textWidth = 0;
-    for (const char* c = text; *c != '\0'; c++) {
-        textWidth += glutBitmapWidth(GLUT_BITMAP_HELVETICA_18, *c);
+void renderSpeedOMeter(float speed) {
+    const float centerX = SPEEDOMETER_X;
+    const float centerY = SPEEDOMETER_Y;
+    const float radius = SPEEDOMETER_RADIUS;
+
+    glColor3f(1.0f, 1.0f, 1.0f); // White color for labels
+    for (int i = 0; i <= SPEEDOMETER_MARKERS; ++i) {
+        float angle = speedometerAngle(i);
+        float textX = centerX + (radius - 25) * cos(angle) - 5;
+        float textY = centerY + (radius - 25) * sin(angle) - 5;
+        QueueText(TEXT_FONT_SMALL, textX, textY, speedLabels[i]);
     }
 
-    // Calculate the X position to center the text
-    float posX = (screenWidth - textWidth) / 2.0f;
+    if (speed == hudNeedleSpeed) {
+        return;
+    }
+    hudNeedleSpeed = speed;
+    const float halfPi = static_cast<float>(M_PI) / 2;
+    float needleAngle = (135.0f - (270.0f * speed / SPEEDOMETER_MAX_SPEED)) * static_cast<float>(M_PI) / 180.0f;
+    float leftBase[2] = { centerX + 2 * cosf(needleAngle - halfPi), centerY + 2 * sinf(needleAngle - halfPi) };
+    float rightBase[2] = { centerX + 2 * cosf(needleAngle + halfPi), centerY + 2 * sinf(needleAngle + halfPi) };
+    float rightTip[2] = { centerX + (radius - 20) * cosf(needleAngle + 0.02f), centerY + (radius - 20) * sinf(needleAngle + 0.02f) };
+    float leftTip[2] = { centerX + (radius - 20) * cosf(needleAngle - 0.02f), centerY + (radius - 20) * sinf(needleAngle - 0.02f) };
+
+    HudVertex needle[12];
+    hudLayer.SetColor(0.3f, 0.0f, 0.0f);  // Dark red shadow
+    hudLayer.MakeQuad(leftBase, rightBase, rightTip, leftTip, needle);
+    hudLayer.SetColor(1.0f, 0.0f, 0.0f);  // Bright red
+    hudLayer.MakeQuad(leftBase, rightBase, rightTip, leftTip, needle + 6);
+    hudLayer.UpdateDynamic(hudNeedle, needle, 12);
+}
 
-    // Set the raster position for the text
-    glRasterPos2f(posX, posY);
 
-    // Render the text
-    for (const char* c = text; *c != '\0'; c++) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-    }
+
+void renderCenteredText(const char* text, float screenWidth, float posY) {
+    // Calculate the X position to center the text
+    float posX = (screenWidth - TextWidth(TEXT_FONT_LARGE, text)) / 2.0f;
+    QueueText(TEXT_FONT_LARGE, posX, posY, text);
 }
 
-void drawHUD() {
+void drawHUD(const GameSnapshot& state) {
 
-    if (currentView == CINEMATIC)
+    if (state.view == CINEMATIC)
     {
         glMatrixMode(GL_PROJECTION);
         glPushMatrix();
@@ -6005,13 +7349,9 @@ void drawHUD() {
         glLoadIdentity();
 
         glColor3f(0.0f, 0.0f, 0.0f);  // White color for text
-        glRasterPos2i(WIDTH / 2 - 70, HEIGHT - 50);
 
         if (level == 1) {
-            const char* text = "Press Enter to Start";
-            for (const char* c = text; *c != '\0'; c++) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
-            }
+            QueueText(TEXT_FONT_LARGE, WIDTH / 2 - 70, HEIGHT - 50, "Press Enter to Start");
         }
 		else {
             const char* text1 = "You need funds for a water bottle and you don't have money, collect 0.5 euros quickly!";
@@ -6043,131 +7383,80 @@ void drawHUD() {
     glDisable(GL_LIGHTING);
     glDisable(GL_DEPTH_TEST);
 
-    // Stopwatch dimensions and position
+    if (hudBuiltWidth != WIDTH || hudBuiltHeight != HEIGHT) {
+        buildHud();
+    }
+
+    // Speedometer if game is active; updates the needle before the panels are drawn
+    bool showSpeedometer = !state.gameWon && !state.gameOver;
+    hudLayer.SetGroupVisible(hudSpeedometerGroup, showSpeedometer);
+    if (showSpeedometer) {
+        renderSpeedOMeter(abs(state.carSpeed * 2.1));
+    }
+    hudLayer.Draw();
+
+    // Stopwatch position, as buildHud laid it out
     float stopwatchX = 20;
     float stopwatchY = HEIGHT - 100;
-    float stopwatchWidth = 180;
     float stopwatchHeight = 60;
 
-    // Draw stopwatch body (rounded rectangle)
-    glColor3f(0.2f, 0.2f, 0.2f); // Dark gray
-    drawRoundedRect(stopwatchX, stopwatchY, stopwatchWidth, stopwatchHeight, 10);
-
-    // Draw stopwatch screen
-    glColor3f(0.0f, 0.0f, 0.0f); // Black screen
-    drawRoundedRect(stopwatchX + 5, stopwatchY + 5, stopwatchWidth - 10, stopwatchHeight - 10, 5);
-
-    // Draw screen border
-    glLineWidth(2.0f);
-    glColor3f(0.5f, 0.5f, 0.5f); // Gray border
-    glBegin(GL_LINE_LOOP);
-    drawRoundedRectOutline(stopwatchX + 5, stopwatchY + 5, stopwatchWidth - 10, stopwatchHeight - 10, 5);
-    glEnd();
-
-    // Format time as HH:MM:SS
-    int totalSeconds = static_cast<int>(gameTimer);
-    int hours = totalSeconds / 3600;
-    int minutes = (totalSeconds % 3600) / 60;
-    int seconds = totalSeconds % 60;
-    int milliseconds = static_cast<int>((gameTimer - totalSeconds) * 100);
-
-    std::ostringstream oss;
-    oss << std::setfill('0') << std::setw(2) << hours << ":"
-        << std::setfill('0') << std::setw(2) << minutes << ":"
-        << std::setfill('0') << std::setw(2) << seconds << "."
-        << std::setfill('0') << std::setw(2) << milliseconds;
-
-    std::string timerText = oss.str();
-
-
+    // Format time as HH:MM:SS.cc
+    int totalSeconds = static_cast<int>(state.gameTimer);
+    int milliseconds = static_cast<int>((state.gameTimer - totalSeconds) * 100);
+    if (totalSeconds * 100 + milliseconds != hudTimerValue) {
+        hudTimerValue = totalSeconds * 100 + milliseconds;
+        snprintf(hudTimerText, sizeof(hudTimerText), "%02d:%02d:%02d.%02d",
+            totalSeconds / 3600, (totalSeconds % 3600) / 60, totalSeconds % 60, milliseconds);
+    }
 
     // Draw digital time text
     glColor3f(0.0f, 1.0f, 0.0f); // Bright green for digital display
     float textX = stopwatchX + 15;
     float textY = stopwatchY + stopwatchHeight / 2 + 5;
-    glRasterPos2f(textX, textY);
-    for (char c : timerText) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
+    QueueText(TEXT_FONT_LARGE, textX, textY, hudTimerText);
+    if (state.score != hudWalletValue) {
+        hudWalletValue = state.score;
+        snprintf(hudWalletText, sizeof(hudWalletText), "Wallet: %d EGP", state.score);
     }
     if (level == 2) {
-        // Draw score of the player
-        glColor3f(0.0f, 1.0f, 0.0f); // Bright green for digital display
+        // Draw state.score of the player
         float scoreX = stopwatchX + 15;
         float scoreY = stopwatchY + stopwatchHeight / 2 - 20;
-
-        std::string scoreText = "Wallet: " + std::to_string(score) + " EGP";
-        glRasterPos2f(scoreX, scoreY);
-
-        for (char c : scoreText) {
-            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
+        QueueText(TEXT_FONT_LARGE, scoreX, scoreY, hudWalletText);
+    }
+
+    if (state.gameWon) {
+        int scoreTime = 9000 - static_cast<int>(state.gameTimer * 100);
+        if (state.playerTime != hudWinTime || scoreTime != hudWinScore || level != hudWinLevel) {
+            hudWinTime = state.playerTime;
+            hudWinScore = scoreTime;
+            hudWinLevel = level;
+            const char* format = level == 1 ? "You Win! Time: %.2f seconds" : "You Have Completed the Game! Time: %.2f seconds";
+            snprintf(hudWinText, sizeof(hudWinText), format, state.playerTime);
+            snprintf(hudWinScoreText, sizeof(hudWinScoreText), "Score: %d", scoreTime);
         }
-    }
-
-    // Render speedometer if game is active
-    if (!gameWon && !gameOver) {
-        renderSpeedOMeter(abs(carSpeed * 2.1));
-    }
-
-    if (gameWon) {
-        int scoreTime = 9000 - static_cast<int>(gameTimer * 100);
-
-        std::ostringstream timeStream;
-        timeStream << std::fixed << std::setprecision(2) << playerTime;
-        std::string formattedTime = timeStream.str();
 
         glColor3f(0.0f, 1.0f, 0.0f); 
-
-        
-
-
+        QueueText(TEXT_FONT_LARGE, WIDTH / 2 - 100, HEIGHT / 2, hudWinText);
         if (level == 1) {
-
-            glRasterPos2i(WIDTH / 2 - 100, HEIGHT / 2);
-            std::string winText = "You Win! Time: " + formattedTime + " seconds";
-            for (char c : winText) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-            }
             // Second line: "Score: XXXX"
-            glRasterPos2i(WIDTH / 2 - 100, HEIGHT / 2 - 30);
-            std::string scoreText = "Score: " + std::to_string(scoreTime);
-            for (char c : scoreText) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-            }
-        
-            glRasterPos2i(WIDTH / 2 - 150, HEIGHT / 2 - 60); // Adjust Y-position for the new line
-            std::string instructionText = "Press R to restart or N to go to the next level";
-            for (char c : instructionText) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-            }
+            QueueText(TEXT_FONT_LARGE, WIDTH / 2 - 100, HEIGHT / 2 - 30, hudWinScoreText);
+            const char* instructionText = secondLevelLoading ? "Loading next level..." : "Press R to restart or N to go to the next level";
+            QueueText(TEXT_FONT_LARGE, WIDTH / 2 - 150, HEIGHT / 2 - 60, instructionText); // Adjust Y-position for the new line
         }
         if (level == 2) {
-
-            glRasterPos2i(WIDTH / 2 - 100, HEIGHT / 2);
-            std::string winText = "You Have Completed the Game! Time: " + formattedTime + " seconds";
-            for (char c : winText) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-            }
-
-            glRasterPos2i(WIDTH / 2 - 100, HEIGHT / 2 - 30);
-            std::string scoreText = "Wallet: " + std::to_string(score) + " EGP";
-            for (char c : scoreText) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-            }
-            
-
-            glRasterPos2i(WIDTH / 2 - 150, HEIGHT / 2 - 60); // Adjust Y-position for the new line
-            std::string instructionText = "Press R to restart";
-            for (char c : instructionText) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-            }
+            QueueText(TEXT_FONT_LARGE, WIDTH / 2 - 100, HEIGHT / 2 - 30, hudWalletText);
+            QueueText(TEXT_FONT_LARGE, WIDTH / 2 - 150, HEIGHT / 2 - 60, "Press R to restart"); // Adjust Y-position for the new line
         }
     }
 
     // Draw game-over text
-    if (gameOver) {
-        drawGameOverText();
+    if (state.gameOver) {
+        drawGameOverText(state.carTooDamaged);
     }
 
+    drawRenderStatsHUD();
+
     // Re-enable lighting and depth testing
     //glEnable(GL_LIGHTING);
     glEnable(GL_DEPTH_TEST);
@@ -6202,6 +7491,7 @@ void resetGame() {
     sunEffect.reset();
     sunrise.reset();
 	stopWinMusic();
+    previousCarPose = currentCarPose(); // No blending from where the car was before the restart
 }
 
 //=======================================================================
@@ -6248,58 +7538,127 @@ void myInit(void)
 // Render Functions
 //=======================================================================
 
+// Prop transforms, one matrix per instance for GLTFModel::DrawInstanced
+glm::mat4 coneTransform(float x, float y, float z) {
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+    return glm::rotate(transform, glm::radians(90.0f), glm::vec3(0, 1, 0));
+}
+
+glm::mat4 stoneTransform(float x, float y, float z) {
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+    return glm::scale(transform, glm::vec3(0.5f));
+}
+
+glm::mat4 logTransform(float x, float y, float z) {
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+    transform = glm::scale(transform, glm::vec3(3.0f));
+    return glm::rotate(transform, glm::radians(90.0f), glm::vec3(0, 1, 0));
+}
+
+glm::mat4 coinTransform(float x, float y, float z, float animationPhase) {
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+    transform = glm::rotate(transform, glm::radians(90.0f), glm::vec3(1, 0, 0));
+    transform = glm::rotate(transform, glm::radians(-animationPhase * 45), glm::vec3(0, 0, 1));
+    return glm::scale(transform, glm::vec3(0.5f));
+}
+
+glm::mat4 nitroTransform(float x, float y, float z, float animationPhase) {
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+    transform = glm::scale(transform, glm::vec3(0.4f));
+    transform = glm::rotate(transform, glm::radians(20.0f), glm::vec3(1, 0, 0));
+    return glm::rotate(transform, glm::radians(-animationPhase * 45), glm::vec3(0, 1, 0));
+}
+
+// Stress mode ('p'): thousands of extra props on a grid around the car, drawn only
+// (no collisions or pickups), to show instancing cost does not grow with the count
+const int STRESS_PROPS_PER_TYPE = 2000;
+const float STRESS_PROP_SPACING = 6.0f;
+std::vector<glm::vec3> stressPropPositions;
+
+void toggleStressProps() {
+    if (!stressPropPositions.empty()) {
+        stressPropPositions.clear();
+        std::cout << "Stress props off" << std::endl;
+        return;
+    }
+
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(STRESS_PROPS_PER_TYPE))));
+    for (int i = 0; i < STRESS_PROPS_PER_TYPE; ++i) {
+        float x = (i % side - side / 2) * STRESS_PROP_SPACING;
+        float z = (i / side - side / 2) * STRESS_PROP_SPACING;
+        stressPropPositions.push_back(glm::vec3(carPosition.x + x, 0.0f, carPosition.z + z));
+    }
+    std::cout << "Stress props on: " << STRESS_PROPS_PER_TYPE << " of each prop type" << std::endl;
+}
+
+// Stress mode also puts a lamp in every few grid cells, a few hundred in all, for the
+// clustered lighting to cull ('k' compares against looping over all of them)
+const size_t STRESS_STREETLIGHT_STRIDE = 8;
+
+void addStressStreetlights(std::vector<PointLight>& lamps) {
+    for (size_t i = 0; i < stressPropPositions.size(); i += STRESS_STREETLIGHT_STRIDE) {
+        const glm::vec3& cell = stressPropPositions[i];
+        lamps.push_back({ { cell.x, 1.0f, cell.z }, { 1.0f, 1.0f, 0.0f }, { 0.8f, 0.2f, 0.1f }, 0.0f });
+    }
+}
+
+// Stress copies of prop type `slot` sit at their own offset inside each grid cell so types do not overlap
+glm::vec3 stressPropPosition(size_t index, int slot) {
+    return stressPropPositions[index] + glm::vec3(slot * STRESS_PROP_SPACING / 5.0f, 0.0f, 0.0f);
+}
+
+std::vector<glm::mat4> propInstances;
+
 void renderCones() {
+    propInstances.clear();
     for (const auto& cone : cones) {
-        glPushMatrix();
-        glTranslatef(cone.x, cone.y, cone.z);
-        glScalef(1.0f, 1.0f, 1.0f);  // Adjust scale if needed
-        glRotatef(90.0f, 0, 1, 0);   // Adjust rotation if needed
-        coneModel.DrawModel();
-        glPopMatrix();
+        propInstances.push_back(coneTransform(cone.x, cone.y, cone.z));
+    }
+    for (size_t i = 0; i < stressPropPositions.size(); ++i) {
+        glm::vec3 position = stressPropPosition(i, 0);
+        propInstances.push_back(coneTransform(position.x, position.y, position.z));
     }
+    coneModel.DrawInstanced(propInstances);
 }
 
 void renderStones() {
+    propInstances.clear();
     for (const auto& stone : stones) {
-        glPushMatrix();
-        glTranslatef(stone.x, stone.y, stone.z);
-        glScalef(0.5f, 0.5f, 0.5f);  // Adjust scale if needed
-        //glRotatef(180.0f, 1, 0, 0);   // Adjust rotation if needed
-        rockModel.DrawModel();
-        glPopMatrix();
+        propInstances.push_back(stoneTransform(stone.x, stone.y, stone.z));
     }
+    for (size_t i = 0; i < stressPropPositions.size(); ++i) {
+        glm::vec3 position = stressPropPosition(i, 1);
+        propInstances.push_back(stoneTransform(position.x, position.y, position.z));
+    }
+    rockModel.DrawInstanced(propInstances);
 }
 
 void renderLogs() {
+    propInstances.clear();
     for (const auto& log : logs) {
-        glPushMatrix();
-        glTranslatef(log.x, log.y, log.z);
-        glScalef(3.0f, 3.0f, 3.0f);  // Adjust scale if needed
-        glRotatef(90.0f, 0, 1, 0);   // Adjust rotation if needed
-        logModel.DrawModel();
-        glPopMatrix();
+        propInstances.push_back(logTransform(log.x, log.y, log.z));
+    }
+    for (size_t i = 0; i < stressPropPositions.size(); ++i) {
+        glm::vec3 position = stressPropPosition(i, 2);
+        propInstances.push_back(logTransform(position.x, position.y, position.z));
     }
+    logModel.DrawInstanced(propInstances);
 }
 
-void renderCoins() {
+void renderCoins(const std::vector<Coin>& coins) {
+    propInstances.clear();
     for (const auto& coin : coins) {
-        float rotation = -coin.animationPhase * 45;
-
-        glPushMatrix();
-        glTranslatef(coin.x, coin.y, coin.z);
-        glRotatef(90, 1, 0, 0);
-        glRotatef(rotation, 0, 0, 1);
-        glScalef(0.5, 0.5, 0.5);
-        egpModel.DrawModel();
-        glPopMatrix();
+        propInstances.push_back(coinTransform(coin.x, coin.y, coin.z, coin.animationPhase));
+    }
+    for (size_t i = 0; i < stressPropPositions.size(); ++i) {
+        glm::vec3 position = stressPropPosition(i, 3);
+        propInstances.push_back(coinTransform(position.x, position.y + 1.0f, position.z, 0.0f));
     }
+    egpModel.DrawInstanced(propInstances);
 }
 
 void renderText(float x, float y, const std::string& text) {
-    glRasterPos2f(x, y);
-    for (char c : text) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-    }
+    QueueText(TEXT_FONT_LARGE, x, y, text);
 }
 
 std::string formatSpeed(float speed) {
@@ -6308,21 +7667,23 @@ std::string formatSpeed(float speed) {
     return oss.str();
 }
 
-void renderNitros() {
+void renderNitros(const std::vector<Nitro>& nitros) {
+    propInstances.clear();
     for (const auto& nitro : nitros) {
-        float rotation = -nitro.animationPhase * 45;
-
-        glPushMatrix();
-        glTranslatef(nitro.x, nitro.y, nitro.z);
-        glScalef(0.4f, 0.4f, 0.4f);  // Adjust scale if needed
-        glRotatef(20, 1, 0, 0);
-        glRotatef(rotation, 0, 1, 0);   // Adjust rotation if needed
-        nitroModel.DrawModel();
-        glPopMatrix();
+        propInstances.push_back(nitroTransform(nitro.x, nitro.y, nitro.z, nitro.animationPhase));
     }
+    for (size_t i = 0; i < stressPropPositions.size(); ++i) {
+        glm::vec3 position = stressPropPosition(i, 4);
+        propInstances.push_back(nitroTransform(position.x, position.y + 1.0f, position.z, 0.0f));
+    }
+    nitroModel.DrawInstanced(propInstances);
 }
 
-void renderCar() {
+void renderCar(const CarPose& pose) {
+    const Vector& carPosition = pose.position;
+    float carRotation = pose.rotation;
+    float wheelRotationX = pose.wheelRotation;
+
     // Update car model position and rotation
     glPushMatrix();
     glTranslatef(carPosition.x, carPosition.y, carPosition.z);
@@ -6342,6 +7703,8 @@ void renderCar() {
     headlight_dir[1] = -0.1f;
     headlight_dir[2] = 1.0f;
 
+    // Moving the headlights is a light change, so the draws queued so far go out first
+    renderQueue.Flush();
     glLightfv(GL_LIGHT1, GL_POSITION, headlight1_pos);
     glLightfv(GL_LIGHT1, GL_SPOT_DIRECTION, headlight_dir);
     glLightfv(GL_LIGHT2, GL_POSITION, headlight2_pos);
@@ -6378,13 +7741,6 @@ void renderCar() {
         redWheelsBackRight1.DrawModel();
         glPopMatrix();
 
-        if (wheelRotationY > 52.5) {
-            wheelRotationY = 52.5;
-        }
-
-        if (wheelRotationY < -52.5) {
-            wheelRotationY = -52.5;
-        }
 
 
         // Draw front left wheel
@@ -6459,7 +7815,11 @@ void renderCar() {
  //   headlight_dir[2] = headlightDir.z;
 }
 
-void renderCar2() {
+void renderCar2(const CarPose& pose) {
+    const Vector& carPosition = pose.position;
+    float carRotation = pose.rotation;
+    float wheelRotationX = pose.wheelRotation;
+
     // disable all lights before rendering 
     
     //glDisable(GL_LIGHT0);
@@ -6489,6 +7849,8 @@ void renderCar2() {
     
 
 
+    // Moving the headlights is a light change, so the draws queued so far go out first
+    renderQueue.Flush();
     glLightfv(GL_LIGHT1, GL_POSITION, headlight1_pos);
     glLightfv(GL_LIGHT1, GL_SPOT_DIRECTION, headlight_dir);
     glLightfv(GL_LIGHT2, GL_POSITION, headlight2_pos);
@@ -6504,6 +7866,8 @@ void renderCar2() {
     float wheelOffsetZBack = 1.8f; // Backward offset for back wheels
     float scaleBlueWheel = 0.14f;
     
+    // The wheels are drawn with lights 0-2 off, so queued draws must not cross this state change
+    renderQueue.Flush();
     glDisable(GL_LIGHT0);
     glDisable(GL_LIGHT1);
     glDisable(GL_LIGHT2);
@@ -6536,13 +7900,6 @@ void renderCar2() {
     blueWheelModel.DrawModel();
     glPopMatrix();
 
-    if (wheelRotationY > 70) {
-        wheelRotationY = 70;
-    }
-
-    if (wheelRotationY < -70) {
-        wheelRotationY = -70;
-    }
 
 
     // Draw front left wheel
@@ -6570,6 +7927,7 @@ void renderCar2() {
     glPopMatrix();
 
     // enable all lights after rendering
+    renderQueue.Flush();
 
     glEnable(GL_LIGHT0);
     glEnable(GL_LIGHT1);
@@ -6617,72 +7975,232 @@ void renderHorizontalBarrier() {
     glPopMatrix();
 }
 
+//=======================================================================
+// Render Statistics
+//=======================================================================
+bool showRenderStats = false;
+FramePacer framePacer;
+
+std::string lodTriangleSummary(const RenderQueue::Stats& stats) {
+    std::ostringstream summary;
+    for (uint32_t level = 0; level < COOKED_MAX_LODS; ++level) {
+        summary << (level > 0 ? "  " : "") << "L" << level << ": " << stats.lodTriangles[level];
+    }
+    if (!lodSettings.enabled) {
+        summary << "  (LOD off)";
+    }
+    return summary.str();
+}
+
+std::string cullingSummary(const RenderQueue::Stats& stats) {
+    std::ostringstream summary;
+    summary << stats.primitivesDrawn << " primitives drawn, " << stats.primitivesCulled << " culled, "
+        << stats.primitivesOccluded << " occluded";
+    if (!frustumCulling) {
+        summary << "  (culling off)";
+    }
+    else if (!occlusionCulling) {
+        summary << "  (occlusion off)";
+    }
+    return summary.str();
+}
+
+// Pacing mode and the spread of recent frame times, for the stats output
+std::string framePacingSummary() {
+    std::string mode = framePacer.ModeName();
+    if (framePacer.Mode() == PACING_FIXED) {
+        mode += " at " + std::to_string(static_cast<int>(framePacer.TargetFps() + 0.5));
+    }
+    FrameTimeStats frames = framePacer.Stats();
+    char summary[160];
+    snprintf(summary, sizeof(summary), "%s: %.1f fps, %.2f ms mean, %.2f ms std dev, %.2f-%.2f ms over %d frames",
+        mode.c_str(), frames.meanMs > 0.0 ? 1000.0 / frames.meanMs : 0.0, frames.meanMs, frames.stdDevMs,
+        frames.minMs, frames.maxMs, frames.frames);
+    return summary;
+}
+
+// Prints the last frame's renderer counters about once a second while enabled ('b')
+void reportRenderStats() {
+    static int lastReportTime = 0;
+    if (!showRenderStats) {
+        return;
+    }
+    int currentTime = glutGet(GLUT_ELAPSED_TIME);
+    if (currentTime - lastReportTime < 1000) {
+        return;
+    }
+    lastReportTime = currentTime;
+
+    const RenderQueue::Stats& queueStats = renderQueue.GetLastFrameStats();
+    std::cout << "Render queue: " << queueStats.items << " draws, texture binds "
+        << queueStats.textureBindsUnsorted << " -> " << queueStats.textureBinds
+        << ", material changes " << queueStats.materialChangesUnsorted << " -> " << queueStats.materialChanges
+        << ", instanced " << queueStats.instancedDraws << " draws / " << queueStats.instances << " props"
+        << std::endl;
+    std::cout << "LOD triangles: " << lodTriangleSummary(queueStats) << std::endl;
+    std::cout << "Frustum culling: " << cullingSummary(queueStats) << std::endl;
+    std::cout << "HUD: " << hudLayer.LastDrawCalls() << " panel draw calls, " << TextGlyphCount() << " glyphs in "
+        << TextDrawCalls() << " text draw calls" << std::endl;
+    if (ShadingEnabled() && ShadingAvailable()) {
+        std::cout << "Per-pixel lights: " << ShadedLightCount() << " (" << ClusteredLightCount()
+            << " clustered, at most " << BusiestClusterLightCount() << " per cluster)" << std::endl;
+    }
+    std::cout << "Frame pacing " << framePacingSummary() << std::endl;
+}
+
+// Triangles drawn per LOD level and culling counts for last frame, in the 2D projection drawHUD sets up
+void drawRenderStatsHUD() {
+    if (!showRenderStats) {
+        return;
+    }
+    const RenderQueue::Stats& stats = renderQueue.GetLastFrameStats();
+    std::string lines[] = { "LOD triangles " + lodTriangleSummary(stats), "Culling " + cullingSummary(stats), "Frames " + framePacingSummary() };
+    glColor3f(1.0f, 1.0f, 0.0f);
+    for (int i = 0; i < 3; ++i) {
+        QueueText(TEXT_FONT_LARGE, 20, 20 + 24 * (2 - i), lines[i]);
+    }
+}
+
+//=======================================================================
+// Simulation Functions
+//=======================================================================
+void simulateLevel1(float deltaTime) {
+    handleCarControls(deltaTime);
+    updateCarPosition(deltaTime);
+    if (checkCollisionWithObstacles(carPosition)) {
+        if (carSpeed > 0)
+            wasGoingForward = true;
+        else
+            wasGoingForward = false;
+        carSpeed = 0;
+        isColliding = true;
+        applyCollisionRecoil(deltaTime);
+    }
+    else {
+        isColliding = false;
+    }
+    if (checkCollisionWithNitros(carPosition, nitros))
+    {
+        isNitroActive = true;
+    }
+    updateSunPosition(deltaTime);
+    updateNitroAnimation(deltaTime);
+}
+
+void simulateLevel2(float deltaTime) {
+    handleCarControls2(deltaTime);
+    updateCarPosition2(deltaTime);
+    sunrise.update(deltaTime);
+    sunEffect.update(deltaTime);
+    updateCoinAnimation(deltaTime);
+
+    if (checkCollisionWithObstacles2(carPosition)) {
+        if (carSpeed > 0)
+            wasGoingForward = true;
+        else
+            wasGoingForward = false;
+        carSpeed = 0;
+        isColliding = true;
+        applyCollisionRecoil(deltaTime);
+        if (score != 0)
+            score -= 1;
+    }
+
+    if (checkCollisionWithCoins(carPosition, coins))
+    {
+        score = score + 1;
+    }
+}
+
+// Copies what the frames draw into the buffer's free slot and hands it over
+void publishSnapshot() {
+    GameSnapshot& snapshot = snapshots.WriteSlot();
+    snapshot.previousPose = previousCarPose;
+    snapshot.pose = currentCarPose();
+    snapshot.steppedAt = lastStepAt;
+    snapshot.carSpeed = carSpeed;
+    snapshot.view = currentView;
+    snapshot.cinematicPoint = currentCinematicPoint;
+    snapshot.cinematicTimer = cinematicTimer;
+    snapshot.gameOver = gameOver;
+    snapshot.gameWon = gameWon;
+    snapshot.carTooDamaged = carTooDamaged;
+    snapshot.lastCarPosition = lastCarPosition;
+    snapshot.gameTimer = gameTimer;
+    snapshot.playerTime = playerTime;
+    snapshot.score = score;
+    snapshot.nitros = nitros; // Assignment reuses the slot's storage
+    snapshot.coins = coins;
+    snapshot.skyColor = currentSkyColor;
+    snapshot.sunPosition = sunPosition;
+    snapshot.sunColor = sunColor;
+    snapshot.sunVisibility = sunVisibility;
+    std::copy(lightPosition, lightPosition + 4, snapshot.lightPosition);
+    std::copy(lightAmbient, lightAmbient + 4, snapshot.lightAmbient);
+    std::copy(lightDiffuse, lightDiffuse + 4, snapshot.lightDiffuse);
+    snapshot.sunrise = sunrise;
+    snapshot.sunEffect = sunEffect;
+    snapshots.Publish();
+}
+
+// One wake-up of the simulation thread: the steps owed, then a snapshot. Nothing
+// moves while the car select screen is up
+void simulationTick(int steps, float step) {
+    std::lock_guard<std::mutex> lock(simulationMutex);
+    if (selectingCar) {
+        previousCarPose = currentCarPose();
+    }
+    else if (steps > 0) {
+        for (int i = 0; i < steps; ++i) {
+            previousCarPose = currentCarPose();
+            if (level == 1)
+                simulateLevel1(step);
+            else
+                simulateLevel2(step);
+            advanceCinematic(step);
+        }
+        lastStepAt = std::chrono::steady_clock::now();
+    }
+    publishSnapshot();
+}
+
+// Declared after the state it steps, so it is joined before that state is destroyed at exit
+SimulationThread simulation(SIM_STEP, SIM_MAX_STEPS);
+
 //=======================================================================
 // Display Function
 //=======================================================================
 void myDisplay(void)
 {
     if (!selectingCar) {
-        static int lastTime = 0;
-        int currentTime = glutGet(GLUT_ELAPSED_TIME);
-        float deltaTime = (currentTime - lastTime) / 1000.0f;
-        lastTime = currentTime;
-        handleCarControls(deltaTime);
-        updateCarPosition(deltaTime);
-        if (checkCollisionWithObstacles(carPosition)) {
-            if (carSpeed > 0)
-                wasGoingForward = true;
-            else
-                wasGoingForward = false;
-            carSpeed = 0;
-            isColliding = true;
-            applyCollisionRecoil(deltaTime);
-        }
-        else {
-            isColliding = false;
-        }
-        if (checkCollisionWithNitros(carPosition, nitros))
-        {
-            isNitroActive = true;
-        }
-        updateSunPosition(deltaTime);
-        updateNitroAnimation();
-        //carPosition.print();
-        glClearColor(currentSkyColor.r, currentSkyColor.g, currentSkyColor.b, 1.0f);
+        // The latest state the simulation thread published; never waits for it
+        const GameSnapshot& state = snapshots.Latest();
+        float alpha = snapshotAlpha(state);
+        CarPose pose = interpolateCarPose(state.previousPose, state.pose, alpha);
+        glClearColor(state.skyColor.r, state.skyColor.g, state.skyColor.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        updateCamera();
-        glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
-        glLightfv(GL_LIGHT0, GL_AMBIENT, lightAmbient);
-        glLightfv(GL_LIGHT0, GL_DIFFUSE, lightDiffuse);
+        updateCamera(state, pose, alpha);
+        glLightfv(GL_LIGHT0, GL_POSITION, state.lightPosition);
+        glLightfv(GL_LIGHT0, GL_AMBIENT, state.lightAmbient);
+        glLightfv(GL_LIGHT0, GL_DIFFUSE, state.lightDiffuse);
+        UpdateLodProjection();
+        renderQueue.Begin();
 
 
-        if (sunVisibility > 0.0f) {
+        if (state.sunVisibility > 0.0f) {
             glPushMatrix();
-            glTranslatef(sunPosition.x, sunPosition.y, sunPosition.z);
+            glTranslatef(state.sunPosition.x, state.sunPosition.y, state.sunPosition.z);
             glDisable(GL_LIGHTING);
-            glColor4f(sunColor.r, sunColor.g, sunColor.b, sunVisibility);
+            glColor4f(state.sunColor.r, state.sunColor.g, state.sunColor.b, state.sunVisibility);
             glEnable(GL_LIGHTING);
             glPopMatrix();
         }
 
-        // Draw skybox
-        glPushMatrix();
-        GLUquadricObj* qobj;
-        qobj = gluNewQuadric();
-        glTranslated(50, 0, 0);
-        glRotated(90, 1, 0, 1);
-        glBindTexture(GL_TEXTURE_2D, tex);
-        gluQuadricTexture(qobj, true);
-        gluQuadricNormals(qobj, GL_SMOOTH);
-        gluSphere(qobj, 1000, 100, 100);
-        gluDeleteQuadric(qobj);
-        glPopMatrix();
-
         setupLighting();
         glPushMatrix();
         glTranslatef(10, 0, 0);
         glScalef(0.7, 0.7, 0.7);
-        model_tree.Draw();
+        treeModel.DrawModel();
         glPopMatrix();
 
 
@@ -6695,12 +8213,12 @@ void myDisplay(void)
 #
 
         renderCones();
-        renderNitros();
+        renderNitros(state.nitros);
 
         if(selectedCar == 1)
-        renderCar();
+        renderCar(pose);
         else if(selectedCar == 2)
-        renderCar2();
+        renderCar2(pose);
 
         // Update car model position and rotation
         glPushMatrix();
@@ -6714,8 +8232,17 @@ void myDisplay(void)
 
         renderGoRight();
 
+        renderQueue.End();
+
+        // Sky last, over whatever the scene left uncovered, in the sun's current colour
+        GLfloat skyTint[3];
+        for (int c = 0; c < 3; ++c) {
+            skyTint[c] = std::min(state.lightAmbient[c] + state.lightDiffuse[c], 1.0f);
+        }
+        DrawSkyDome(skyTint);
+        reportRenderStats();
 
-        drawHUD();
+        drawHUD(state);
 
     }
     else {
@@ -6727,7 +8254,9 @@ void myDisplay(void)
         }
     }
 
+    FlushText();
     glutSwapBuffers();
+    framePacer.FrameDone();
 }
 
 void myDisplay2(void) {
@@ -6736,27 +8265,24 @@ void myDisplay2(void) {
         setupLighting();
 
 
-        static int lastTime = 0;
-        int currentTime = glutGet(GLUT_ELAPSED_TIME);
-        float deltaTime = (currentTime - lastTime) / 1000.0f;
-        lastTime = currentTime;
-        handleCarControls2(deltaTime);
-        updateCarPosition2(deltaTime);
+        const GameSnapshot& state = snapshots.Latest();
+        float alpha = snapshotAlpha(state);
+        CarPose pose = interpolateCarPose(state.previousPose, state.pose, alpha);
 
         //glClearColor(currentSkyColor.r, currentSkyColor.g, currentSkyColor.b, 1.0f);
-        sunrise.update(deltaTime);
-        sunEffect.update(deltaTime);
 
         // Clear the screen and apply the sunrise effect
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        sunrise.apply();
-        sunEffect.apply();
-        updateCamera();
+        state.sunrise.apply();
+        state.sunEffect.apply();
+        updateCamera(state, pose, alpha);
+        UpdateLodProjection();
+        renderQueue.Begin();
 
         if (selectedCar == 1)
-            renderCar();
+            renderCar(pose);
         else if (selectedCar == 2)
-            renderCar2();
+            renderCar2(pose);
         // draw moscow 
 
         glPushMatrix();
@@ -6782,30 +8308,16 @@ void myDisplay2(void) {
 
 
 
-        renderCoins();
-        renderStreetlights();
+        // Before the instanced props, which are lit as soon as they are drawn
+        renderStreetlights(pose.position);
+        renderCoins(state.coins);
         renderLogs();
         renderStones();
-        updateCoinAnimation();
-
-        if (checkCollisionWithObstacles2(carPosition)) {
-            if (carSpeed > 0)
-                wasGoingForward = true;
-            else
-                wasGoingForward = false;
-            carSpeed = 0;
-            isColliding = true;
-            applyCollisionRecoil(deltaTime);
-            if (score != 0)
-                score -= 1;
-        }
 
-        if (checkCollisionWithCoins(carPosition, coins))
-        {
-            score = score + 1;
-        }
+        renderQueue.End();
+        reportRenderStats();
 
-        drawHUD();
+        drawHUD(state);
     }
     else {
 		renderCarSelectScreen();
@@ -6815,7 +8327,9 @@ void myDisplay2(void) {
         }
 	}
 
+    FlushText();
     glutSwapBuffers();
+    framePacer.FrameDone();
 
 
 }
@@ -6826,10 +8340,9 @@ void myDisplay2(void) {
 
 
 
-boolean secondLevelLoading; 
-
 void myKeyboard(unsigned char button, int x, int y)
 {
+    std::unique_lock<std::mutex> lock(simulationMutex);
     if (selectingCar && button == 's' && selectedCar != 0) {  // 13 is the ASCII code for Enter
         selectingCar = false;
         std::cout << "Selected car: " << selectedCar << std::endl;
@@ -6859,10 +8372,15 @@ void myKeyboard(unsigned char button, int x, int y)
 			resetGame();
             playIdleEngine();
 		}
-        if (button == 'n' || button == 'N') {
+        if ((button == 'n' || button == 'N') && !secondLevelLoading) {
+            // Level 2 has been loading in the background since level 1 started; when
+            // it is not done yet idle() finishes the switch and the HUD says so
             secondLevelLoading = true; 
-            goToNextLevel(); 
-            resetGame();
+            PrefetchAssets2();
+            if (assetRegistry.PrefetchDone()) {
+                goToNextLevel(); 
+                resetGame();
+            }
         }
 		return;
 	}
@@ -6908,6 +8426,49 @@ void myKeyboard(unsigned char button, int x, int y)
     case 'R':
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
         break;
+    case 'b':
+    case 'B':
+        showRenderStats = !showRenderStats;
+        break;
+    case 'p':
+    case 'P':
+        toggleStressProps();
+        break;
+    case 'l':
+    case 'L':
+        lodSettings.enabled = !lodSettings.enabled;
+        std::cout << "Mesh LOD " << (lodSettings.enabled ? "on" : "off") << std::endl;
+        break;
+    case 'c':
+    case 'C':
+        frustumCulling = !frustumCulling;
+        std::cout << "Frustum culling " << (frustumCulling ? "on" : "off") << std::endl;
+        break;
+    case 'v':
+    case 'V':
+        occlusionCulling = !occlusionCulling;
+        std::cout << "Occlusion culling " << (occlusionCulling ? "on" : "off") << std::endl;
+        break;
+    case 'o':
+    case 'O':
+        SetInstancingEnabled(!InstancingEnabled());
+        std::cout << "Instanced props " << (InstancingEnabled() ? "on" : "off") << std::endl;
+        break;
+    case 'g':
+    case 'G':
+        SetShadingEnabled(!ShadingEnabled());
+        std::cout << "Per-pixel lighting " << (ShadingEnabled() ? "on" : "off") << std::endl;
+        break;
+    case 'k':
+    case 'K':
+        SetClusteringEnabled(!ClusteringEnabled());
+        std::cout << "Clustered lights " << (ClusteringEnabled() ? "on" : "off") << std::endl;
+        break;
+    case 'f':
+    case 'F':
+        framePacer.SetMode(static_cast<PacingMode>((framePacer.Mode() + 1) % PACING_MODE_COUNT));
+        std::cout << "Frame pacing " << framePacer.ModeName() << std::endl;
+        break;
 	case '1':
 		currentView = INSIDE_FRONT;
 		break;
@@ -6948,16 +8509,18 @@ void myKeyboard(unsigned char button, int x, int y)
         sunsetProgress = 0.0f;
 		break;
 	case 27:
+		lock.unlock();
+		simulation.Stop();
 		exit(0);
 		break;
 	default:
 		break;
 	}
-	glutPostRedisplay();
 }
 
 void specialKeyboard(int key, int x, int y)
 {
+    std::lock_guard<std::mutex> lock(simulationMutex);
     if (gameOver || gameWon || isRespawning || collisionRecoil > 0 || currentView == CINEMATIC) {
         return;
     }
@@ -6997,11 +8560,15 @@ void specialKeyboard(int key, int x, int y)
         }
         break;
     }
-    glutPostRedisplay();
+
+    // Steering lock of the selected car
+    float steeringLimit = selectedCar == 2 ? 70.0f : 52.5f;
+    wheelRotationY = std::min(std::max(wheelRotationY, -steeringLimit), steeringLimit);
 }
 
 void specialKeyboardUp(int key, int x, int y)
 {
+    std::lock_guard<std::mutex> lock(simulationMutex);
 	switch (key)
 	{
 	case GLUT_KEY_LEFT:
@@ -7021,7 +8588,6 @@ void specialKeyboardUp(int key, int x, int y)
 		isBraking = false;
 		break;
 	}
-	glutPostRedisplay();
 }
 
 //=======================================================================
@@ -7050,8 +8616,6 @@ void myMotion(int x, int y)
 
 	GLfloat light_position[] = { 0.0f, 10.0f, 0.0f, 1.0f };
 	glLightfv(GL_LIGHT0, GL_POSITION, light_position);
-
-	glutPostRedisplay();	//Re-draw scene 
 }
 
 //=======================================================================
@@ -7075,7 +8639,6 @@ void myMouse(int button, int state, int x, int y)
             int carX = startX + i * (carWidth + carSpacing);
             if (x >= carX && x <= carX + carWidth && y >= startY && y <= startY + carHeight) {
                 selectedCar = i + 1;  // Set the selected car
-                glutPostRedisplay();
                 break;
             }
         }
@@ -7119,11 +8682,50 @@ void myReshape(int w, int h)
 
 // Load Level 1 
 
+// Models each level loads, handed to the loader threads before the GL thread starts
+// asking for them. Keep in step with LoadAssets/LoadAssets2; a file missing here
+// still loads, just without the head start
+void PrefetchAssets()
+{
+    assetRegistry.Prefetch({
+        "models/track5/scene.gltf",
+        "models/red-car-no-wheels/scene.gltf",
+        "models/bugatti-no-wheels/scene.gltf",
+        "models/blue-wheel/scene.gltf",
+        "models/wheel/scene.gltf",
+        "models/nitro2/scene.gltf",
+        "models/cone/scene.gltf",
+        "models/finish/scene.gltf",
+        "models/horizontal-obstacle/scene.gltf",
+        "models/traffic-obstacles/scene.gltf",
+        "Models/tree/Tree1.3ds"
+    });
+}
+
+void PrefetchAssets2()
+{
+    assetRegistry.Prefetch({
+        "models/moscow-test/scene.gltf",
+        "models/bugatti-no-wheels/scene.gltf",
+        "models/pound_egypt/scene.gltf",
+        "models/log2/scene.gltf",
+        "models/rock-snow/scene.gltf",
+        "models/roadsign/scene.gltf",
+        "models/red-car-no-wheels/scene.gltf",
+        "models/blue-wheel/scene.gltf",
+        "models/wheel/scene.gltf"
+    });
+}
+
 void LoadAssets()
 {
+	PrefetchAssets();
+
 	// Loading Model files
 	model_house.Load("Models/house/house.3DS");
-	model_tree.Load("Models/tree/Tree1.3ds");
+	if (!treeModel.LoadModel("Models/tree/Tree1.3ds")) {
+		std::cerr << "Failed to load 3DS model" << std::endl;
+	}
 
     
 	if (!gltfModel1.LoadModel("models/track5/scene.gltf")) {
@@ -7198,9 +8800,11 @@ void LoadAssets()
 
 	// Loading texture files
 	loadBMP(&tex, "Textures/blu-sky-3.bmp", true);
+    CreateSkyDome(tex);
 }
 
 void UnloadAssets() {
+    DestroySkyDome();
     gltfModel1.UnloadModel();
     carModel1.UnloadModel();
     redWheelsFrontLeft1.UnloadModel();
@@ -7214,15 +8818,19 @@ void UnloadAssets() {
     trafficObstacle.UnloadModel();
     bugattiModel.UnloadModel();
     blueWheelModel.UnloadModel();
+    treeModel.UnloadModel();
 }
 
 // Load Level 2
 
 void LoadAssets2() {
+    PrefetchAssets2();
 
     if (!moscowModel.LoadModel("models/moscow-test/scene.gltf")) {
 	std::cerr << "Failed to load GLTF model" << std::endl;
     }
+    // At street level most of the city is hidden behind the buildings along the road
+    moscowModel.SetOcclusionCulling(true);
     
 
     if (!bugattiModel.LoadModel("models/bugatti-no-wheels/scene.gltf")) {
@@ -7304,6 +8912,7 @@ void LoadAssets2() {
 void goToNextLevel() {
     UnloadAssets();
     LoadAssets2();
+    assetRegistry.CollectUnused();
     selectedCar = 0; 
     selectingCar = true;
     timerStarted = false;
@@ -7344,13 +8953,44 @@ void goToNextLevel() {
 //=======================================================================
 // Main Function
 //=======================================================================
-void timer(int value) {
+// Between frames: waits for the next one as the pacing mode says, then does the
+// loading work that rides along with every frame
+void idle() {
+    framePacer.WaitForNextFrame();
+
+    if (secondLevelLoading && assetRegistry.PrefetchDone()) {
+        std::lock_guard<std::mutex> lock(simulationMutex);
+        goToNextLevel();
+        resetGame();
+    }
+
+    // One finished background load per tick goes to the GPU, keeping each upload stall short
+    assetRegistry.UploadReady(1);
+
 	glutPostRedisplay();
-	glutTimerFunc(16, timer, 0);
 }
 
 void main(int argc, char** argv)
 {
+	// Offline modes (--convert-glb, --cook, --cook-bc7, --benchmark-load) exit before the game window opens
+	if (RunAssetTool(argc, argv)) {
+		return;
+	}
+	PacingMode pacingMode = PACING_VSYNC;
+	double targetFps = 0.0;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--float-vertices") {
+			quantizedVertices = false;
+		}
+		// --pacing=vsync|fixed|uncapped, and --fps=N for fixed pacing (the display's rate by default)
+		else if (arg.compare(0, 9, "--pacing=") == 0 && !ParsePacingMode(arg.c_str() + 9, pacingMode)) {
+			std::cerr << "Unknown pacing mode " << arg.substr(9) << ", expected vsync, fixed or uncapped" << std::endl;
+		}
+		else if (arg.compare(0, 6, "--fps=") == 0) {
+			targetFps = atof(arg.c_str() + 6);
+		}
+	}
 
 	glutInit(&argc, argv);
 
@@ -7362,7 +9002,13 @@ void main(int argc, char** argv)
 
 	glutCreateWindow(title);
 
-    
+	// Buffer objects and vertex arrays used by GLTFModel come through GLEW
+	GLenum glewStatus = glewInit();
+	if (glewStatus != GLEW_OK) {
+		std::cerr << "Failed to initialize GLEW: " << glewGetErrorString(glewStatus) << std::endl;
+	}
+    InitTextRenderer();
+    framePacer.Init(pacingMode, targetFps);
 
     if(level == 1)
 	{
@@ -7388,11 +9034,17 @@ void main(int argc, char** argv)
 
 	myInit();
 
+    // Models start loading in the background while the car select textures decode
     if (level == 1) {
+        PrefetchAssets();
         loadCars();
         LoadAssets();
+
+        // Level 2 streams in while level 1 is played, so pressing N is just a swap
+        PrefetchAssets2();
     }
     else {
+        PrefetchAssets2();
         loadCars();
         LoadAssets2();
 	
@@ -7407,10 +9059,13 @@ void main(int argc, char** argv)
 
 	glShadeModel(GL_SMOOTH);
 
-	//glut timer 
+	// Frames are started from the idle callback, as fast as the pacing mode allows
+	glutIdleFunc(idle);
 
-	glutTimerFunc(0, timer, 0);  // Start the timer
 
+	// The game state is set up; from here the simulation thread owns it
+	publishSnapshot();
+	simulation.Start(simulationTick);
 
 	glutMainLoop();
 }
@@ -0,0 +1,607 @@
+#include "ShaderLighting.h"
+#include "InstancedDraw.h"
+#include "LightClusters.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glew.h>
+#include <glut.h>
+
+namespace {
+
+const int FIXED_FUNCTION_LIGHTS = 8; // gl_MaxLights in every GL 2.x implementation
+
+// Eye-space position and normal for the fragment shader; instanced variants insert
+// the instance matrix between the modelview and the node matrix
+const char* SCENE_VERTEX_SHADER = R"(
+#ifdef INSTANCED
+attribute mat4 instanceMatrix;
+uniform mat4 nodeMatrix;
+#endif
+varying vec3 eyePosition;
+varying vec3 eyeNormal;
+
+void main() {
+#ifdef INSTANCED
+    vec4 position = gl_ModelViewMatrix * (instanceMatrix * (nodeMatrix * gl_Vertex));
+    // Props only use uniform scales, so normalizing stands in for the inverse transpose
+    eyeNormal = mat3(gl_ModelViewMatrix) * mat3(instanceMatrix) * mat3(nodeMatrix) * gl_Normal;
+#else
+    vec4 position = gl_ModelViewMatrix * gl_Vertex;
+    eyeNormal = gl_NormalMatrix * gl_Normal;
+#endif
+    eyePosition = position.xyz;
+    gl_Position = gl_ProjectionMatrix * position;
+    gl_TexCoord[0] = gl_MultiTexCoord0;
+    gl_FrontColor = gl_Color;
+}
+)";
+
+// The fixed-function lighting equation (single colour, infinite viewer, front
+// material) evaluated per pixel over the light buffer, then GL_MODULATE texturing.
+// Lights [0, lightCount.x) reach every pixel; the rest come from the pixel's cluster
+// list when lightCount.z is set, else all of [lightCount.x, lightCount.y) are applied
+const char* SCENE_FRAGMENT_SHADER = R"(
+varying vec3 eyePosition;
+varying vec3 eyeNormal;
+uniform sampler2D baseTexture;
+
+#ifdef LIGHTING
+uniform sampler2D clusterTexture;
+uniform sampler2D indexTexture;
+
+struct SceneLight {
+    vec4 position;    // Eye space; w = 0 for directional lights
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;    // w = range for bounded lights, else 0
+    vec4 spot;        // Eye-space direction, cosine of the cutoff (-2 for no cone)
+    vec4 attenuation; // Constant, linear, quadratic, spot exponent
+};
+
+layout(std140) uniform SceneLights {
+    ivec4 lightCount;   // Unbounded lights, all lights, clustered
+    vec4 clusterGrid;   // Tile scale, viewport origin
+    vec4 clusterSlices; // Slice scale, 1 / near edge, index texture size
+    SceneLight lights[MAX_SCENE_LIGHTS];
+};
+
+vec3 LightContribution(int i, vec3 normal, vec3 ambientMaterial, vec3 diffuseMaterial) {
+    vec3 toLight = lights[i].position.xyz;
+    float attenuation = 1.0;
+    if (lights[i].position.w != 0.0) {
+        toLight -= eyePosition;
+        float lightDistance = length(toLight);
+        attenuation = 1.0 / (lights[i].attenuation.x + lights[i].attenuation.y * lightDistance
+            + lights[i].attenuation.z * lightDistance * lightDistance);
+        if (lights[i].specular.w > 0.0) {
+            // Fade over the last quarter of the range so cluster edges do not show
+            attenuation *= clamp(4.0 - 4.0 * lightDistance / lights[i].specular.w, 0.0, 1.0);
+        }
+    }
+    toLight = normalize(toLight);
+
+    if (lights[i].spot.w > -1.5) {
+        float spot = dot(-toLight, normalize(lights[i].spot.xyz));
+        attenuation *= spot < lights[i].spot.w ? 0.0 : pow(max(spot, 0.0), lights[i].attenuation.w);
+    }
+
+    float diffuse = max(dot(normal, toLight), 0.0);
+    vec3 contribution = lights[i].ambient.rgb * ambientMaterial + diffuse * lights[i].diffuse.rgb * diffuseMaterial;
+    if (diffuse > 0.0) {
+        float specular = max(dot(normal, normalize(toLight + vec3(0.0, 0.0, 1.0))), 0.0);
+        if (specular > 0.0) {
+            contribution += pow(specular, gl_FrontMaterial.shininess) * lights[i].specular.rgb * gl_FrontMaterial.specular.rgb;
+        }
+    }
+    return attenuation * contribution;
+}
+
+// Light index stored at entry of the cluster lists
+int ClusterEntry(float entry) {
+    vec2 texel = vec2(mod(entry, clusterSlices.z), floor(entry / clusterSlices.z)) + 0.5;
+    return int(texture2D(indexTexture, texel / clusterSlices.zw).r * 255.0 + 0.5);
+}
+#endif
+
+void main() {
+    vec4 color = gl_Color;
+#ifdef LIGHTING
+#ifdef COLOR_MATERIAL
+    vec4 ambientMaterial = gl_Color;
+    vec4 diffuseMaterial = gl_Color;
+#else
+    vec4 ambientMaterial = gl_FrontMaterial.ambient;
+    vec4 diffuseMaterial = gl_FrontMaterial.diffuse;
+#endif
+    vec3 normal = normalize(eyeNormal);
+    vec3 lit = gl_FrontMaterial.emission.rgb + gl_LightModel.ambient.rgb * ambientMaterial.rgb;
+
+    for (int i = 0; i < lightCount.x; ++i) {
+        lit += LightContribution(i, normal, ambientMaterial.rgb, diffuseMaterial.rgb);
+    }
+    if (lightCount.z != 0) {
+        vec2 tile = clamp(floor((gl_FragCoord.xy - clusterGrid.zw) * clusterGrid.xy), vec2(0.0), vec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+        float slice = min(floor(log(max(-eyePosition.z * clusterSlices.y, 1.0)) * clusterSlices.x), float(CLUSTER_Z - 1));
+        vec4 cluster = texture2D(clusterTexture, (vec2(tile.y * float(CLUSTER_X) + tile.x, slice) + 0.5) / vec2(CLUSTER_X * CLUSTER_Y, CLUSTER_Z));
+        float first = floor(cluster.r * 255.0 + 0.5) + floor(cluster.g * 255.0 + 0.5) * 256.0;
+        int count = int(cluster.b * 255.0 + 0.5);
+        for (int k = 0; k < count; ++k) {
+            lit += LightContribution(ClusterEntry(first + float(k)), normal, ambientMaterial.rgb, diffuseMaterial.rgb);
+        }
+    } else {
+        for (int i = lightCount.x; i < lightCount.y; ++i) {
+            lit += LightContribution(i, normal, ambientMaterial.rgb, diffuseMaterial.rgb);
+        }
+    }
+    color = clamp(vec4(lit, diffuseMaterial.a), 0.0, 1.0);
+#endif
+#ifdef TEXTURED
+    color *= texture2D(baseTexture, gl_TexCoord[0].st);
+#endif
+    gl_FragColor = color;
+}
+)";
+
+// std140 mirror of SceneLight
+struct GpuLight {
+    float position[4];
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+    float spot[4];
+    float attenuation[4];
+};
+
+struct LightBlock {
+    int32_t lightCount[4];
+    float clusterGrid[4];
+    float clusterSlices[4];
+    GpuLight lights[MAX_SCENE_LIGHTS];
+};
+
+const size_t LIGHT_BLOCK_HEADER = offsetof(LightBlock, lights);
+
+// Texture units the cluster tables are bound to; unit 0 stays the base texture
+const int CLUSTER_TEXTURE_UNIT = 1;
+const int INDEX_TEXTURE_UNIT = 2;
+
+struct ShaderVariant {
+    GLuint program = 0;
+    GLint nodeMatrix = -1;
+};
+
+ShaderVariant variants[SHADER_VARIANT_COUNT];
+bool compiled = false;       // Compilation was attempted
+bool available = false;
+bool shadingEnabled = true;
+bool clusteringEnabled = true;
+int sceneLightLimit = MAX_SCENE_LIGHTS; // What the driver's uniform block size allows
+GLuint lightBuffer = 0;
+LightBlock lightBlock;
+std::vector<GpuLight> pointLights;
+std::vector<GpuLight> sceneLights;      // Scratch for BeginShading
+
+// Clusters are rebuilt only when the bounded lights, projection or viewport change,
+// so the draws of one frame share a single build and upload
+LightClusters clusters;
+std::vector<ClusterLight> clusterInputs;
+std::vector<ClusterLight> builtInputs;
+GLfloat builtProjection[16] = {};
+GLint builtViewport[4] = {};
+int builtFirstIndex = -1;
+bool clustersBuilt = false;
+GLuint clusterTexture = 0;
+GLuint indexTexture = 0;
+int indexTextureRows = 0;
+int clusteredLights = 0;
+unsigned int passFeatures = 0; // Features of the pass without SHADER_TEXTURED
+int boundVariant = -1;
+
+GLuint CompileShader(GLenum type, const std::string& source) {
+    GLuint shader = glCreateShader(type);
+    const char* text = source.c_str();
+    glShaderSource(shader, 1, &text, nullptr);
+    glCompileShader(shader);
+
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::string log(std::max(length, 1), '\0');
+        glGetShaderInfoLog(shader, length, nullptr, &log[0]);
+        std::cerr << "ShaderLighting: shader compilation failed: " << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader) {
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    // A mat4 attribute takes four consecutive slots starting here
+    glBindAttribLocation(program, INSTANCE_MATRIX_ATTRIB, "instanceMatrix");
+    glLinkProgram(program);
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::string log(std::max(length, 1), '\0');
+        glGetProgramInfoLog(program, length, nullptr, &log[0]);
+        std::cerr << "ShaderLighting: program link failed: " << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+std::string VariantHeader(unsigned int features) {
+    std::string header = "#version 120\n#extension GL_ARB_uniform_buffer_object : require\n";
+    header += "#define MAX_SCENE_LIGHTS " + std::to_string(sceneLightLimit) + "\n";
+    header += "#define CLUSTER_X " + std::to_string(CLUSTER_X) + "\n";
+    header += "#define CLUSTER_Y " + std::to_string(CLUSTER_Y) + "\n";
+    header += "#define CLUSTER_Z " + std::to_string(CLUSTER_Z) + "\n";
+    if (features & SHADER_TEXTURED) {
+        header += "#define TEXTURED\n";
+    }
+    if (features & SHADER_COLOR_MATERIAL) {
+        header += "#define COLOR_MATERIAL\n";
+    }
+    if (features & SHADER_LIGHTING) {
+        header += "#define LIGHTING\n";
+    }
+    if (features & SHADER_INSTANCED) {
+        header += "#define INSTANCED\n";
+    }
+    return header;
+}
+
+// Each vertex shader serves the variants sharing its SHADER_INSTANCED bit and each
+// fragment shader those sharing the other bits, so 16 programs take 10 compiles
+bool CompileVariants() {
+    const unsigned int fragmentBits = SHADER_TEXTURED | SHADER_COLOR_MATERIAL | SHADER_LIGHTING;
+    GLuint vertexShaders[2] = {};
+    GLuint fragmentShaders[fragmentBits + 1] = {};
+    bool ok = true;
+    for (unsigned int instanced = 0; instanced < 2 && ok; ++instanced) {
+        vertexShaders[instanced] = CompileShader(GL_VERTEX_SHADER, VariantHeader(instanced ? SHADER_INSTANCED : 0) + SCENE_VERTEX_SHADER);
+        ok = vertexShaders[instanced] != 0;
+    }
+    for (unsigned int bits = 0; bits <= fragmentBits && ok; ++bits) {
+        fragmentShaders[bits] = CompileShader(GL_FRAGMENT_SHADER, VariantHeader(bits) + SCENE_FRAGMENT_SHADER);
+        ok = fragmentShaders[bits] != 0;
+    }
+
+    for (unsigned int features = 0; features < SHADER_VARIANT_COUNT && ok; ++features) {
+        ShaderVariant& variant = variants[features];
+        variant.program = LinkProgram(vertexShaders[(features & SHADER_INSTANCED) ? 1 : 0], fragmentShaders[features & fragmentBits]);
+        if (!variant.program) {
+            ok = false;
+            break;
+        }
+
+        GLuint block = glGetUniformBlockIndex(variant.program, "SceneLights");
+        if (block != GL_INVALID_INDEX) {
+            glUniformBlockBinding(variant.program, block, 0);
+        }
+        variant.nodeMatrix = glGetUniformLocation(variant.program, "nodeMatrix");
+        glUseProgram(variant.program);
+        glUniform1i(glGetUniformLocation(variant.program, "baseTexture"), 0);
+        glUniform1i(glGetUniformLocation(variant.program, "clusterTexture"), CLUSTER_TEXTURE_UNIT);
+        glUniform1i(glGetUniformLocation(variant.program, "indexTexture"), INDEX_TEXTURE_UNIT);
+    }
+    glUseProgram(0);
+
+    for (GLuint shader : vertexShaders) {
+        if (shader) {
+            glDeleteShader(shader);
+        }
+    }
+    for (GLuint shader : fragmentShaders) {
+        if (shader) {
+            glDeleteShader(shader);
+        }
+    }
+    return ok;
+}
+
+GLsizeiptr LightBlockSize() {
+    return static_cast<GLsizeiptr>(LIGHT_BLOCK_HEADER + sceneLightLimit * sizeof(GpuLight));
+}
+
+// Texture the shader reads texel by texel; left bound on the current unit
+GLuint CreateTableTexture() {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+void CompileShading() {
+    compiled = true;
+    if (!GLEW_VERSION_2_0 || !(GLEW_VERSION_3_1 || GLEW_ARB_uniform_buffer_object)) {
+        std::cout << "ShaderLighting: no GLSL or uniform buffers, meshes keep fixed-function lighting" << std::endl;
+        return;
+    }
+
+    GLint blockSize = 16384; // The minimum GL guarantees
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &blockSize);
+    sceneLightLimit = std::min(MAX_SCENE_LIGHTS, static_cast<int>((blockSize - LIGHT_BLOCK_HEADER) / sizeof(GpuLight)));
+
+    if (!CompileVariants()) {
+        for (ShaderVariant& variant : variants) {
+            if (variant.program) {
+                glDeleteProgram(variant.program);
+            }
+            variant = ShaderVariant();
+        }
+        return;
+    }
+
+    glGenBuffers(1, &lightBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, LightBlockSize(), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    clusterTexture = CreateTableTexture();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    indexTexture = CreateTableTexture();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    available = true;
+}
+
+void CopyVector(float* dst, const float* src, float w) {
+    dst[0] = src[0];
+    dst[1] = src[1];
+    dst[2] = src[2];
+    dst[3] = w;
+}
+
+// An enabled GL_LIGHTi as the fixed-function pipeline would use it
+GpuLight ReadFixedFunctionLight(GLenum light) {
+    GpuLight packed;
+    glGetLightfv(light, GL_POSITION, packed.position);
+    glGetLightfv(light, GL_AMBIENT, packed.ambient);
+    glGetLightfv(light, GL_DIFFUSE, packed.diffuse);
+    glGetLightfv(light, GL_SPECULAR, packed.specular);
+    glGetLightfv(light, GL_SPOT_DIRECTION, packed.spot);
+
+    GLfloat cutoff = 180.0f;
+    glGetLightfv(light, GL_SPOT_CUTOFF, &cutoff);
+    packed.spot[3] = cutoff >= 180.0f ? -2.0f : cosf(cutoff * 3.14159265f / 180.0f);
+    glGetLightfv(light, GL_CONSTANT_ATTENUATION, &packed.attenuation[0]);
+    glGetLightfv(light, GL_LINEAR_ATTENUATION, &packed.attenuation[1]);
+    glGetLightfv(light, GL_QUADRATIC_ATTENUATION, &packed.attenuation[2]);
+    glGetLightfv(light, GL_SPOT_EXPONENT, &packed.attenuation[3]);
+    return packed;
+}
+
+float BrightestColor(const GpuLight& light) {
+    float brightest = 0.0f;
+    for (int c = 0; c < 3; ++c) {
+        brightest = std::max({ brightest, light.ambient[c], light.diffuse[c], light.specular[c] });
+    }
+    return brightest;
+}
+
+// Distance at which a positional light's attenuation takes it below LIGHT_CUTOFF
+// of brightest; 0 when it never gets there, negative when it never gets above it
+float LightRange(const GpuLight& light, float brightest) {
+    const float* attenuation = light.attenuation;
+    if (light.position[3] == 0.0f || (attenuation[1] <= 0.0f && attenuation[2] <= 0.0f)) {
+        return 0.0f;
+    }
+
+    // Solve constant + linear * d + quadratic * d^2 = brightest / cutoff
+    float excess = brightest / LIGHT_CUTOFF - attenuation[0];
+    if (excess <= 0.0f) {
+        return -1.0f;
+    }
+    if (attenuation[2] > 0.0f) {
+        float discriminant = attenuation[1] * attenuation[1] + 4.0f * attenuation[2] * excess;
+        return (std::sqrt(discriminant) - attenuation[1]) / (2.0f * attenuation[2]);
+    }
+    return excess / attenuation[1];
+}
+
+// Rebuilds the cluster tables from clusterInputs when anything they depend on moved
+void UpdateClusters(int firstIndex) {
+    GLfloat projection[16];
+    GLint viewport[4];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (clustersBuilt && builtInputs.size() == clusterInputs.size()
+        && memcmp(builtInputs.data(), clusterInputs.data(), clusterInputs.size() * sizeof(ClusterLight)) == 0
+        && memcmp(builtProjection, projection, sizeof(projection)) == 0 && memcmp(builtViewport, viewport, sizeof(viewport)) == 0
+        && builtFirstIndex == firstIndex) {
+        return;
+    }
+    builtInputs = clusterInputs;
+    builtFirstIndex = firstIndex;
+    memcpy(builtProjection, projection, sizeof(projection));
+    memcpy(builtViewport, viewport, sizeof(viewport));
+    clustersBuilt = clusters.Build(projection, viewport, clusterInputs.data(), static_cast<int>(clusterInputs.size()), firstIndex);
+    if (!clustersBuilt) {
+        return;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, clusterTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, GL_RGBA, GL_UNSIGNED_BYTE, clusters.ClusterTexels().data());
+    glBindTexture(GL_TEXTURE_2D, indexTexture);
+    if (clusters.IndexRows() != indexTextureRows) {
+        indexTextureRows = clusters.IndexRows();
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, INDEX_TEXTURE_WIDTH, indexTextureRows, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, clusters.Indices().data());
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, INDEX_TEXTURE_WIDTH, indexTextureRows, GL_LUMINANCE, GL_UNSIGNED_BYTE, clusters.Indices().data());
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+} // namespace
+
+bool ShadingAvailable() {
+    if (!compiled) {
+        CompileShading();
+    }
+    return available;
+}
+
+void SetShadingEnabled(bool enabled) {
+    shadingEnabled = enabled;
+}
+
+bool ShadingEnabled() {
+    return shadingEnabled;
+}
+
+void SetClusteringEnabled(bool enabled) {
+    clusteringEnabled = enabled;
+}
+
+bool ClusteringEnabled() {
+    return clusteringEnabled;
+}
+
+void SetPointLights(const PointLight* lights, int count) {
+    GLfloat modelView[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelView);
+
+    pointLights.resize(count);
+    for (int i = 0; i < count; ++i) {
+        const PointLight& light = lights[i];
+        GpuLight& packed = pointLights[i];
+        for (int row = 0; row < 3; ++row) {
+            packed.position[row] = modelView[row] * light.position[0] + modelView[4 + row] * light.position[1]
+                + modelView[8 + row] * light.position[2] + modelView[12 + row];
+        }
+        packed.position[3] = 1.0f;
+        const float black[3] = { 0.0f, 0.0f, 0.0f };
+        CopyVector(packed.ambient, black, 1.0f);
+        CopyVector(packed.diffuse, light.color, 1.0f);
+        CopyVector(packed.specular, light.color, 1.0f);
+        CopyVector(packed.spot, black, -2.0f); // No cone
+        CopyVector(packed.attenuation, light.attenuation, 0.0f);
+        packed.specular[3] = LightRange(packed, light.peak > 0.0f ? light.peak : BrightestColor(packed));
+    }
+}
+
+void BeginShading(unsigned int features) {
+    sceneLights.clear();
+    for (int i = 0; i < FIXED_FUNCTION_LIGHTS; ++i) {
+        if (glIsEnabled(GL_LIGHT0 + i)) {
+            sceneLights.push_back(ReadFixedFunctionLight(GL_LIGHT0 + i));
+            sceneLights.back().specular[3] = LightRange(sceneLights.back(), BrightestColor(sceneLights.back()));
+        }
+    }
+    sceneLights.insert(sceneLights.end(), pointLights.begin(), pointLights.end());
+
+    // Unbounded lights first, then the bounded ones the clusters index; specular.w holds the range
+    int count = 0;
+    for (const GpuLight& light : sceneLights) {
+        if (light.specular[3] == 0.0f && count < sceneLightLimit) {
+            lightBlock.lights[count++] = light;
+        }
+    }
+    int unbounded = count;
+    clusterInputs.clear();
+    for (const GpuLight& light : sceneLights) {
+        if (light.specular[3] > 0.0f && count < sceneLightLimit) {
+            lightBlock.lights[count++] = light;
+            ClusterLight bounds = { { light.position[0], light.position[1], light.position[2] }, light.specular[3] };
+            clusterInputs.push_back(bounds);
+        }
+    }
+    lightBlock.lightCount[0] = unbounded;
+    lightBlock.lightCount[1] = count;
+    lightBlock.lightCount[2] = 0;
+    clusteredLights = 0;
+
+    if (clusteringEnabled && !clusterInputs.empty()) {
+        UpdateClusters(unbounded);
+    }
+    if (clusteringEnabled && !clusterInputs.empty() && clustersBuilt) {
+        const ClusterGrid& grid = clusters.Grid();
+        lightBlock.lightCount[2] = 1;
+        lightBlock.clusterGrid[0] = grid.tileScale[0];
+        lightBlock.clusterGrid[1] = grid.tileScale[1];
+        lightBlock.clusterGrid[2] = grid.viewportOrigin[0];
+        lightBlock.clusterGrid[3] = grid.viewportOrigin[1];
+        lightBlock.clusterSlices[0] = grid.sliceScale;
+        lightBlock.clusterSlices[1] = grid.inverseNear;
+        lightBlock.clusterSlices[2] = static_cast<float>(INDEX_TEXTURE_WIDTH);
+        lightBlock.clusterSlices[3] = static_cast<float>(clusters.IndexRows());
+        clusteredLights = count - unbounded;
+
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, clusterTexture);
+        glActiveTexture(GL_TEXTURE0 + INDEX_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Orphan the previous contents so the driver need not wait for draws still reading them
+    GLsizeiptr size = static_cast<GLsizeiptr>(LIGHT_BLOCK_HEADER + count * sizeof(GpuLight));
+    glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, LightBlockSize(), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, &lightBlock);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, lightBuffer);
+
+    passFeatures = features & SHADER_INSTANCED;
+    if (glIsEnabled(GL_LIGHTING)) {
+        passFeatures |= SHADER_LIGHTING;
+    }
+    if (glIsEnabled(GL_COLOR_MATERIAL)) {
+        passFeatures |= SHADER_COLOR_MATERIAL;
+    }
+    boundVariant = -1;
+}
+
+void SetShadingTextured(bool textured) {
+    int variant = static_cast<int>(passFeatures | (textured ? SHADER_TEXTURED : 0));
+    if (variant != boundVariant) {
+        glUseProgram(variants[variant].program);
+        boundVariant = variant;
+    }
+}
+
+void SetShaderNodeMatrix(const float* matrix) {
+    if (boundVariant >= 0) {
+        glUniformMatrix4fv(variants[boundVariant].nodeMatrix, 1, GL_FALSE, matrix);
+    }
+}
+
+void EndShading() {
+    glUseProgram(0);
+    boundVariant = -1;
+}
+
+int ShadedLightCount() {
+    return lightBlock.lightCount[1];
+}
+
+int ClusteredLightCount() {
+    return clusteredLights;
+}
+
+int BusiestClusterLightCount() {
+    return clusteredLights > 0 ? clusters.BusiestCluster() : 0;
+}
@@ -0,0 +1,80 @@
+#ifndef SHADERLIGHTING_H
+#define SHADERLIGHTING_H
+
+// Per-pixel lighting for everything GLTFAsset draws (glTF and cooked 3DS meshes,
+// queued, immediate and instanced). The lights are the fixed-function ones the game
+// code sets up (GL_LIGHT0-7, as glLightfv left them in eye space) plus a list of
+// point lights beyond that limit, packed together into one uniform buffer per pass.
+// Material, colour and texture come from the same GL state the fixed-function path
+// reads, so switching between the two changes shading quality, not inputs.
+//
+// Programs are GLSL 1.20 with ARB_uniform_buffer_object. Every combination of
+// ShaderFeature bits is compiled up front, so binding a variant never compiles.
+//
+// Lights whose attenuation brings them below LIGHT_CUTOFF within some range (the
+// streetlights) are culled per pixel through LightClusters; unbounded ones (the sun,
+// the headlights) are applied everywhere.
+
+enum ShaderFeature {
+    SHADER_TEXTURED = 1,       // Modulate by the texture on unit 0, as GL_MODULATE does
+    SHADER_COLOR_MATERIAL = 2, // glColor is the ambient and diffuse material (GL_COLOR_MATERIAL)
+    SHADER_LIGHTING = 4,       // Without it the colour passes through, as with GL_LIGHTING off
+    SHADER_INSTANCED = 8       // instanceMatrix attribute and nodeMatrix uniform (see InstancedDraw.h)
+};
+
+const unsigned int SHADER_VARIANT_COUNT = 16;
+
+// Fixed-function lights plus point lights the light buffer holds; further lights are
+// dropped. Fewer where uniform blocks cannot hold this many (under 24 KB)
+const int MAX_SCENE_LIGHTS = 256;
+
+// Fraction of its brightest colour below which a bounded light's contribution is cut off
+const float LIGHT_CUTOFF = 1.0f / 64.0f;
+
+// Omnidirectional light with fixed-function style attenuation
+struct PointLight {
+    float position[3];    // Through the modelview current at SetPointLights, like glLightfv
+    float color[3];       // Diffuse and specular
+    float attenuation[3]; // Constant, linear, quadratic
+    float peak;           // Brightest channel the colour ever reaches (a flickering lamp's maximum), 0 for the colour's own.
+                          // The light's range comes from it, so flicker alone does not rebuild the clusters
+};
+
+// True when the driver has GLSL and uniform buffers and every variant linked.
+// Compiles on the first call, which must come after glewInit
+bool ShadingAvailable();
+
+// Switch for comparing against fixed-function lighting; instanced draws always use the shaders
+void SetShadingEnabled(bool enabled);
+bool ShadingEnabled();
+
+// Switch for comparing clustered culling against looping over every light per pixel
+void SetClusteringEnabled(bool enabled);
+bool ClusteringEnabled();
+
+// Replaces the point lights. They stay until the next call, so set them every frame
+// the camera moves, before the draws that should see them
+void SetPointLights(const PointLight* lights, int count);
+
+// Gathers the enabled fixed-function lights and the point lights into the light
+// buffer, bins the bounded ones into clusters for the current projection and
+// viewport (only when one of them changed) and reads the GL_LIGHTING and
+// GL_COLOR_MATERIAL enables. Binds texture units 1 and 2 and leaves unit 0 active.
+// features may add SHADER_INSTANCED. Call once before a run of draws with unchanged lights
+void BeginShading(unsigned int features = 0);
+
+// Binds the variant for the current pass with or without texturing; cheap when unchanged
+void SetShadingTextured(bool textured);
+
+// Transform applied inside each instance, column-major; instanced passes only
+void SetShaderNodeMatrix(const float* matrix);
+
+void EndShading();
+
+// Lights the last BeginShading packed, and how many of them went through the clusters
+// with the longest cluster list, for the stats line
+int ShadedLightCount();
+int ClusteredLightCount();
+int BusiestClusterLightCount();
+
+#endif
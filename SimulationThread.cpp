@@ -0,0 +1,36 @@
+#include "SimulationThread.h"
+#include <chrono>
+
+void SimulationThread::Start(std::function<void(int, float)> tickFunction) {
+    Stop();
+    tick = tickFunction;
+    stopping = false;
+    clock.Reset();
+    thread = std::thread([this]() { Run(); });
+}
+
+void SimulationThread::Stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+void SimulationThread::Run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        lock.unlock();
+        int steps = clock.Advance();
+        tick(steps, clock.Step());
+        lock.lock();
+
+        // Until the next step is due; a late wake-up is made up by the next Advance
+        std::chrono::duration<double> untilNextStep((1.0 - clock.Alpha()) * clock.Step());
+        wake.wait_for(lock, untilNextStep, [this]() { return stopping; });
+    }
+}
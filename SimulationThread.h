@@ -0,0 +1,37 @@
+#ifndef SIMULATIONTHREAD_H
+#define SIMULATIONTHREAD_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "FixedStep.h"
+
+// Runs a fixed-step simulation on its own thread, so game logic keeps its rate
+// however long the GLUT thread spends drawing. The thread wakes when the next step
+// is due and calls tick with the number of steps owed (0 when it woke early) and
+// the step length. Locking the game state and publishing what the frame should
+// draw are the tick's business.
+class SimulationThread {
+public:
+    SimulationThread(double stepSeconds, int maxStepsPerTick) : clock(stepSeconds, maxStepsPerTick) {}
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+    ~SimulationThread() { Stop(); }
+
+    void Start(std::function<void(int, float)> tick);
+    // Waits for the current tick to finish; the caller must not hold anything the tick locks
+    void Stop();
+
+private:
+    void Run();
+
+    FixedStep clock;
+    std::function<void(int, float)> tick;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "SkyDome.h"
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+#include <glew.h>
+#include <glut.h>
+
+namespace {
+
+const int SKY_SLICES = 64;
+const int SKY_STACKS = 32;
+const float SKY_RADIUS = 1000.0f; // Any radius between the clip planes looks the same
+
+struct SkyVertex {
+    float position[3];
+    float texcoord[2];
+};
+
+GLuint vertexBuffer = 0;
+GLuint indexBuffer = 0;
+GLsizei indexCount = 0;
+GLuint skyTexture = 0;
+
+} // namespace
+
+bool CreateSkyDome(unsigned int texture) {
+    DestroySkyDome();
+    if (!GLEW_VERSION_1_5) {
+        std::cerr << "SkyDome: no buffer objects, the sky stays the clear colour" << std::endl;
+        return false;
+    }
+
+    // gluSphere's layout: stacks from +z to -z, slices around z, t running 1 to 0
+    // down the stacks and s 1 to 0 around them, with a duplicated seam column
+    std::vector<SkyVertex> vertices;
+    vertices.reserve((SKY_STACKS + 1) * (SKY_SLICES + 1));
+    const float pi = 3.14159265f;
+    for (int stack = 0; stack <= SKY_STACKS; ++stack) {
+        float rho = stack * pi / SKY_STACKS;
+        for (int slice = 0; slice <= SKY_SLICES; ++slice) {
+            float theta = slice * 2.0f * pi / SKY_SLICES;
+            SkyVertex vertex = { { SKY_RADIUS * sinf(rho) * sinf(theta), SKY_RADIUS * sinf(rho) * cosf(theta), SKY_RADIUS * cosf(rho) },
+                { 1.0f - static_cast<float>(slice) / SKY_SLICES, 1.0f - static_cast<float>(stack) / SKY_STACKS } };
+            vertices.push_back(vertex);
+        }
+    }
+
+    std::vector<GLushort> indices;
+    indices.reserve(SKY_STACKS * SKY_SLICES * 6);
+    for (int stack = 0; stack < SKY_STACKS; ++stack) {
+        for (int slice = 0; slice < SKY_SLICES; ++slice) {
+            GLushort top = static_cast<GLushort>(stack * (SKY_SLICES + 1) + slice);
+            GLushort bottom = static_cast<GLushort>(top + SKY_SLICES + 1);
+            GLushort quad[6] = { top, bottom, static_cast<GLushort>(top + 1), static_cast<GLushort>(top + 1), bottom, static_cast<GLushort>(bottom + 1) };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(SkyVertex), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    indexCount = static_cast<GLsizei>(indices.size());
+    skyTexture = texture;
+    return true;
+}
+
+void DrawSkyDome(const float* tint) {
+    if (!vertexBuffer) {
+        return;
+    }
+
+    // Depth pinned to the far plane and tested against the cleared value, without writing it
+    glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT | GL_VIEWPORT_BIT | GL_CURRENT_BIT | GL_TEXTURE_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_LEQUAL);
+    glDepthRange(1.0, 1.0);
+    glBindTexture(GL_TEXTURE_2D, skyTexture);
+    glColor3fv(tint);
+
+    // The view's rotation only, so the dome stays centred on the eye
+    GLfloat view[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, view);
+    view[12] = view[13] = view[14] = 0.0f;
+    glPushMatrix();
+    glLoadMatrixf(view);
+    glRotatef(90.0f, 1.0f, 0.0f, 1.0f); // The orientation the level's texture was placed for
+
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(SkyVertex), reinterpret_cast<const void*>(offsetof(SkyVertex, position)));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(SkyVertex), reinterpret_cast<const void*>(offsetof(SkyVertex, texcoord)));
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, nullptr);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glPopClientAttrib();
+
+    glPopMatrix();
+    glPopAttrib();
+}
+
+void DestroySkyDome() {
+    if (vertexBuffer) {
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+    }
+    vertexBuffer = 0;
+    indexBuffer = 0;
+    indexCount = 0;
+    skyTexture = 0;
+}
@@ -0,0 +1,20 @@
+#ifndef SKYDOME_H
+#define SKYDOME_H
+
+// Textured sky sphere for the first level, built once into buffer objects instead of
+// a gluSphere per frame. It keeps gluSphere's texture mapping and the orientation
+// the level used, but follows the eye, and is drawn after the scene at the far
+// plane (glDepthRange 1..1 with GL_LEQUAL) so only pixels nothing else covered are
+// shaded. Time-of-day colour is a per-draw tint, so nothing is rebuilt as it changes.
+
+// Builds the dome around `texture` (which stays owned by the caller). Needs GL 1.5
+// buffer objects, so call it after glewInit. Returns false when the driver has none
+bool CreateSkyDome(unsigned int texture);
+
+// Draws the dome modulated by tint (RGB). Call once the opaque scene is drawn, with
+// the camera's modelview current; lighting, depth and texture state are restored
+void DrawSkyDome(const float* tint);
+
+void DestroySkyDome();
+
+#endif
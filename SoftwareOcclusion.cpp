@@ -0,0 +1,284 @@
+#include "SoftwareOcclusion.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const int TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE;
+const int TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE;
+
+struct ClipVertex {
+    float x, y, z, w;
+};
+
+ClipVertex Transform(const float* m, const float* p) {
+    return {
+        m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12],
+        m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+        m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14],
+        m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15]
+    };
+}
+
+// Signed distance to the GL near plane (z = -w), positive in front of it
+float NearDistance(const ClipVertex& v) {
+    return v.z + v.w;
+}
+
+ClipVertex Lerp(const ClipVertex& a, const ClipVertex& b, float t) {
+    return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t };
+}
+
+// Clips a triangle against the near plane; the result has 0, 3 or 4 vertices
+int ClipNear(const ClipVertex* in, ClipVertex* out) {
+    int count = 0;
+    for (int i = 0; i < 3; ++i) {
+        const ClipVertex& a = in[i];
+        const ClipVertex& b = in[(i + 1) % 3];
+        float da = NearDistance(a);
+        float db = NearDistance(b);
+        if (da >= 0.0f) {
+            out[count++] = a;
+        }
+        // Always interpolated from the vertex in front, so the two triangles sharing an
+        // edge get bit-identical points and no crack opens between them
+        if (da >= 0.0f && db < 0.0f) {
+            out[count++] = Lerp(a, b, da / (da - db));
+        }
+        else if (da < 0.0f && db >= 0.0f) {
+            out[count++] = Lerp(b, a, db / (db - da));
+        }
+    }
+    return count;
+}
+
+// Whole triangle beyond one of the side planes
+bool OutsideSides(const ClipVertex* v) {
+    return (v[0].x > v[0].w && v[1].x > v[1].w && v[2].x > v[2].w)
+        || (v[0].x < -v[0].w && v[1].x < -v[1].w && v[2].x < -v[2].w)
+        || (v[0].y > v[0].w && v[1].y > v[1].w && v[2].y > v[2].w)
+        || (v[0].y < -v[0].w && v[1].y < -v[1].w && v[2].y < -v[2].w);
+}
+
+} // namespace
+
+OcclusionBuffer::OcclusionBuffer()
+    : depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f), tileDepth(TILES_X * TILES_Y, 1.0f) {
+}
+
+void OcclusionBuffer::Clear() {
+    std::fill(depth.begin(), depth.end(), 1.0f);
+    std::fill(tileDepth.begin(), tileDepth.end(), 1.0f);
+}
+
+void OcclusionBuffer::RasterizeTriangles(const float* clipMatrix, const float* positions, size_t vertexCount,
+    size_t positionStride, const uint32_t* indices, size_t indexCount) {
+    clipVertices.resize(vertexCount * 4);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(positions) + v * positionStride);
+        ClipVertex c = Transform(clipMatrix, p);
+        clipVertices[v * 4] = c.x;
+        clipVertices[v * 4 + 1] = c.y;
+        clipVertices[v * 4 + 2] = c.z;
+        clipVertices[v * 4 + 3] = c.w;
+    }
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        ClipVertex triangle[3];
+        bool valid = true;
+        for (int k = 0; k < 3; ++k) {
+            uint32_t index = indices[i + k];
+            if (index >= vertexCount) {
+                valid = false;
+                break;
+            }
+            const float* c = &clipVertices[index * 4];
+            triangle[k] = { c[0], c[1], c[2], c[3] };
+        }
+        if (!valid || OutsideSides(triangle)) {
+            continue;
+        }
+
+        ClipVertex clipped[4];
+        int count = ClipNear(triangle, clipped);
+        float x[4], y[4], z[4];
+        for (int k = 0; k < count; ++k) {
+            float invW = 1.0f / clipped[k].w;
+            x[k] = (clipped[k].x * invW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+            y[k] = (clipped[k].y * invW * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+            z[k] = clipped[k].z * invW;
+        }
+        for (int k = 2; k < count; ++k) {
+            float fanX[3] = { x[0], x[k - 1], x[k] };
+            float fanY[3] = { y[0], y[k - 1], y[k] };
+            float fanZ[3] = { z[0], z[k - 1], z[k] };
+            DrawTriangle(fanX, fanY, fanZ);
+        }
+    }
+}
+
+// Half-space rasterization at pixel centres, four pixels of a row at a time. Depth is
+// affine in screen space, so it is evaluated as a plane like the edge functions
+void OcclusionBuffer::DrawTriangle(const float* x, const float* y, const float* z) {
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (std::fabs(area) < 1e-6f) {
+        return;
+    }
+    int b = 1, c = 2;
+    if (area < 0.0f) {
+        std::swap(b, c);
+        area = -area;
+    }
+    const int corner[3] = { 0, b, c };
+
+    int minX = std::max(0, static_cast<int>(std::floor(std::min(x[0], std::min(x[1], x[2])))));
+    int maxX = std::min(OCCLUSION_WIDTH - 1, static_cast<int>(std::floor(std::max(x[0], std::max(x[1], x[2])))));
+    int minY = std::max(0, static_cast<int>(std::floor(std::min(y[0], std::min(y[1], y[2])))));
+    int maxY = std::min(OCCLUSION_HEIGHT - 1, static_cast<int>(std::floor(std::max(y[0], std::max(y[1], y[2])))));
+    if (minX > maxX || minY > maxY) {
+        return;
+    }
+
+    // Edge k runs between the two corners other than corner k and is positive on the inside;
+    // divided by the area it is corner k's barycentric weight
+    float edgeA[3], edgeB[3], edgeC[3];
+    for (int k = 0; k < 3; ++k) {
+        int from = corner[(k + 1) % 3];
+        int to = corner[(k + 2) % 3];
+        edgeA[k] = y[from] - y[to];
+        edgeB[k] = x[to] - x[from];
+        edgeC[k] = x[from] * y[to] - x[to] * y[from];
+    }
+    float z0 = z[corner[0]], z1 = z[corner[1]], z2 = z[corner[2]];
+    float invArea = 1.0f / area;
+    float depthA = (edgeA[0] * z0 + edgeA[1] * z1 + edgeA[2] * z2) * invArea;
+    float depthB = (edgeB[0] * z0 + edgeB[1] * z1 + edgeB[2] * z2) * invArea;
+    float depthC = (edgeC[0] * z0 + edgeC[1] * z1 + edgeC[2] * z2) * invArea;
+
+    int startX = minX & ~3;
+#ifdef OCCLUSION_SSE2
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 a0 = _mm_set1_ps(edgeA[0]), a1 = _mm_set1_ps(edgeA[1]), a2 = _mm_set1_ps(edgeA[2]);
+    __m128 depthStepX = _mm_set1_ps(depthA);
+    for (int py = minY; py <= maxY; ++py) {
+        float centerY = py + 0.5f;
+        __m128 rowE0 = _mm_set1_ps(edgeB[0] * centerY + edgeC[0]);
+        __m128 rowE1 = _mm_set1_ps(edgeB[1] * centerY + edgeC[1]);
+        __m128 rowE2 = _mm_set1_ps(edgeB[2] * centerY + edgeC[2]);
+        __m128 rowDepth = _mm_set1_ps(depthB * centerY + depthC);
+        float* row = &depth[py * OCCLUSION_WIDTH];
+
+        for (int px = startX; px <= maxX; px += 4) {
+            __m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(px)), laneOffsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, centerX), rowE0);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, centerX), rowE1);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, centerX), rowE2);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+
+            __m128 triangleDepth = _mm_add_ps(_mm_mul_ps(depthStepX, centerX), rowDepth);
+            __m128 stored = _mm_loadu_ps(row + px);
+            __m128 nearest = _mm_min_ps(stored, triangleDepth);
+            _mm_storeu_ps(row + px, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+        }
+    }
+#else
+    for (int py = minY; py <= maxY; ++py) {
+        float centerY = py + 0.5f;
+        float* row = &depth[py * OCCLUSION_WIDTH];
+        for (int px = startX; px <= maxX; ++px) {
+            float centerX = px + 0.5f;
+            if (edgeA[0] * centerX + edgeB[0] * centerY + edgeC[0] < 0.0f ||
+                edgeA[1] * centerX + edgeB[1] * centerY + edgeC[1] < 0.0f ||
+                edgeA[2] * centerX + edgeB[2] * centerY + edgeC[2] < 0.0f) {
+                continue;
+            }
+            row[px] = std::min(row[px], depthA * centerX + depthB * centerY + depthC);
+        }
+    }
+#endif
+}
+
+void OcclusionBuffer::Finish() {
+    for (int ty = 0; ty < TILES_Y; ++ty) {
+        for (int tx = 0; tx < TILES_X; ++tx) {
+            const float* tile = &depth[ty * OCCLUSION_TILE * OCCLUSION_WIDTH + tx * OCCLUSION_TILE];
+#ifdef OCCLUSION_SSE2
+            __m128 farthest = _mm_set1_ps(-1.0f);
+            for (int row = 0; row < OCCLUSION_TILE; ++row) {
+                const float* pixels = tile + row * OCCLUSION_WIDTH;
+                farthest = _mm_max_ps(farthest, _mm_max_ps(_mm_loadu_ps(pixels), _mm_loadu_ps(pixels + 4)));
+            }
+            farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+            farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+            tileDepth[ty * TILES_X + tx] = _mm_cvtss_f32(farthest);
+#else
+            float farthest = -1.0f;
+            for (int row = 0; row < OCCLUSION_TILE; ++row) {
+                for (int column = 0; column < OCCLUSION_TILE; ++column) {
+                    farthest = std::max(farthest, tile[row * OCCLUSION_WIDTH + column]);
+                }
+            }
+            tileDepth[ty * TILES_X + tx] = farthest;
+#endif
+        }
+    }
+}
+
+bool OcclusionBuffer::IsBoxVisible(const float* clipMatrix, const float* boxMin, const float* boxMax) const {
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearestDepth = FLT_MAX;
+    for (int i = 0; i < 8; ++i) {
+        float corner[3] = { (i & 1) ? boxMax[0] : boxMin[0], (i & 2) ? boxMax[1] : boxMin[1], (i & 4) ? boxMax[2] : boxMin[2] };
+        ClipVertex c = Transform(clipMatrix, corner);
+        if (c.w <= 1e-6f || NearDistance(c) < 0.0f) {
+            return true;
+        }
+        float invW = 1.0f / c.w;
+        float x = (c.x * invW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+        float y = (c.y * invW * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearestDepth = std::min(nearestDepth, c.z * invW);
+    }
+
+    // Every pixel whose area the projected box touches
+    int x0 = std::max(0, static_cast<int>(std::floor(minX)));
+    int x1 = std::min(OCCLUSION_WIDTH - 1, static_cast<int>(std::floor(maxX)));
+    int y0 = std::max(0, static_cast<int>(std::floor(minY)));
+    int y1 = std::min(OCCLUSION_HEIGHT - 1, static_cast<int>(std::floor(maxY)));
+    if (x0 > x1 || y0 > y1) {
+        return true; // Off screen, which is the frustum test's call
+    }
+
+    for (int ty = y0 / OCCLUSION_TILE; ty <= y1 / OCCLUSION_TILE; ++ty) {
+        for (int tx = x0 / OCCLUSION_TILE; tx <= x1 / OCCLUSION_TILE; ++tx) {
+            if (nearestDepth > tileDepth[ty * TILES_X + tx]) {
+                continue; // The whole tile is in front of the box
+            }
+
+            // Some pixel of the tile is at or behind the box; check the ones the box covers
+            int py0 = std::max(y0, ty * OCCLUSION_TILE), py1 = std::min(y1, ty * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+            int px0 = std::max(x0, tx * OCCLUSION_TILE), px1 = std::min(x1, tx * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+            for (int py = py0; py <= py1; ++py) {
+                for (int px = px0; px <= px1; ++px) {
+                    if (depth[py * OCCLUSION_WIDTH + px] >= nearestDepth) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,49 @@
+#ifndef SOFTWAREOCCLUSION_H
+#define SOFTWAREOCCLUSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Low-resolution software depth buffer for occlusion culling. Occluder triangles are
+// rasterized on the CPU, then reduced into 8x8-pixel tiles that keep their farthest
+// depth, and bounding boxes are rejected when their nearest point lies behind the
+// occluders over every pixel they cover. Touches no GL state, so a worker thread can
+// fill and query one while the GL thread draws.
+//
+// Matrices are column-major clip matrices (projection * modelview * model) mapping
+// the given positions to GL clip space; depth is stored as NDC z, -1 near to 1 far.
+
+const int OCCLUSION_WIDTH = 256;  // Multiple of OCCLUSION_TILE and of 4 (the SIMD width)
+const int OCCLUSION_HEIGHT = 128;
+const int OCCLUSION_TILE = 8;
+
+class OcclusionBuffer {
+public:
+    OcclusionBuffer();
+
+    // Resets every pixel to the far plane
+    void Clear();
+
+    // Rasterizes an indexed triangle list into the depth buffer. positions points at the
+    // first vertex's xyz floats, positionStride is the byte distance between vertices.
+    // Triangles are drawn regardless of facing and clipped against the near plane
+    void RasterizeTriangles(const float* clipMatrix, const float* positions, size_t vertexCount, size_t positionStride,
+        const uint32_t* indices, size_t indexCount);
+
+    // Builds the tile depths; call after the last RasterizeTriangles and before testing boxes
+    void Finish();
+
+    // False only when the box is certainly hidden behind what has been rasterized.
+    // Boxes crossing the near plane are always visible
+    bool IsBoxVisible(const float* clipMatrix, const float* boxMin, const float* boxMax) const;
+
+private:
+    std::vector<float> depth;     // OCCLUSION_WIDTH * OCCLUSION_HEIGHT, row by row from the bottom
+    std::vector<float> tileDepth; // Farthest depth of each tile
+    std::vector<float> clipVertices; // Scratch xyzw per vertex for RasterizeTriangles
+
+    void DrawTriangle(const float* x, const float* y, const float* z);
+};
+
+#endif
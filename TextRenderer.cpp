@@ -0,0 +1,303 @@
+#include "TextRenderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <glew.h>
+#include <glut.h>
+
+namespace {
+
+const int FIRST_GLYPH = 32;  // Space
+const int LAST_GLYPH = 126;  // Tilde
+const int GLYPH_COUNT = LAST_GLYPH - FIRST_GLYPH + 1;
+const int ATLAS_COLUMNS = 16;
+const int ATLAS_ROWS = (GLYPH_COUNT + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS;
+const int GLYPH_PADDING = 2; // Room left of the pen for glyphs that start before it
+
+// A face's cells in the atlas: each glyph is drawn at the same offset inside its
+// cell, so a quad the size of the cell reproduces the bitmap exactly
+struct FontFace {
+    void* glutFont;
+    int cellHeight;
+    int baseline;   // Pixels below the baseline inside the cell (descenders)
+
+    // Measured when the atlas is built
+    int cellWidth = 0;
+    int atlasY = 0; // First row of the face's cells
+    int advance[GLYPH_COUNT] = {};
+};
+
+FontFace faces[TEXT_FONT_COUNT] = {
+    { GLUT_BITMAP_HELVETICA_12, 20, 5 },
+    { GLUT_BITMAP_HELVETICA_18, 28, 7 },
+};
+
+struct TextVertex {
+    float position[2]; // Window coordinates
+    float texcoord[2];
+    uint8_t color[4];
+};
+
+GLuint atlasTexture = 0;
+int atlasWidth = 0;
+int atlasHeight = 0;
+GLuint vertexBuffer = 0;
+std::vector<TextVertex> vertices;
+int lastGlyphCount = 0;
+int lastDrawCalls = 0;
+
+int NextPowerOfTwo(int value) {
+    int result = 1;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
+
+int GlyphIndex(char c) {
+    int code = static_cast<unsigned char>(c);
+    return code >= FIRST_GLYPH && code <= LAST_GLYPH ? code - FIRST_GLYPH : -1;
+}
+
+// Draws every face into an offscreen colour buffer with glBitmap and reads back the coverage
+bool RasterizeAtlas(std::vector<uint8_t>& coverage) {
+    GLuint colorBuffer = 0;
+    GLuint framebuffer = 0;
+    glGenTextures(1, &colorBuffer);
+    glBindTexture(GL_TEXTURE_2D, colorBuffer);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasWidth, atlasHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffer, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    if (complete) {
+        glPushAttrib(GL_ALL_ATTRIB_BITS);
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glOrtho(0, atlasWidth, 0, atlasHeight, -1, 1);
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+
+        glViewport(0, 0, atlasWidth, atlasHeight);
+        glDisable(GL_LIGHTING);
+        glDisable(GL_TEXTURE_2D);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glColor3f(1.0f, 1.0f, 1.0f);
+        for (const FontFace& face : faces) {
+            for (int glyph = 0; glyph < GLYPH_COUNT; ++glyph) {
+                int x = (glyph % ATLAS_COLUMNS) * face.cellWidth + GLYPH_PADDING;
+                int y = face.atlasY + (glyph / ATLAS_COLUMNS) * face.cellHeight + face.baseline;
+                glRasterPos2i(x, y);
+                glutBitmapCharacter(face.glutFont, FIRST_GLYPH + glyph);
+            }
+        }
+
+        coverage.resize(static_cast<size_t>(atlasWidth) * atlasHeight);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, atlasWidth, atlasHeight, GL_RED, GL_UNSIGNED_BYTE, coverage.data());
+
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPopMatrix();
+        glPopAttrib();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &colorBuffer);
+    return complete;
+}
+
+// glutBitmapCharacter path for drivers without an atlas
+void DrawTextImmediate(const FontFace& face, float x, float y, const char* text) {
+    glRasterPos2f(x, y);
+    for (const char* c = text; *c != '\0'; c++) {
+        glutBitmapCharacter(face.glutFont, *c);
+    }
+}
+
+} // namespace
+
+bool InitTextRenderer() {
+    // Metrics first: TextWidth works with or without the atlas
+    int height = 0;
+    for (FontFace& face : faces) {
+        int widest = 0;
+        for (int glyph = 0; glyph < GLYPH_COUNT; ++glyph) {
+            face.advance[glyph] = glutBitmapWidth(face.glutFont, FIRST_GLYPH + glyph);
+            widest = std::max(widest, face.advance[glyph]);
+        }
+        face.cellWidth = widest + 2 * GLYPH_PADDING + 2;
+        face.atlasY = height;
+        height += ATLAS_ROWS * face.cellHeight;
+        atlasWidth = std::max(atlasWidth, ATLAS_COLUMNS * face.cellWidth);
+    }
+    atlasWidth = NextPowerOfTwo(atlasWidth);
+    atlasHeight = NextPowerOfTwo(height);
+
+    if (!GLEW_VERSION_1_5 || !(GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object)) {
+        std::cout << "TextRenderer: no framebuffer objects, text stays on glutBitmapCharacter" << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> coverage;
+    if (!RasterizeAtlas(coverage)) {
+        std::cerr << "TextRenderer: atlas framebuffer incomplete, text stays on glutBitmapCharacter" << std::endl;
+        return false;
+    }
+
+    // Coverage as alpha: GL_MODULATE keeps the vertex colour and multiplies its alpha
+    glGenTextures(1, &atlasTexture);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, atlasWidth, atlasHeight, 0, GL_ALPHA, GL_UNSIGNED_BYTE, coverage.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &vertexBuffer);
+    return true;
+}
+
+int TextWidth(TextFont font, const char* text) {
+    const FontFace& face = faces[font];
+    int width = 0;
+    for (const char* c = text; *c != '\0'; c++) {
+        int glyph = GlyphIndex(*c);
+        width += glyph >= 0 ? face.advance[glyph] : 0;
+    }
+    return width;
+}
+
+int TextWidth(TextFont font, const std::string& text) {
+    return TextWidth(font, text.c_str());
+}
+
+void QueueText(TextFont font, float x, float y, const char* text) {
+    const FontFace& face = faces[font];
+    if (!atlasTexture) {
+        DrawTextImmediate(face, x, y, text);
+        return;
+    }
+
+    // Where glRasterPos2f(x, y) would land, in window pixels
+    GLdouble modelView[16];
+    GLdouble projection[16];
+    GLint viewport[4];
+    glGetDoublev(GL_MODELVIEW_MATRIX, modelView);
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLdouble windowX = 0.0, windowY = 0.0, windowZ = 0.0;
+    if (!gluProject(x, y, 0.0, modelView, projection, viewport, &windowX, &windowY, &windowZ)) {
+        return;
+    }
+
+    GLfloat color[4];
+    glGetFloatv(GL_CURRENT_COLOR, color);
+    uint8_t packed[4];
+    for (int c = 0; c < 4; ++c) {
+        packed[c] = static_cast<uint8_t>(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    float penX = std::floor(static_cast<float>(windowX));
+    float penY = std::floor(static_cast<float>(windowY));
+    for (const char* c = text; *c != '\0'; c++) {
+        int glyph = GlyphIndex(*c);
+        if (glyph < 0) {
+            continue;
+        }
+        float x0 = penX - GLYPH_PADDING;
+        float y0 = penY - face.baseline;
+        float x1 = x0 + face.cellWidth;
+        float y1 = y0 + face.cellHeight;
+        float u0 = static_cast<float>((glyph % ATLAS_COLUMNS) * face.cellWidth) / atlasWidth;
+        float v0 = static_cast<float>(face.atlasY + (glyph / ATLAS_COLUMNS) * face.cellHeight) / atlasHeight;
+        float u1 = u0 + static_cast<float>(face.cellWidth) / atlasWidth;
+        float v1 = v0 + static_cast<float>(face.cellHeight) / atlasHeight;
+
+        const TextVertex quad[4] = {
+            { { x0, y0 }, { u0, v0 }, { packed[0], packed[1], packed[2], packed[3] } },
+            { { x1, y0 }, { u1, v0 }, { packed[0], packed[1], packed[2], packed[3] } },
+            { { x1, y1 }, { u1, v1 }, { packed[0], packed[1], packed[2], packed[3] } },
+            { { x0, y1 }, { u0, v1 }, { packed[0], packed[1], packed[2], packed[3] } },
+        };
+        vertices.insert(vertices.end(), quad, quad + 4);
+        penX += face.advance[glyph];
+    }
+}
+
+void QueueText(TextFont font, float x, float y, const std::string& text) {
+    QueueText(font, x, y, text.c_str());
+}
+
+void FlushText() {
+    lastGlyphCount = static_cast<int>(vertices.size() / 4);
+    lastDrawCalls = 0;
+    if (vertices.empty()) {
+        return;
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(viewport[0], viewport[0] + viewport[2], viewport[1], viewport[1] + viewport[3], -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+    // Orphan last frame's text, then one draw for all of this frame's
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TextVertex), vertices.data(), GL_STREAM_DRAW);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(TextVertex), reinterpret_cast<const void*>(offsetof(TextVertex, position)));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(TextVertex), reinterpret_cast<const void*>(offsetof(TextVertex, texcoord)));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(TextVertex), reinterpret_cast<const void*>(offsetof(TextVertex, color)));
+    glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(vertices.size()));
+    glPopClientAttrib();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    lastDrawCalls = 1;
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+    glPopAttrib();
+    vertices.clear();
+}
+
+int TextGlyphCount() {
+    return lastGlyphCount;
+}
+
+int TextDrawCalls() {
+    return lastDrawCalls;
+}
@@ -0,0 +1,43 @@
+#ifndef TEXTRENDERER_H
+#define TEXTRENDERER_H
+
+#include <string>
+
+// Screen text through a glyph atlas instead of glutBitmapCharacter. The GLUT bitmap
+// fonts the game already used are drawn once into a texture (printable ASCII of
+// each face), then every string queued in a frame becomes textured quads in one
+// vertex buffer, drawn with a single call by FlushText. Text looks the same as
+// before, pixel for pixel.
+//
+// Strings are placed as glRasterPos would place them (the position goes through the
+// modelview, projection and viewport current at QueueText, in the current colour),
+// so they can be queued from any 2D or 3D setup and flushed once at the end of the
+// frame. Without framebuffer objects, QueueText falls back to glutBitmapCharacter.
+
+enum TextFont {
+    TEXT_FONT_SMALL,    // GLUT_BITMAP_HELVETICA_12
+    TEXT_FONT_LARGE,    // GLUT_BITMAP_HELVETICA_18
+    TEXT_FONT_COUNT
+};
+
+// Builds the atlas. Call once after glewInit with the window's context current
+bool InitTextRenderer();
+
+// Width in pixels, as glutBitmapLength measures it
+int TextWidth(TextFont font, const char* text);
+int TextWidth(TextFont font, const std::string& text);
+
+// Queues text with its baseline starting at (x, y), like glRasterPos2f(x, y)
+// followed by glutBitmapCharacter per character. Does not allocate once the
+// frame's glyph buffer has grown to its usual size
+void QueueText(TextFont font, float x, float y, const char* text);
+void QueueText(TextFont font, float x, float y, const std::string& text);
+
+// Draws everything queued since the last flush on top of the frame; call before swapping
+void FlushText();
+
+// Glyphs and draw calls of the last flush, for the stats line
+int TextGlyphCount();
+int TextDrawCalls();
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include "glew.h"
 #include "glaux.h"
+#include "TextureUpload.h"
 
 #pragma comment(lib, "glew32.lib")
 #pragma comment(lib, "glaux.lib")
@@ -19,13 +20,7 @@ void loadPPM(GLuint *textureID, char *strFileName, int width, int height, int wr
 		exit(EXIT_FAILURE);
 	}
 
-	glGenTextures(1, textureID);
-	glBindTexture(GL_TEXTURE_2D, *textureID);
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap ? GL_REPEAT : GL_CLAMP);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap ? GL_REPEAT : GL_CLAMP);
+	*textureID = UploadTexture(data, width, height, 3, 1, wrap ? GL_REPEAT : GL_CLAMP, GL_LINEAR_MIPMAP_NEAREST);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
 	free(data);
@@ -44,13 +39,7 @@ void loadBMP(GLuint *textureID, char *strFileName, int wrap) {
 		exit(EXIT_FAILURE);
 	}
 
-	glGenTextures(1, textureID);
-	glBindTexture(GL_TEXTURE_2D, *textureID);
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, pBitmap->sizeX, pBitmap->sizeY, GL_RGB, GL_UNSIGNED_BYTE, pBitmap->data);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap ? GL_REPEAT : GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap ? GL_REPEAT : GL_CLAMP);
+	*textureID = UploadTexture(pBitmap->data, pBitmap->sizeX, pBitmap->sizeY, 3, 1, wrap ? GL_REPEAT : GL_CLAMP, GL_LINEAR_MIPMAP_NEAREST);
 
 	if (pBitmap) {
 		if (pBitmap->data) {
@@ -0,0 +1,269 @@
+#include "TextureUpload.h"
+#include "BlockCompression.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <glew.h>
+#include <glut.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TEXTURE_UPLOAD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// sum[i] = a[i] + b[i], widened to 16 bits
+void SumRows(const unsigned char* a, const unsigned char* b, int count, uint16_t* sum) {
+    int i = 0;
+#ifdef TEXTURE_UPLOAD_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i rowA = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i rowB = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(rowA, zero), _mm_unpacklo_epi8(rowB, zero));
+        __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(rowA, zero), _mm_unpackhi_epi8(rowB, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sum + i), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sum + i + 8), high);
+    }
+#endif
+    for (; i < count; ++i) {
+        sum[i] = static_cast<uint16_t>(a[i] + b[i]);
+    }
+}
+
+// Averages horizontal pairs of summed row pixels into one output row
+void AverageColumns(const uint16_t* sum, int width, int nextWidth, int components, unsigned char* dst) {
+    if (width == 1) {
+        for (int c = 0; c < components; ++c) {
+            dst[c] = static_cast<unsigned char>((sum[c] * 2 + 2) / 4);
+        }
+        return;
+    }
+
+    int x = 0;
+#ifdef TEXTURE_UPLOAD_SSE2
+    if (components == 4) {
+        // Eight source pixels in, four out; each register holds two RGBA pixels
+        const __m128i two = _mm_set1_epi16(2);
+        for (; x + 4 <= nextWidth; x += 4) {
+            const uint16_t* src = sum + x * 8;
+            __m128i p01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i p23 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+            __m128i p45 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+            __m128i p67 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 24));
+            __m128i out01 = _mm_add_epi16(_mm_unpacklo_epi64(p01, p23), _mm_unpackhi_epi64(p01, p23));
+            __m128i out23 = _mm_add_epi16(_mm_unpacklo_epi64(p45, p67), _mm_unpackhi_epi64(p45, p67));
+            out01 = _mm_srli_epi16(_mm_add_epi16(out01, two), 2);
+            out23 = _mm_srli_epi16(_mm_add_epi16(out23, two), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(out01, out23));
+        }
+    }
+#endif
+    for (; x < nextWidth; ++x) {
+        const uint16_t* left = sum + (x * 2) * components;
+        const uint16_t* right = left + components;
+        for (int c = 0; c < components; ++c) {
+            dst[x * components + c] = static_cast<unsigned char>((left[c] + right[c] + 2) / 4);
+        }
+    }
+}
+
+bool IsPowerOfTwo(int value) {
+    return (value & (value - 1)) == 0;
+}
+
+int NextPowerOfTwo(int value) {
+    int result = 1;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
+
+bool NonPowerOfTwoSupported() {
+    return GLEW_VERSION_2_0 || GLEW_ARB_texture_non_power_of_two;
+}
+
+bool BlockFormatSupported(unsigned int format) {
+    if (format == BLOCK_FORMAT_BC7) {
+        return GLEW_ARB_texture_compression_bptc;
+    }
+    return GLEW_EXT_texture_compression_s3tc;
+}
+
+void SetTextureParameters(int mipCount, unsigned int wrap, unsigned int minFilter) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+bool GenerateMipmapSupported() {
+    return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object || GLEW_EXT_framebuffer_object;
+}
+
+} // namespace
+
+int MipLevelCount(int width, int height) {
+    int levels = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+size_t MipChainSize(int width, int height, int components, int mipCount) {
+    size_t size = 0;
+    for (int level = 0; level < mipCount; ++level) {
+        size += static_cast<size_t>(width) * height * components;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return size;
+}
+
+void DownsampleBox(const unsigned char* src, int width, int height, int components, unsigned char* dst) {
+    int nextWidth = std::max(1, width / 2);
+    int nextHeight = std::max(1, height / 2);
+    size_t rowSize = static_cast<size_t>(width) * components;
+    std::vector<uint16_t> sum(rowSize);
+
+    for (int y = 0; y < nextHeight; ++y) {
+        const unsigned char* row0 = src + (y * 2) * rowSize;
+        const unsigned char* row1 = height == 1 ? row0 : row0 + rowSize;
+        SumRows(row0, row1, static_cast<int>(rowSize), sum.data());
+        AverageColumns(sum.data(), width, nextWidth, components, dst + static_cast<size_t>(y) * nextWidth * components);
+    }
+}
+
+int BuildMipChain(const unsigned char* pixels, int width, int height, int components, std::vector<unsigned char>& levels) {
+    int mipCount = MipLevelCount(width, height);
+    levels.resize(MipChainSize(width, height, components, mipCount));
+    std::copy(pixels, pixels + static_cast<size_t>(width) * height * components, levels.begin());
+
+    unsigned char* level = levels.data();
+    for (int i = 1; i < mipCount; ++i) {
+        unsigned char* next = level + static_cast<size_t>(width) * height * components;
+        DownsampleBox(level, width, height, components, next);
+        level = next;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return mipCount;
+}
+
+unsigned int UploadTexture(const unsigned char* levels, int width, int height, int components, int mipCount,
+    unsigned int wrap, unsigned int minFilter) {
+    if (!levels || width <= 0 || height <= 0 || (components != 3 && components != 4)) {
+        std::cerr << "UploadTexture: unsupported image " << width << "x" << height << "x" << components << std::endl;
+        return 0;
+    }
+
+    GLenum format = components == 3 ? GL_RGB : GL_RGBA;
+    GLint internalFormat = components == 3 ? GL_RGB8 : GL_RGBA8;
+
+    GLint previousAlignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Only drivers without NPOT support get the image stretched, as gluBuild2DMipmaps always did
+    std::vector<unsigned char> scaled;
+    if (!NonPowerOfTwoSupported() && (!IsPowerOfTwo(width) || !IsPowerOfTwo(height))) {
+        int scaledWidth = NextPowerOfTwo(width);
+        int scaledHeight = NextPowerOfTwo(height);
+        scaled.resize(static_cast<size_t>(scaledWidth) * scaledHeight * components);
+
+        GLint previousPackAlignment;
+        glGetIntegerv(GL_PACK_ALIGNMENT, &previousPackAlignment);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        gluScaleImage(format, width, height, GL_UNSIGNED_BYTE, levels, scaledWidth, scaledHeight, GL_UNSIGNED_BYTE, scaled.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, previousPackAlignment);
+
+        levels = scaled.data();
+        width = scaledWidth;
+        height = scaledHeight;
+        mipCount = 1; // A baked chain no longer matches the scaled size
+    }
+
+    int fullCount = MipLevelCount(width, height);
+    bool generate = mipCount == 1 && fullCount > 1 && GenerateMipmapSupported();
+    std::vector<unsigned char> chain;
+    if (mipCount == 1 && !generate) {
+        mipCount = BuildMipChain(levels, width, height, components, chain);
+        levels = chain.data();
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    GLsizei levelWidth = width;
+    GLsizei levelHeight = height;
+    for (int level = 0; level < mipCount; ++level) {
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, levelWidth, levelHeight, 0, format, GL_UNSIGNED_BYTE, levels);
+        levels += static_cast<size_t>(levelWidth) * levelHeight * components;
+        levelWidth = std::max(1, levelWidth / 2);
+        levelHeight = std::max(1, levelHeight / 2);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+
+    if (generate) {
+        if (GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object) {
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        else {
+            glGenerateMipmapEXT(GL_TEXTURE_2D);
+        }
+        mipCount = fullCount;
+    }
+
+    SetTextureParameters(mipCount, wrap, minFilter);
+    return texture;
+}
+
+unsigned int UploadCompressedTexture(const unsigned char* levels, int width, int height, unsigned int format, int mipCount,
+    unsigned int wrap, unsigned int minFilter) {
+    if (!levels || width <= 0 || height <= 0 || !IsBlockFormat(format)) {
+        std::cerr << "UploadCompressedTexture: unsupported image " << width << "x" << height << " format " << format << std::endl;
+        return 0;
+    }
+
+    bool supported = BlockFormatSupported(format);
+    if (!supported) {
+        std::cout << "UploadCompressedTexture: no driver support for " << BlockFormatName(format) << ", decoding on the CPU" << std::endl;
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    GLint previousAlignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    std::vector<unsigned char> decoded;
+    GLsizei levelWidth = width;
+    GLsizei levelHeight = height;
+    for (int level = 0; level < mipCount; ++level) {
+        size_t levelSize = CompressedLevelSize(levelWidth, levelHeight, format);
+        if (supported) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, format, levelWidth, levelHeight, 0, static_cast<GLsizei>(levelSize), levels);
+        }
+        else {
+            decoded.resize(static_cast<size_t>(levelWidth) * levelHeight * 4);
+            DecompressImage(levels, levelWidth, levelHeight, format, decoded.data());
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, levelWidth, levelHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, decoded.data());
+        }
+        levels += levelSize;
+        levelWidth = std::max(1, levelWidth / 2);
+        levelHeight = std::max(1, levelHeight / 2);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+
+    SetTextureParameters(mipCount, wrap, minFilter);
+    return texture;
+}
@@ -0,0 +1,40 @@
+#ifndef TEXTUREUPLOAD_H
+#define TEXTUREUPLOAD_H
+
+#include <cstddef>
+#include <vector>
+
+// Mip chain building and texture creation shared by every loader (GLTFAsset, the
+// car select images, TextureBuilder.h and GLTexture). Images are 8-bit RGB or RGBA
+// with tightly packed rows. A chain stores its levels back to back, largest first,
+// each halving (rounding down) until 1x1, the same layout CookedImage uses.
+
+// Number of levels from width x height down to 1x1
+int MipLevelCount(int width, int height);
+
+// Bytes taken by the first mipCount levels of a chain
+size_t MipChainSize(int width, int height, int components, int mipCount);
+
+// Halves an image with a 2x2 box filter, using SSE2 where the target has it.
+// dst must hold max(1, width / 2) * max(1, height / 2) * components bytes
+void DownsampleBox(const unsigned char* src, int width, int height, int components, unsigned char* dst);
+
+// Replaces levels with the full chain of pixels, level 0 included. Touches no GL
+// state, so loader threads can run it. Returns the number of levels
+int BuildMipChain(const unsigned char* pixels, int width, int height, int components, std::vector<unsigned char>& levels);
+
+// Creates a mipmapped GL_TEXTURE_2D on the GL thread and returns its name, 0 on failure.
+// levels holds mipCount levels; with a single level the rest of the chain comes from
+// glGenerateMipmap, or from BuildMipChain on drivers without it. Every level is uploaded
+// once. Non-power-of-two images are kept as they are unless the driver lacks NPOT support.
+// The new texture is left bound
+unsigned int UploadTexture(const unsigned char* levels, int width, int height, int components, int mipCount,
+    unsigned int wrap, unsigned int minFilter);
+
+// Same for a block-compressed chain (format is a BLOCK_FORMAT_* value), uploaded
+// with glCompressedTexImage2D. Drivers without the format get each level decoded
+// to RGBA8 instead
+unsigned int UploadCompressedTexture(const unsigned char* levels, int width, int height, unsigned int format, int mipCount,
+    unsigned int wrap, unsigned int minFilter);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for CPU-side loading work: file I/O, parsing and
+// image decoding. Jobs must not touch OpenGL; results go back to the GLUT thread
+// through the returned futures and are uploaded there. Workers are started on the
+// first Submit, so a pool that is never used costs nothing.
+class ThreadPool {
+public:
+    // threadCount 0 sizes the pool to the machine, leaving one core for the GLUT thread
+    explicit ThreadPool(unsigned threadCount = 0) : threadCount(threadCount) {}
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    template <typename F>
+    auto Submit(F&& job) -> std::future<decltype(job())> {
+        using Result = decltype(job());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (workers.empty()) {
+                Start();
+            }
+            jobs.push([task]() { (*task)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    unsigned threadCount;
+
+    void Start() {
+        // One core is left for the GLUT thread, which keeps uploading while the workers decode
+        unsigned count = threadCount ? threadCount : std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned i = 0; i < count; ++i) {
+            workers.emplace_back([this]() { Run(); });
+        }
+    }
+
+    void Run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
+
+#endif
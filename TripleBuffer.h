@@ -0,0 +1,44 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Hands values from one producer thread to one consumer thread without locks. The
+// producer fills WriteSlot and publishes it; the consumer takes whatever was
+// published last. Neither side ever waits for the other: the three slots are one
+// being written, one being read and one holding the latest publish, and the two
+// sides only swap indices with the middle one.
+//
+// Slots are reused, so the producer must fill every field before each Publish.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() = default;
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Producer side
+    T& WriteSlot() { return slots[writeIndex]; }
+    void Publish() {
+        writeIndex = shared.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Consumer side. The reference stays valid, and unchanged, until the next call
+    const T& Latest() {
+        if (shared.load(std::memory_order_relaxed) & FRESH) {
+            readIndex = shared.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+        return slots[readIndex];
+    }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4; // Set on the middle index when the consumer has not taken it yet
+
+    T slots[3];
+    std::atomic<int> shared{ 1 };
+    int writeIndex = 0;
+    int readIndex = 2;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include "VertexQuantize.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const float POSITION_RANGE = 32767.0f;
+
+int16_t QuantizePosition(float value, float offset, float scale) {
+    float grid = std::round((value - offset) / scale);
+    return static_cast<int16_t>(std::min(std::max(grid, -POSITION_RANGE), POSITION_RANGE));
+}
+
+int8_t QuantizeSnorm8(float value) {
+    float scaled = std::round(value * 127.0f);
+    return static_cast<int8_t>(std::min(std::max(scaled, -127.0f), 127.0f));
+}
+
+} // namespace
+
+QuantizationGrid MakeQuantizationGrid(const float* boxMin, const float* boxMax) {
+    QuantizationGrid grid;
+    float halfExtent = 0.0f;
+    for (int c = 0; c < 3; ++c) {
+        grid.offset[c] = (boxMin[c] + boxMax[c]) * 0.5f;
+        halfExtent = std::max(halfExtent, (boxMax[c] - boxMin[c]) * 0.5f);
+    }
+    grid.scale = halfExtent / POSITION_RANGE;
+    if (!(grid.scale > 0.0f) || !std::isfinite(grid.scale)) {
+        grid.scale = 1.0f; // Empty or degenerate box
+    }
+    return grid;
+}
+
+uint16_t FloatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    if (magnitude >= 0x7F800000) {
+        return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0); // Infinity or NaN
+    }
+    if (magnitude >= 0x477FF000) {
+        return sign | 0x7C00; // Rounds past 65504
+    }
+    if (magnitude < 0x38800000) {
+        // Below the smallest normal half (2^-14): denormal or zero
+        if (magnitude < 0x33000000) {
+            return sign;
+        }
+        uint32_t shift = 126 - (magnitude >> 23);
+        uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        return sign | static_cast<uint16_t>((mantissa + (1u << (shift - 1))) >> shift);
+    }
+
+    // Rebias the exponent, then round to nearest even; a carry out of the mantissa
+    // correctly bumps the exponent
+    uint32_t rebased = magnitude - (112u << 23);
+    return sign | static_cast<uint16_t>((rebased + 0xFFF + ((rebased >> 13) & 1)) >> 13);
+}
+
+void QuantizeVertices(const CookedVertex* vertices, size_t count, const QuantizationGrid& grid, std::vector<QuantizedVertex>& out) {
+    out.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const CookedVertex& source = vertices[i];
+        QuantizedVertex& packed = out[i];
+        for (int c = 0; c < 3; ++c) {
+            packed.position[c] = QuantizePosition(source.position[c], grid.offset[c], grid.scale);
+            packed.normal[c] = QuantizeSnorm8(source.normal[c]);
+        }
+        packed.position[3] = 0;
+        packed.normal[3] = 0;
+        packed.texcoord[0] = FloatToHalf(source.texcoord[0]);
+        packed.texcoord[1] = FloatToHalf(source.texcoord[1]);
+        for (int c = 0; c < 4; ++c) {
+            packed.tangent[c] = QuantizeSnorm8(source.tangent[c]);
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef VERTEXQUANTIZE_H
+#define VERTEXQUANTIZE_H
+
+#include "CookedAsset.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compact vertex layout GLTFAsset uploads in place of CookedVertex (20 bytes instead
+// of 48). Every attribute is a type the fixed-function arrays accept directly:
+//
+//   position  GL_SHORT, integer grid values; the mesh's dequantization transform
+//             (offset + scale * value) goes on the modelview before drawing
+//   normal    GL_BYTE, which glNormalPointer maps to [-1, 1]
+//   texcoord  GL_HALF_FLOAT (GL 3.0 or ARB_half_float_vertex); primitives the
+//             cooker flags COOKED_WIDE_TEXCOORDS are uploaded as CookedVertex instead
+//   tangent   GL_BYTE, normalized by glVertexAttribPointer
+//
+// The scale is the same on every axis, so the transform leaves normals pointing the
+// right way for GL_NORMALIZE and the instanced shader to fix up their length.
+struct QuantizedVertex {
+    int16_t position[4]; // w unused, keeps the normal 4-byte aligned
+    int8_t normal[4];    // w unused
+    uint16_t texcoord[2];
+    int8_t tangent[4];
+};
+
+// Grid shared by the primitives of one mesh, so vertices on a seam between them
+// (the cooker's chunks) land on the same values
+struct QuantizationGrid {
+    float offset[3];     // Position of grid value 0
+    float scale;         // Object units per grid step
+};
+
+// Grid covering boxMin..boxMax with 16-bit precision on its longest axis
+QuantizationGrid MakeQuantizationGrid(const float* boxMin, const float* boxMax);
+
+// IEEE half from a float, rounded to nearest; overflow becomes infinity
+uint16_t FloatToHalf(float value);
+
+// Packs count vertices on the grid into out
+void QuantizeVertices(const CookedVertex* vertices, size_t count, const QuantizationGrid& grid, std::vector<QuantizedVertex>& out);
+
+#endif